@@ -19,12 +19,11 @@ void MakeReplicateFileName(const string &Pattern, TREEPERM TP,
 		FileName += Pattern[i];
 	}
 
+// One MSA per TREEPERM, sharing posteriors and consistency.
 static void Align(MPCFlat &M, MultiSequence &InputSeqs,
-  uint PerturbSeed, TREEPERM TP, bool WriteEfaHdr, FILE *fOut)
+  uint PerturbSeed, const vector<TREEPERM> &TPs,
+  vector<MultiSequence *> &MSAs)
 	{
-	if (fOut == 0)
-		return;
-
 	bool Nucleo = (g_Alpha == ALPHA_Nucleo);
 	HMMParams HP;
 	if (optset_hmmin)
@@ -39,17 +38,9 @@ static void Align(MPCFlat &M, MultiSequence &InputSeqs,
 		}
 	HP.ToPairHMM();
 
-	M.m_TreePerm = TP;
-	M.Run(&InputSeqs);
-
-	asserta(M.m_MSA != 0);
-
-	if (WriteEfaHdr)
-		{
-		const char *TPStr = TREEPERMToStr(TP);
-		fprintf(fOut, "<%s.%u\n", TPStr, PerturbSeed);
-		}
-	M.m_MSA->WriteMFA(fOut);
+	M.m_RefineSeed = HashMix32(optd(randseed, 1), PerturbSeed);
+	M.RunPerms(&InputSeqs, TPs, MSAs);
+	asserta(SIZE(MSAs) == SIZE(TPs));
 	}
 
 void cmd_align()
@@ -70,7 +61,7 @@ void cmd_align()
 		}
 
 	if (InputSeqCount > 1000)
-		Warning(">1k sequences, may be slow or use excessive memory, consider using -super5");
+		Warning(">1k sequences, may be slow or use excessive memory, consider using -super5 or -consz");
 
 	const string &OutputPattern = opt(output);
 	if (OutputPattern.empty())
@@ -90,8 +81,14 @@ void cmd_align()
 	MPCFlat M;
 	if (optset_consiters)
 		M.m_ConsistencyIterCount = opt(consiters);
+	if (optset_consz)
+		M.m_ConsSampleSize = opt(consz);
 	if (optset_refineiters)
 		M.m_RefineIterCount = opt(refineiters);
+	if (optset_refinebatch)
+		M.m_RefineBatchSize = opt(refinebatch);
+	if (optset_refinestop)
+		M.m_RefineStopRounds = opt(refinestop);
 
 	if (opt(stratified) && opt(diversified))
 		Die("Cannot set both -stratified and -diversified");
@@ -129,7 +126,14 @@ void cmd_align()
 		else
 			OutputFileName = OutputPattern;
 		fOut = CreateStdioFile(OutputFileName);
-		Align(M, InputSeqs, PerturbSeed, TP, false, fOut);
+		if (fOut != 0)
+			{
+			vector<TREEPERM> TPs(1, TP);
+			vector<MultiSequence *> MSAs;
+			Align(M, InputSeqs, PerturbSeed, TPs, MSAs);
+			MSAs[0]->WriteMFA(fOut);
+			delete MSAs[0];
+			}
 		CloseStdioFile(fOut);
 		return;
 		}
@@ -147,23 +151,42 @@ void cmd_align()
 	string OutputFileName;
 	if (!OutputWildcard)
 		fOut = CreateStdioFile(OutputPattern);
-	for (uint RepIndex = 0; RepIndex < RepCount; ++RepIndex)
+// Consecutive replicates with the same perturbation differ only
+// by TREEPERM, align them together to share posteriors.
+	for (uint RepIndex = 0; RepIndex < RepCount; )
 		{
 		uint PerturbSeed = (Stratified ? RepIndex/4 : RepIndex);
-		TREEPERM TP = (optset_perm ? 
-		  StrToTREEPERM(opt(perm)) : TREEPERM(RepIndex%4));
-		ProgressLog("Replicate %u/%u, %s.%u\n",
-		  RepIndex+1, RepCount, TREEPERMToStr(TP), PerturbSeed);
+		vector<TREEPERM> TPs;
+		uint RepIndex2 = RepIndex;
+		while (RepIndex2 < RepCount &&
+		  (Stratified ? RepIndex2/4 : RepIndex2) == PerturbSeed)
+			{
+			TREEPERM TP = (optset_perm ? 
+			  StrToTREEPERM(opt(perm)) : TREEPERM(RepIndex2%4));
+			ProgressLog("Replicate %u/%u, %s.%u\n",
+			  RepIndex2+1, RepCount, TREEPERMToStr(TP), PerturbSeed);
+			TPs.push_back(TP);
+			++RepIndex2;
+			}
 
-		if (OutputWildcard)
+		vector<MultiSequence *> MSAs;
+		Align(M, InputSeqs, PerturbSeed, TPs, MSAs);
+		for (uint i = 0; i < SIZE(TPs); ++i)
 			{
-			MakeReplicateFileName(OutputPattern, TP, PerturbSeed, OutputFileName);
-			fOut = CreateStdioFile(OutputFileName);
+			TREEPERM TP = TPs[i];
+			if (OutputWildcard)
+				{
+				MakeReplicateFileName(OutputPattern, TP, PerturbSeed, OutputFileName);
+				fOut = CreateStdioFile(OutputFileName);
+				}
+			else
+				fprintf(fOut, "<%s.%u\n", TREEPERMToStr(TP), PerturbSeed);
+			MSAs[i]->WriteMFA(fOut);
+			delete MSAs[i];
+			if (OutputWildcard)
+				CloseStdioFile(fOut);
 			}
-		bool WriteEfaHeader = !OutputWildcard;
-		Align(M, InputSeqs, PerturbSeed, TP, WriteEfaHeader, fOut);
-		if (OutputWildcard)
-			CloseStdioFile(fOut);
+		RepIndex = RepIndex2;
 		}
 
 	if (!OutputWildcard)
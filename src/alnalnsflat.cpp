@@ -10,8 +10,6 @@ MultiSequence *MPCFlat::AlignAlns(const MultiSequence *ptrMSA1,
   const MultiSequence *ptrMSA2, float *ptrScore)
 	{
 	const uint MAX_COL_COUNT = optd(maxcols, 5000);
-	const uint SeqCount1 = ptrMSA1->GetSeqCount();
-	const uint SeqCount2 = ptrMSA2->GetSeqCount();
 
 	uint ColCount1 = ptrMSA1->GetColCount();
 	uint ColCount2 = ptrMSA2->GetColCount();
@@ -30,9 +28,9 @@ MultiSequence *MPCFlat::AlignAlns(const MultiSequence *ptrMSA1,
 		ColCount2 = ptrMSA2->GetColCount();
 		}
 
-// INT_MAX=2147483647; 5 N^2 == 2147483647; N = sqrt(2147483647/5) = 20724
-	if (double(ColCount1)*double(ColCount2)*5 + 100 > double(INT_MAX))
-		Die("Join Cols1=%u, Cols2=%u overflow 64-bit HMM buffers", ColCount1, ColCount2);
+// Post and TB are indexed with 32-bit offsets, no HMM buffers here
+	if (double(ColCount1 + 1)*double(ColCount2 + 1) + 100 > double(UINT_MAX))
+		Die("Join Cols1=%u, Cols2=%u overflow 32-bit DP buffers", ColCount1, ColCount2);
 
 	float *Post = AllocPost(ColCount1, ColCount2);
 	BuildPost(*ptrMSA1, *ptrMSA2, Post);
@@ -48,23 +46,32 @@ MultiSequence *MPCFlat::AlignAlns(const MultiSequence *ptrMSA1,
 	myfree(DPRows);
 	myfree(TB);
 
+	MultiSequence *result = AlignAlnsFromPath(ptrMSA1, ptrMSA2, Path);
+
+	if (ptrSqueezedMSA1 != 0) delete ptrSqueezedMSA1;
+	if (ptrSqueezedMSA2 != 0) delete ptrSqueezedMSA2;
+
+	return result;
+	}
+
+MultiSequence *AlignAlnsFromPath(const MultiSequence *MSA1,
+  const MultiSequence *MSA2, const string &Path)
+	{
+	const uint SeqCount1 = MSA1->GetSeqCount();
+	const uint SeqCount2 = MSA2->GetSeqCount();
 	MultiSequence *result = new MultiSequence();
 	for (uint SeqIndex1 = 0; SeqIndex1 < SeqCount1; ++SeqIndex1)
 		{
-		const Sequence *InputRow = ptrMSA1->GetSequence(SeqIndex1);
+		const Sequence *InputRow = MSA1->GetSequence(SeqIndex1);
 		Sequence *AlignedRow = InputRow->AddGapsPath(Path, 'X');
 		result->AddSequence(AlignedRow, true);
 		}
 
 	for (uint SeqIndex2 = 0; SeqIndex2 < SeqCount2; ++SeqIndex2)
 		{
-		const Sequence *InputRow = ptrMSA2->GetSequence(SeqIndex2);
+		const Sequence *InputRow = MSA2->GetSequence(SeqIndex2);
 		Sequence *AlignedRow = InputRow->AddGapsPath(Path, 'Y');
 		result->AddSequence(AlignedRow, true);
 		}
-
-	if (ptrSqueezedMSA1 != 0) delete ptrSqueezedMSA1;
-	if (ptrSqueezedMSA2 != 0) delete ptrSqueezedMSA2;
-
 	return result;
 	}
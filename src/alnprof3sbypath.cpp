@@ -3,13 +3,24 @@
 #include "pwpath.h"
 #include "profile3.h"
 
-static ProfPos3 g_PPStart;
-static bool InitPPStart()
+struct Dimers3
 	{
-	g_PPStart.SetStartDimers();
-	return true;
+	float m_LL;
+	float m_LG;
+	float m_GL;
+	float m_GG;
+	};
+
+// Pseudo-column before first actual column
+static const Dimers3 g_DimersStart = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+static void GetDimers(const Profile3 &Prof, uint ColIndex, Dimers3 &D)
+	{
+	D.m_LL = Prof.m_LL[ColIndex];
+	D.m_LG = Prof.m_LG[ColIndex];
+	D.m_GL = Prof.m_GL[ColIndex];
+	D.m_GG = Prof.m_GG[ColIndex];
 	}
-static bool g_PPStartInitDone = InitPPStart();
 
 // MM
 //  Ai1	Ai		Out
@@ -24,12 +35,12 @@ static bool g_PPStartInitDone = InitPPStart();
 //  -		X	GL	GL
 //  -		-	GG	GG
 static void SetDimersMM(
-  const ProfPos3 *PPA, float wA,const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wA*PPA->m_LL + wB*PPB->m_LL;
-	PPAB.m_LG = wA*PPA->m_LG + wB*PPB->m_LG;
-	PPAB.m_GL = wA*PPA->m_GL + wB*PPB->m_GL;
-	PPAB.m_GG = wA*PPA->m_GG + wB*PPB->m_GG;
+	DAB.m_LL = wA*DA.m_LL + wB*DB.m_LL;
+	DAB.m_LG = wA*DA.m_LG + wB*DB.m_LG;
+	DAB.m_GL = wA*DA.m_GL + wB*DB.m_GL;
+	DAB.m_GG = wA*DA.m_GG + wB*DB.m_GG;
 	}
 
 // MD
@@ -43,12 +54,12 @@ static void SetDimersMM(
 //  X		-	?L	LG
 //  -		-	?G	GG
 static void SetDimersMD(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wA*PPA->m_LL;
-	PPAB.m_LG = wA*PPA->m_LG + wB*(PPB->m_LL + PPB->m_GL);
-	PPAB.m_GL = wA*PPA->m_GL;
-	PPAB.m_GG = wA*PPA->m_GG + wB*(PPB->m_LG + PPB->m_GG);
+	DAB.m_LL = wA*DA.m_LL;
+	DAB.m_LG = wA*DA.m_LG + wB*(DB.m_LL + DB.m_GL);
+	DAB.m_GL = wA*DA.m_GL;
+	DAB.m_GG = wA*DA.m_GG + wB*(DB.m_LG + DB.m_GG);
 	}
 
 // DD
@@ -61,12 +72,12 @@ static void SetDimersMD(
 //  (-)		(-)
 //  -		-	??	GG
 static void SetDimersDD(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wA*PPA->m_LL;
-	PPAB.m_LG = wA*PPA->m_LG;
-	PPAB.m_GL = wA*PPA->m_GL;
-	PPAB.m_GG = wA*PPA->m_GG + wB;
+	DAB.m_LL = wA*DA.m_LL;
+	DAB.m_LG = wA*DA.m_LG;
+	DAB.m_GL = wA*DA.m_GL;
+	DAB.m_GG = wA*DA.m_GG + wB;
 	}
 
 // MI
@@ -80,12 +91,12 @@ static void SetDimersDD(
 //  -		X	GL	GL
 //  -		-	GG	GG
 static void SetDimersMI(
-  const ProfPos3 *PPA, float wA,const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wB*PPB->m_LL;
-	PPAB.m_LG = wB*PPB->m_LG + wA*(PPA->m_LL + PPA->m_GL);
-	PPAB.m_GL = wB*PPB->m_GL;
-	PPAB.m_GG = wB*PPB->m_GG + wA*(PPA->m_LG + PPA->m_GG);
+	DAB.m_LL = wB*DB.m_LL;
+	DAB.m_LG = wB*DB.m_LG + wA*(DA.m_LL + DA.m_GL);
+	DAB.m_GL = wB*DB.m_GL;
+	DAB.m_GG = wB*DB.m_GG + wA*(DA.m_LG + DA.m_GG);
 	}
 
 // DM
@@ -99,12 +110,12 @@ static void SetDimersMI(
 //  -		X		?L	GL
 //  -		-		?G	GG
 static void SetDimersDM(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wA*PPA->m_LL;
-	PPAB.m_LG = wA*PPA->m_LG;
-	PPAB.m_GL = wA*PPA->m_GL + wB*(PPB->m_LL + PPB->m_GL);
-	PPAB.m_GG = wA*PPA->m_GG + wB*(PPB->m_LG + PPB->m_GG);
+	DAB.m_LL = wA*DA.m_LL;
+	DAB.m_LG = wA*DA.m_LG;
+	DAB.m_GL = wA*DA.m_GL + wB*(DB.m_LL + DB.m_GL);
+	DAB.m_GG = wA*DA.m_GG + wB*(DB.m_LG + DB.m_GG);
 	}
 
 // IM
@@ -118,12 +129,12 @@ static void SetDimersDM(
 //  -		X	GL	GL
 //  -		-	GG	GG
 static void SetDimersIM(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wB*PPB->m_LL;
-	PPAB.m_LG = wB*PPB->m_LG;
-	PPAB.m_GL = wB*PPB->m_GL + wA*(PPA->m_LL + PPA->m_GL);
-	PPAB.m_GG = wB*PPB->m_GG + wA*(PPA->m_LG + PPA->m_GG);
+	DAB.m_LL = wB*DB.m_LL;
+	DAB.m_LG = wB*DB.m_LG;
+	DAB.m_GL = wB*DB.m_GL + wA*(DA.m_LL + DA.m_GL);
+	DAB.m_GG = wB*DB.m_GG + wA*(DA.m_LG + DA.m_GG);
 	}
 
 // ID
@@ -135,12 +146,12 @@ static void SetDimersIM(
 //  X		-	?L	LG
 //  -		-	?G	GG
 static void SetDimersID(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = 0;
-	PPAB.m_LG = wB*PPB->m_GL + wB*PPB->m_LL;
-	PPAB.m_GL = wA*PPA->m_GL + wA*PPA->m_LL;
-	PPAB.m_GG = wA*(PPA->m_LG + PPA->m_GG) + wB*(PPB->m_LG + PPB->m_GG);
+	DAB.m_LL = 0;
+	DAB.m_LG = wB*DB.m_GL + wB*DB.m_LL;
+	DAB.m_GL = wA*DA.m_GL + wA*DA.m_LL;
+	DAB.m_GG = wA*(DA.m_LG + DA.m_GG) + wB*(DB.m_LG + DB.m_GG);
 	}
 
 // DI
@@ -152,12 +163,12 @@ static void SetDimersID(
 //  -		X	?L	GL
 //  -		-	?G	GG
 static void SetDimersDI(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = 0;
-	PPAB.m_LG = wA*PPA->m_GL + wA*PPA->m_LL;
-	PPAB.m_GL = wB*PPB->m_GL + wB*PPB->m_LL;
-	PPAB.m_GG = wA*(PPA->m_LG + PPA->m_GG) + wB*(PPB->m_LG + PPB->m_GG);
+	DAB.m_LL = 0;
+	DAB.m_LG = wA*DA.m_GL + wA*DA.m_LL;
+	DAB.m_GL = wB*DB.m_GL + wB*DB.m_LL;
+	DAB.m_GG = wA*(DA.m_LG + DA.m_GG) + wB*(DB.m_LG + DB.m_GG);
 	}
 
 // II
@@ -170,27 +181,29 @@ static void SetDimersDI(
 //  -		X	GL	GL
 //  -		-	GG	GG
 static void SetDimersII(
-  const ProfPos3 *PPA, float wA, const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+  const Dimers3 &DA, float wA, const Dimers3 &DB, float wB, Dimers3 &DAB)
 	{
-	PPAB.m_LL = wB*PPB->m_LL;
-	PPAB.m_LG = wB*PPB->m_LG;
-	PPAB.m_GL = wB*PPB->m_GL;
-	PPAB.m_GG = wB*PPB->m_GG + wA;
+	DAB.m_LL = wB*DB.m_LL;
+	DAB.m_LG = wB*DB.m_LG;
+	DAB.m_GL = wB*DB.m_GL;
+	DAB.m_GG = wB*DB.m_GG + wA;
 	}
 
-static void SetFreqs1(const ProfPos3 *PP, float w, ProfPos3 &PPAB)
+static void SetFreqs1(const float *Freqs, float w, float *FreqsAB)
 	{
 	for (uint i = 0; i < g_AlphaSize; ++i)
-		PPAB.m_Freqs[i] = w*PP->m_Freqs[i];
-	//PPAB.NormalizeAAFreqsIfRequired();
+		FreqsAB[i] = w*Freqs[i];
+	for (uint i = g_AlphaSize; i < 20; ++i)
+		FreqsAB[i] = 0;
 	}
 
-static void SetFreqs2(const ProfPos3 *PPA, float wA, 
-  const ProfPos3 *PPB, float wB, ProfPos3 &PPAB)
+static void SetFreqs2(const float *FreqsA, float wA,
+  const float *FreqsB, float wB, float *FreqsAB)
 	{
 	for (uint i = 0; i < g_AlphaSize; ++i)
-		PPAB.m_Freqs[i] = wA*PPA->m_Freqs[i] + wB*PPB->m_Freqs[i];
-	//PPAB.NormalizeAAFreqsIfRequired();
+		FreqsAB[i] = wA*FreqsA[i] + wB*FreqsB[i];
+	for (uint i = g_AlphaSize; i < 20; ++i)
+		FreqsAB[i] = 0;
 	}
 
 void AlignTwoProfsGivenPath(const Profile3 &ProfA, float WeightA,
@@ -224,31 +237,29 @@ void AlignTwoProfsGivenPath(const Profile3 &ProfA, float WeightA,
 	}
 #endif
 
-	ProfAB.Clear();
-	ProfAB.m_PPs.reserve(EdgeCount);
+	ProfAB.Alloc(EdgeCount);
 	char cPrevType = 'M';
 	uint PosA = 0;
 	uint PosB = 0;
-	ProfPos3 *PPA = &g_PPStart;
-	ProfPos3 *PPB = &g_PPStart;
+	Dimers3 DA = g_DimersStart;
+	Dimers3 DB = g_DimersStart;
+	Dimers3 DAB = g_DimersStart;
 	for (uint EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
 		{
 		const char cType = Path[EdgeIndex];
-		ProfPos3 &PPAB = *new ProfPos3;
-
-		PPAB.m_AllGaps = false;
+		float *FreqsAB = ProfAB.GetFreqs(EdgeIndex);
 		switch (cType)
 			{
 		case 'M':
 			{
-			PPA = ProfA.m_PPs[PosA];
-			PPB = ProfB.m_PPs[PosB];
-			SetFreqs2(PPA, wA, PPB, wB, PPAB);
+			GetDimers(ProfA, PosA, DA);
+			GetDimers(ProfB, PosB, DB);
+			SetFreqs2(ProfA.GetFreqs(PosA), wA, ProfB.GetFreqs(PosB), wB, FreqsAB);
 			switch (cPrevType)
 				{
-			case 'M': SetDimersMM(PPA, wA, PPB, wB, PPAB); break;
-			case 'D': SetDimersDM(PPA, wA, PPB, wB, PPAB); break;
-			case 'I': SetDimersIM(PPA, wA, PPB, wB, PPAB); break;
+			case 'M': SetDimersMM(DA, wA, DB, wB, DAB); break;
+			case 'D': SetDimersDM(DA, wA, DB, wB, DAB); break;
+			case 'I': SetDimersIM(DA, wA, DB, wB, DAB); break;
 			default: asserta(false);
 				}
 
@@ -259,13 +270,14 @@ void AlignTwoProfsGivenPath(const Profile3 &ProfA, float WeightA,
 
 		case 'D':
 			{
-			ProfPos3 *PPA = ProfA.m_PPs[PosA];
-			SetFreqs1(PPA, wA, PPAB);
+			Dimers3 DAD;
+			GetDimers(ProfA, PosA, DAD);
+			SetFreqs1(ProfA.GetFreqs(PosA), wA, FreqsAB);
 			switch (cPrevType)
 				{
-			case 'M': SetDimersMD(PPA, wA, PPB, wB, PPAB); break;
-			case 'D': SetDimersDD(PPA, wA, PPB, wB, PPAB); break;
-			case 'I': SetDimersID(PPA, wA, PPB, wB, PPAB); break;
+			case 'M': SetDimersMD(DAD, wA, DB, wB, DAB); break;
+			case 'D': SetDimersDD(DAD, wA, DB, wB, DAB); break;
+			case 'I': SetDimersID(DAD, wA, DB, wB, DAB); break;
 			default: asserta(false);
 				}
 
@@ -275,13 +287,14 @@ void AlignTwoProfsGivenPath(const Profile3 &ProfA, float WeightA,
 
 		case 'I':
 			{
-			ProfPos3 *PPB = ProfB.m_PPs[PosB];
-			SetFreqs1(PPB, wB, PPAB);
+			Dimers3 DBI;
+			GetDimers(ProfB, PosB, DBI);
+			SetFreqs1(ProfB.GetFreqs(PosB), wB, FreqsAB);
 			switch (cPrevType)
 				{
-			case 'M': SetDimersMI(PPA, wA, PPB, wB, PPAB); break;
-			case 'D': SetDimersDI(PPA, wA, PPB, wB, PPAB); break;
-			case 'I': SetDimersII(PPA, wA, PPB, wB, PPAB); break;
+			case 'M': SetDimersMI(DA, wA, DBI, wB, DAB); break;
+			case 'D': SetDimersDI(DA, wA, DBI, wB, DAB); break;
+			case 'I': SetDimersII(DA, wA, DBI, wB, DAB); break;
 			default: asserta(false);
 				}
 			++PosB;
@@ -291,11 +304,13 @@ void AlignTwoProfsGivenPath(const Profile3 &ProfA, float WeightA,
 		default:
 			assert(false);
 			}
-		PPAB.SetOcc();
-		ProfAB.m_PPs.push_back(&PPAB);
+		ProfAB.m_LL[EdgeIndex] = DAB.m_LL;
+		ProfAB.m_LG[EdgeIndex] = DAB.m_LG;
+		ProfAB.m_GL[EdgeIndex] = DAB.m_GL;
+		ProfAB.m_GG[EdgeIndex] = DAB.m_GG;
+		ProfAB.m_fOcc[EdgeIndex] = DAB.m_LL + DAB.m_GL;
 		cPrevType = cType;
 		}
-	assert(SIZE(ProfAB.m_PPs)== EdgeCount);
 
 	ProfAB.SetScores(SubstMx_Letter, GapOpen);
 	ProfAB.Validate();
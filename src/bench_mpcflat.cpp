@@ -0,0 +1,63 @@
+#include "muscle.h"
+#include "mpcflat.h"
+#include "hmmparams.h"
+
+// Wall-clock time of MPCFlat stages, for comparing implementations.
+// Same steps as MPCFlat::Run without derep and refinement, all
+// sequence weights 1.
+void cmd_bench_mpcflat()
+	{
+	MultiSequence InputSeqs;
+	LoadInput(InputSeqs);
+	const uint SeqCount = InputSeqs.GetSeqCount();
+	if (SeqCount < 3)
+		Die("Need at least three sequences");
+
+	bool Nucleo = InputSeqs.GuessIsNucleo();
+	SetAlpha(Nucleo ? ALPHA_Nucleo : ALPHA_Amino);
+	HMMParams HP;
+	HP.FromDefaults(Nucleo);
+	HP.ToPairHMM();
+
+	MPCFlat M;
+	if (optset_consiters)
+		M.m_ConsistencyIterCount = opt(consiters);
+	if (optset_consz)
+		M.m_ConsSampleSize = opt(consz);
+	const uint PairCount = (SeqCount*(SeqCount - 1))/2;
+	M.AllocPairCount(PairCount);
+	M.InitSeqs(&InputSeqs);
+	M.InitPairs();
+	M.InitDistMx();
+
+	double t0 = omp_get_wtime();
+	M.CalcPosteriors();
+	double t1 = omp_get_wtime();
+	M.CalcGuideTree();
+	M.m_Weights.clear();
+	M.m_Weights.resize(SeqCount, 1.0f);
+	double t2 = omp_get_wtime();
+	M.Consistency();
+	double t3 = omp_get_wtime();
+	M.CalcJoinOrder();
+	M.ProgressiveAlign();
+	double t4 = omp_get_wtime();
+
+// Pair index lookups alone, as done by ConsPair
+	uint64 Sum = 0;
+	for (uint i = 0; i < SeqCount; ++i)
+		for (uint j = i + 1; j < SeqCount; ++j)
+			Sum += M.GetPairIndex(i, j);
+	double t5 = omp_get_wtime();
+	asserta(Sum == uint64(PairCount)*(PairCount - 1)/2);
+
+	ProgressLog("%u seqs, %u pairs, %u threads\n",
+	  SeqCount, PairCount, GetRequestedThreadCount());
+	ProgressLog("Posteriors        %8.3f secs\n", t1 - t0);
+	ProgressLog("Consistency       %8.3f secs\n", t3 - t2);
+	ProgressLog("ProgressiveAlign  %8.3f secs\n", t4 - t3);
+	ProgressLog("GetPairIndex x%u %8.3f secs\n", PairCount, t5 - t4);
+
+	if (optset_output)
+		M.m_MSA->WriteMFA(opt(output));
+	}
@@ -47,20 +47,21 @@ static inline char XChar(char Bits, char cType)
 	return '?';
 	}
 
-void BitTraceBack(char **TraceBack, uint uLengthA, uint uLengthB,
+// TraceBack is (uLengthA+1) x (uLengthB+1), row-major
+void BitTraceBack(const char *TraceBack, uint uLengthA, uint uLengthB,
   char LastEdge, string &Path)
 	{
 	Path.resize(0);
 
 	uint PLA = uLengthA;
 	uint PLB = uLengthB;
-	char Bits = TraceBack[uLengthA][uLengthB];
+	const size_t Stride = size_t(uLengthB) + 1;
 	char cType = LastEdge;
 	for (;;)
 		{
 		Path.push_back(cType);
 
-		char Bits = TraceBack[PLA][PLB];
+		char Bits = TraceBack[PLA*Stride + PLB];
 		char NextEdgeType = XChar(Bits, cType);
 		switch (cType)
 			{
@@ -20,47 +20,106 @@ void MPCFlat::BuildPost(const MultiSequence &MSA1, const MultiSequence &MSA2,
 	{
 	const uint SeqCount1 = MSA1.GetSeqCount();
 	const uint SeqCount2 = MSA2.GetSeqCount();
-
 	const uint ColCount1 = MSA1.GetColCount();
-	const uint ColCount2 = MSA2.GetColCount();
 
-	uint Ix = 0;
-	for (uint i = 0; i < ColCount1; ++i)
-		for (uint j = 0; j < ColCount2; ++j)
-			Post[Ix++] = 0;
+// Input seq indexes and PosToCol are needed for every pair,
+// compute once per MSA rather than once per pair.
+	vector<uint> SMIs1(SeqCount1);
+	vector<uint> SMIs2(SeqCount2);
+	vector<vector<uint> > PosToCols1(SeqCount1);
+	vector<vector<uint> > PosToCols2(SeqCount2);
+	for (uint SeqIndex1 = 0; SeqIndex1 < SeqCount1; ++SeqIndex1)
+		{
+		const Sequence *Seq1 = MSA1.GetSequence(SeqIndex1);
+		SMIs1[SeqIndex1] = GetMyInputSeqIndex(Seq1->m_Label);
+		Seq1->GetPosToCol(PosToCols1[SeqIndex1]);
+		}
+	for (uint SeqIndex2 = 0; SeqIndex2 < SeqCount2; ++SeqIndex2)
+		{
+		const Sequence *Seq2 = MSA2.GetSequence(SeqIndex2);
+		SMIs2[SeqIndex2] = GetMyInputSeqIndex(Seq2->m_Label);
+		Seq2->GetPosToCol(PosToCols2[SeqIndex2]);
+		}
+
+	BuildPost(SMIs1, SMIs2, PosToCols1, PosToCols2, ColCount1,
+	  MSA2.GetColCount(), Post);
+	}
+
+// Large joins near the root of the guide tree run one at a time
+// (see ProgressiveAlign), so split Post into row blocks. Each
+// cell is summed in the same order as the serial loop.
+void MPCFlat::BuildPost(const vector<uint> &SMIs1, const vector<uint> &SMIs2,
+  const vector<vector<uint> > &PosToCols1,
+  const vector<vector<uint> > &PosToCols2, uint ColCount1,
+  uint ColCount2, float *Post)
+	{
+	const uint SeqCount1 = SIZE(SMIs1);
+	const uint SeqCount2 = SIZE(SMIs2);
+	const uint ThreadCount = GetThreadCount();
+	const uint64 PairCount = uint64(SeqCount1)*SeqCount2;
+	if (ThreadCount == 1 || omp_get_level() > m_OmpLevel ||
+	  PairCount < BUILDPOST_PARALLEL_PAIRS)
+		{
+		BuildPostRows(SMIs1, SMIs2, PosToCols1, PosToCols2,
+		  0, ColCount1, ColCount2, Post);
+		return;
+		}
+
+	const uint BlockCount = min(ColCount1, 4*ThreadCount);
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1)
+	for (int Block = 0; Block < (int) BlockCount; ++Block)
+		{
+		uint ColLo = uint((uint64(Block)*ColCount1)/BlockCount);
+		uint ColHi = uint((uint64(Block + 1)*ColCount1)/BlockCount);
+		BuildPostRows(SMIs1, SMIs2, PosToCols1, PosToCols2,
+		  ColLo, ColHi, ColCount2, Post);
+		}
+	}
+
+// Rows ColLo..ColHi-1 of Post. PosToCol is increasing so the
+// positions of each sequence in MSA1 landing in these rows are
+// a contiguous range.
+void MPCFlat::BuildPostRows(const vector<uint> &SMIs1,
+  const vector<uint> &SMIs2, const vector<vector<uint> > &PosToCols1,
+  const vector<vector<uint> > &PosToCols2, uint ColLo, uint ColHi,
+  uint ColCount2, float *Post)
+	{
+	const uint SeqCount1 = SIZE(SMIs1);
+	const uint SeqCount2 = SIZE(SMIs2);
+
+	for (uint64 Ix = uint64(ColLo)*ColCount2; Ix < uint64(ColHi)*ColCount2; ++Ix)
+		Post[Ix] = 0;
 
 // for each s in MSA1
-	vector<uint> PosToCol1;
-	vector<uint> PosToCol2;
 	for (uint SeqIndex1 = 0; SeqIndex1 < SeqCount1; ++SeqIndex1)
 		{
-		const Sequence *Seq1 = MSA1.GetSequence(SeqIndex1);
-		uint SMI_1 = GetMyInputSeqIndex(Seq1->m_Label);
+		uint SMI_1 = SMIs1[SeqIndex1];
 		asserta(SMI_1 != UINT_MAX);
 		const float w1 = m_Weights[SeqIndex1];
-
-		Seq1->GetPosToCol(PosToCol1);
+		const vector<uint> &PosToCol1 = PosToCols1[SeqIndex1];
+		const uint PosLo = uint(lower_bound(PosToCol1.begin(), PosToCol1.end(), ColLo) -
+		  PosToCol1.begin());
+		const uint PosHi = uint(lower_bound(PosToCol1.begin(), PosToCol1.end(), ColHi) -
+		  PosToCol1.begin());
+		if (PosLo == PosHi)
+			continue;
 
 	// for each t in MSA2
 		for (uint SeqIndex2 = 0; SeqIndex2 < SeqCount2; SeqIndex2++)
 			{
-			const Sequence *Seq2 = MSA2.GetSequence(SeqIndex2);
-			uint SMI_2 = GetMyInputSeqIndex(Seq2->m_Label);
+			uint SMI_2 = SMIs2[SeqIndex2];
 			asserta(SMI_2 != UINT_MAX);
 			asserta(SMI_1 != SMI_2);
 			const float w2 = m_Weights[SeqIndex2];
-
-			Seq2->GetPosToCol(PosToCol2);
+			const vector<uint> &PosToCol2 = PosToCols2[SeqIndex2];
 
 			if (SMI_1 < SMI_2)
 				{
 				uint PairIndex = GetPairIndex(SMI_1, SMI_2);
 				const MySparseMx &Mx = GetSparsePost(PairIndex);
-				const uint LX = Mx.GetLX();
-				const uint LY = Mx.GetLY();
-				assert(SIZE(PosToCol1) == LX);
-				assert(SIZE(PosToCol2) == LY);
-				for (uint i = 0; i < LX; ++i)
+				assert(SIZE(PosToCol1) == Mx.GetLX());
+				assert(SIZE(PosToCol2) == Mx.GetLY());
+				for (uint i = PosLo; i < PosHi; ++i)
 					{
 					uint Col1 = PosToCol1[i];
 					uint Offset = Mx.GetOffset(i);
@@ -71,7 +130,7 @@ void MPCFlat::BuildPost(const MultiSequence &MSA1, const MultiSequence &MSA2,
 						uint j = Mx.GetCol_Offset(Offset);
 						++Offset;
 						uint Col2 = PosToCol2[j];
-						Post[Col1*ColCount2 + Col2] += w1*w2*P;
+						Post[uint64(Col1)*ColCount2 + Col2] += w1*w2*P;
 						}
 					}
 				}
@@ -80,27 +139,29 @@ void MPCFlat::BuildPost(const MultiSequence &MSA1, const MultiSequence &MSA2,
 				uint PairIndex = GetPairIndex(SMI_2, SMI_1);
 				const MySparseMx &Mx = GetSparsePost(PairIndex);
 				const uint LX = Mx.GetLX();
-				const uint LY = Mx.GetLY();
 				assert(SIZE(PosToCol2) == LX);
-				assert(SIZE(PosToCol1) == LY);
+				assert(SIZE(PosToCol1) == Mx.GetLY());
 				for (uint i = 0; i < LX; ++i)
 					{
+				// Columns in a row are increasing
 					uint Col2 = PosToCol2[i];
 					uint Offset = Mx.GetOffset(i);
-					uint Size = Mx.GetSize(i);
-					for (uint k = 0; k < Size; ++k)
+					const uint *Cols = Mx.m_Cols + Offset;
+					const uint *EndCols = Cols + Mx.GetSize(i);
+					const uint *Lo = (PosLo == 0 ? Cols : lower_bound(Cols, EndCols, PosLo));
+					Offset += uint(Lo - Cols);
+					for (const uint *p = Lo; p != EndCols; ++p)
 						{
+						uint j = *p;
+						if (j >= PosHi)
+							break;
 						float P = Mx.GetProb_Offset(Offset);
-						uint j = Mx.GetCol_Offset(Offset);
 						++Offset;
 						uint Col1 = PosToCol1[j];
-						Post[Col1*ColCount2 + Col2] += w1*w2*P;
+						Post[uint64(Col1)*ColCount2 + Col2] += w1*w2*P;
 						}
 					}
 				}
 			}
 		}
-#if 0//TRACE
-	LogFlatMx("MSAPost", Post, ColCount1, ColCount2);
-#endif
 	}
@@ -1,4 +1,5 @@
 #include "muscle.h"
+#include "queryprof.h"
 
 /***
 Bwd[s][i][j] = 
@@ -7,7 +8,8 @@ Bwd[s][i][j] =
 	last (LY-j) letters of Y.
 ***/
 
-void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
+void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX, const QueryProf *PY)
 	{
 	asserta(!Mega::m_Loaded);
 
@@ -15,6 +17,10 @@ void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
 	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
 		Die("HMM overflow, sequence lengths %u, %u (max ~21k)", LX, LY);
 
+	QueryPair QP;
+	QP.Init(X, LX, Y, LY, PX, PY);
+	const float *InsY = QP.m_InsY;
+
 	const int iLX = int(LX);
 	const int iLY = int(LY);
 
@@ -47,6 +53,7 @@ void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
 		{
 		char x = (i == iLX ? 0 : X[i]);
 		float Emit_x = InsScore[x];
+		const float *MatchRow = (i == iLX ? 0 : QP.GetMatchRow(i));
 
 		for (int j = iLY; j >= 0; --j)
 			{
@@ -66,12 +73,11 @@ void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
 				continue;
 				}
 
-			char y = (j == iLY ? 0 : Y[j]);
-			float Emit_y = InsScore[y];
-			float Emit_xy = MatchScore[x][y];
+			float Emit_y = InsY[j];
 
 			if (i < iLX && j < iLY)
 				{
+				float Emit_xy = MatchRow[j];
 				float NextM  = Flat[Base_i1_j1 + HMMSTATE_M] + Emit_xy;
 				float NextIX = Flat[Base_i1_j + HMMSTATE_IX] + Emit_x;
 				float NextJX = Flat[Base_i1_j + HMMSTATE_JX] + Emit_x;
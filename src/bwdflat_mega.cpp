@@ -11,8 +11,8 @@ Bwd[s][i][j] =
 ***/
 
 void Mega::CalcBwdFlat_mega(
-  const vector<vector<byte> > &ProfileX,
-  const vector<vector<byte> > &ProfileY, float *Flat)
+  const MegaProfile &ProfileX,
+  const MegaProfile &ProfileY, float *Flat)
 	{
 #include "hmmscores.h"
 	const uint LX = SIZE(ProfileX);
@@ -23,6 +23,12 @@ void Mega::CalcBwdFlat_mega(
 	const int iLX = int(LX);
 	const int iLY = int(LY);
 
+	const uint IdxX = Mega::GetProfileIdx(ProfileX);
+	const uint IdxY = Mega::GetProfileIdx(ProfileY);
+	const float *InsX = Mega::GetInsScores(IdxX);
+	const float *InsY = Mega::GetInsScores(IdxY);
+	vector<float> MatchRow(LY);
+
 	const int LY1 = LY+1;
 	const int BaseInc_i = HMMSTATE_COUNT*LY1;
 	const int BaseInc_j = HMMSTATE_COUNT;
@@ -52,7 +58,9 @@ void Mega::CalcBwdFlat_mega(
 		{
 		//char x = (i == iLX ? 0 : X[i]);
 		//float Emit_x = InsScore[x];
-		float Emit_x = (i == iLX ? 0 : Mega::GetInsScore(ProfileX, i));
+		float Emit_x = (i == iLX ? 0 : InsX[i]);
+		if (i < iLX)
+			Mega::GetMatchScoreRow(false, IdxX, i, IdxY, MatchRow.data());
 
 		for (int j = iLY; j >= 0; --j)
 			{
@@ -75,9 +83,8 @@ void Mega::CalcBwdFlat_mega(
 			//char y = (j == iLY ? 0 : Y[j]);
 			//float Emit_y = InsScore[y];
 			//float Emit_xy = MatchScore[x][y];
-			float Emit_y = (j == iLY ? 0 : Mega::GetInsScore(ProfileY, j));
-			float Emit_xy = (i == iLX || j == iLY ? 0 : 
-			  Mega::GetMatchScore(ProfileX, i, ProfileY, j));
+			float Emit_y = (j == iLY ? 0 : InsY[j]);
+			float Emit_xy = (i == iLX || j == iLY ? 0 : MatchRow[j]);
 
 			if (i < iLX && j < iLY)
 				{
@@ -0,0 +1,208 @@
+#include "muscle.h"
+#include "logaddvec.h"
+#include "fbrows.h"
+
+/***
+Vectorized CalcBwdFlat, enabled by -vecfb.
+
+Same recursion and Flat layout as CalcBwdFlat (bwdflat3.cpp).
+In row i, IX and JX depend only on row i+1 and are computed for
+the whole row at once (SIMD over j). IY and JY chain along the
+row and are filled in by a scalar scan, then M is computed for
+the whole row from both.
+***/
+
+VEC_DISPATCH
+static void BwdRow_X(uint LY, const float *VEC_RESTRICT NxtM,
+  const float *VEC_RESTRICT NxtIX, const float *VEC_RESTRICT NxtJX,
+  const float *VEC_RESTRICT MatchRow, float Emit_x,
+  float *VEC_RESTRICT NextM, float *VEC_RESTRICT NextIX, float *VEC_RESTRICT NextJX,
+  float *VEC_RESTRICT IX, float *VEC_RESTRICT JX)
+	{
+#include "hmmscores.h"
+	for (uint j = 0; j < LY; ++j)
+		{
+		float NM = NxtM[j+1] + MatchRow[j];
+		float NIX = NxtIX[j] + Emit_x;
+		float NJX = NxtJX[j] + Emit_x;
+		NextM[j] = NM;
+		NextIX[j] = NIX;
+		NextJX[j] = NJX;
+
+		float IX_IX = tII + NIX;
+		float IX_M = tIM + NM;
+		IX[j] = LOG_ADD_VEC(IX_IX, IX_M);
+
+		float JX_JX = tJJ + NJX;
+		float JX_M = tJM + NM;
+		JX[j] = LOG_ADD_VEC(JX_JX, JX_M);
+		}
+	}
+
+VEC_DISPATCH
+static void BwdRow_M(uint LY, const float *VEC_RESTRICT NextM,
+  const float *VEC_RESTRICT NextIX, const float *VEC_RESTRICT NextJX,
+  const float *VEC_RESTRICT NextIY, const float *VEC_RESTRICT NextJY,
+  float *VEC_RESTRICT M)
+	{
+#include "hmmscores.h"
+	for (uint j = 0; j < LY; ++j)
+		{
+		float M_M  = tMM + NextM[j];
+		float M_IX = tMI + NextIX[j];
+		float M_JX = tMJ + NextJX[j];
+		float M_IY = tMI + NextIY[j];
+		float M_JY = tMJ + NextJY[j];
+		M[j] = LOG_ADD_VEC(M_M, M_IX, M_JX, M_IY, M_JY);
+		}
+	}
+
+void FBRows::BwdRowLX(float *Row)
+	{
+#include "hmmscores.h"
+	const uint LY = m_LY;
+	const uint LY1 = LY + 1;
+	float *M = Row + HMMSTATE_M*LY1;
+	float *IX = Row + HMMSTATE_IX*LY1;
+	float *JX = Row + HMMSTATE_JX*LY1;
+	float *IY = Row + HMMSTATE_IY*LY1;
+	float *JY = Row + HMMSTATE_JY*LY1;
+
+	M[LY] = tSM;
+	IX[LY] = tSI;
+	IY[LY] = tSI;
+	JX[LY] = tSJ;
+	JY[LY] = tSJ;
+	for (int j = int(LY) - 1; j >= 0; --j)
+		{
+		IX[j] = LOG_ZERO;
+		JX[j] = LOG_ZERO;
+
+		float Emit_y = m_InsY[j];
+		float NIY = IY[j+1] + Emit_y;
+		float NJY = JY[j+1] + Emit_y;
+		if (j > 0)
+			{
+			float M_IY = tMI + NIY;
+			float M_JY = tMJ + NJY;
+			M[j] = LOG_ADD(M_IY, M_JY);
+			IY[j] = tII + NIY;
+			JY[j] = tJJ + NJY;
+			}
+		else
+			{
+			M[j] = LOG_ZERO;
+			IY[j] = LOG_ZERO;
+			JY[j] = LOG_ZERO;
+			}
+		}
+	}
+
+void FBRows::BwdRow(uint i, const float *NextRow, float *Row)
+	{
+#include "hmmscores.h"
+	assert(i < m_LX);
+	const uint LY = m_LY;
+	const uint LY1 = LY + 1;
+
+	byte x = m_X[i];
+	float Emit_x = InsScore[x];
+	m_MatchRow = m_Prof.GetMatchRow(i);
+
+	const float *NxtM = NextRow + HMMSTATE_M*LY1;
+	const float *NxtIX = NextRow + HMMSTATE_IX*LY1;
+	const float *NxtJX = NextRow + HMMSTATE_JX*LY1;
+
+	float *M = Row + HMMSTATE_M*LY1;
+	float *IX = Row + HMMSTATE_IX*LY1;
+	float *JX = Row + HMMSTATE_JX*LY1;
+	float *IY = Row + HMMSTATE_IY*LY1;
+	float *JY = Row + HMMSTATE_JY*LY1;
+
+// Column LY
+	IY[LY] = LOG_ZERO;
+	JY[LY] = LOG_ZERO;
+	if (i > 0)
+		{
+		float NIX = NxtIX[LY] + Emit_x;
+		float NJX = NxtJX[LY] + Emit_x;
+
+		float M_IX = tMI + NIX;
+		float M_JX = tMJ + NJX;
+
+		M[LY] = LOG_ADD(M_IX, M_JX);
+		IX[LY] = tII + NIX;
+		JX[LY] = tJJ + NJX;
+		}
+	else
+		{
+		M[LY] = LOG_ZERO;
+		IX[LY] = LOG_ZERO;
+		JX[LY] = LOG_ZERO;
+		}
+
+	BwdRow_X(LY, NxtM, NxtIX, NxtJX, m_MatchRow, Emit_x,
+	  m_NextM, m_NextIX, m_NextJX, IX, JX);
+
+	for (int j = int(LY) - 1; j >= 0; --j)
+		{
+		float Emit_y = m_InsY[j];
+		float NIY = IY[j+1] + Emit_y;
+		float NJY = JY[j+1] + Emit_y;
+		m_NextIY[j] = NIY;
+		m_NextJY[j] = NJY;
+		if (j > 0)
+			{
+			float IY_IY = tII + NIY;
+			float IY_M = tIM + m_NextM[j];
+			IY[j] = LOG_ADD(IY_IY, IY_M);
+
+			float JY_JY = tJJ + NJY;
+			float JY_M = tJM + m_NextM[j];
+			JY[j] = LOG_ADD(JY_JY, JY_M);
+			}
+		else
+			{
+			IY[j] = LOG_ZERO;
+			JY[j] = LOG_ZERO;
+			}
+		}
+
+	BwdRow_M(LY, m_NextM, m_NextIX, m_NextJX, m_NextIY, m_NextJY, M);
+	M[0] = LOG_ZERO;
+	if (i == 0)
+		{
+		for (uint j = 0; j < LY; ++j)
+			{
+			M[j] = LOG_ZERO;
+			IX[j] = LOG_ZERO;
+			JX[j] = LOG_ZERO;
+			}
+		}
+	}
+
+void CalcBwdFlat_Vec(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX, const QueryProf *PY)
+	{
+	asserta(!Mega::m_Loaded);
+	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
+		Die("HMM overflow, sequence lengths %u, %u (max ~21k)", LX, LY);
+
+	FBRows FB;
+	FB.Init(X, LX, Y, LY, PX, PY);
+	const uint RowSize = FB.GetRowSize();
+	float *Next = myalloc(float, RowSize);
+	float *Cur = myalloc(float, RowSize);
+
+	FB.BwdRowLX(Next);
+	FB.RowToFlat(Next, LX, Flat);
+	for (int i = int(LX) - 1; i >= 0; --i)
+		{
+		FB.BwdRow(uint(i), Next, Cur);
+		FB.RowToFlat(Cur, uint(i), Flat);
+		swap(Next, Cur);
+		}
+
+	myfree(Next);
+	myfree(Cur);
+	}
@@ -11,7 +11,7 @@ public:
 	float *CacheMNext = 0;
 	float *CacheMPrev = 0;
 	float *CacheDRow = 0;
-	char **CacheTB = 0;
+	char *CacheTB = 0;		// uPrefixCountA x uPrefixCountB, contiguous
 
 	CacheMem3()
 		{
@@ -35,8 +35,6 @@ public:
 		myfree(CacheMNext);
 		myfree(CacheMPrev);
 		myfree(CacheDRow);
-		for (unsigned i = 0; i < uCachePrefixCountA; ++i)
-			myfree(CacheTB[i]);
 		myfree(CacheTB);
 
 		uCachePrefixCountB = 0;
@@ -64,8 +62,6 @@ public:
 		CacheMPrev = myalloc(float, uCachePrefixCountB);
 		CacheDRow = myalloc(float, uCachePrefixCountB);
 
-		CacheTB = myalloc(char *, uCachePrefixCountA);
-		for (unsigned i = 0; i < uCachePrefixCountA; ++i)
-			CacheTB[i] = myalloc(char, uCachePrefixCountB);
+		CacheTB = myalloc(char, size_t(uCachePrefixCountA)*uCachePrefixCountB);
 		}
 	};
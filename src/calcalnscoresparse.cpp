@@ -13,11 +13,45 @@ float CalcAlnScoreSparse(const MySparseMx &Mx)
 	return Sum;
 #endif
 
-	float *Post = AllocPost(LX, LY);
-	Mx.ToPost(Post);
+// Same DP as CalcAlnScoreFlat, but Post is expanded from the
+// sparse matrix one row at a time so memory is O(LY).
 	float *DPRows = AllocDPRows(LX, LY);
-	float Score = CalcAlnScoreFlat(Post, LX, LY, DPRows);
-	myfree(Post);
+	float *Row = DPRows;
+	float *PostRow = DPRows + (LY + 1);
+	for (uint j = 0; j <= LY; ++j)
+		{
+		Row[j] = 0;
+		PostRow[j] = 0;
+		}
+
+	for (uint i = 1; i <= LX; ++i)
+		{
+		const uint Offset = Mx.GetOffset(i-1);
+		const uint Size = Mx.GetSize(i-1);
+		for (uint k = 0; k < Size; ++k)
+			PostRow[Mx.GetCol_Offset(Offset + k)] = Mx.GetProb_Offset(Offset + k);
+
+		float Currj1 = 0;
+		float Prevj1 = Row[0];
+		Row[0] = 0;
+		for (uint j = 1; j <= LY; ++j)
+			{
+			float Prevj = Row[j];
+
+			float P = PostRow[j-1];
+			float B = Prevj1 + P;
+			float X = Prevj;
+			float Y = Currj1;
+
+			Prevj1 = Row[j];
+			Best3(B, X, Y, &Currj1);
+			Row[j] = Currj1;
+			}
+
+		for (uint k = 0; k < Size; ++k)
+			PostRow[Mx.GetCol_Offset(Offset + k)] = 0;
+		}
+	float Score = Row[LY];
 	myfree(DPRows);
 	return Score;
 	}
@@ -1,33 +1,56 @@
 #include "muscle.h"
 #include "mega.h"
 
-float *CalcPost(const string &LabelX, const string &LabelY)
+float *CalcPost(const byte *X, uint LX, const byte *Y, uint LY,
+  const QueryProf *PX, const QueryProf *PY)
 	{
-	uint LX = GetSeqLengthByGlobalLabel(LabelX);
-	uint LY = GetSeqLengthByGlobalLabel(LabelY);
+	asserta(!Mega::m_Loaded);
 	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
 		Die("HMM overflow, sequence lengths %u, %u (max ~21k)", LX, LY);
 
 	float *Fwd = AllocFB(LX, LY);
 	float *Bwd = AllocFB(LX, LY);
-
-	if (Mega::m_Loaded)
+	if (opt(vecfb))
 		{
-		const vector<vector<byte> > &ProfileX = *Mega::GetProfileByLabel(LabelX);
-		const vector<vector<byte> > &ProfileY = *Mega::GetProfileByLabel(LabelY);
-		asserta(SIZE(ProfileX) == LX);
-		asserta(SIZE(ProfileY) == LY);
-		Mega::CalcFwdFlat_mega(ProfileX, ProfileY, Fwd);
-		Mega::CalcBwdFlat_mega(ProfileX, ProfileY, Bwd);
+		CalcFwdFlat_Vec(X, LX, Y, LY, Fwd, PX, PY);
+		CalcBwdFlat_Vec(X, LX, Y, LY, Bwd, PX, PY);
 		}
 	else
+		{
+		CalcFwdFlat(X, LX, Y, LY, Fwd, PX, PY);
+		CalcBwdFlat(X, LX, Y, LY, Bwd, PX, PY);
+		}
+
+	float *Post = AllocPost(LX, LY);
+	CalcPostFlat(Fwd, Bwd, LX, LY, Post);
+	myfree(Fwd);
+	myfree(Bwd);
+	return Post;
+	}
+
+float *CalcPost(const string &LabelX, const string &LabelY)
+	{
+	uint LX = GetSeqLengthByGlobalLabel(LabelX);
+	uint LY = GetSeqLengthByGlobalLabel(LabelY);
+	if (!Mega::m_Loaded)
 		{
 		const byte *X = GetGlobalByteSeqByLabel(LabelX);
 		const byte *Y = GetGlobalByteSeqByLabel(LabelY);
-		CalcFwdFlat(X, LX, Y, LY, Fwd);
-		CalcBwdFlat(X, LX, Y, LY, Bwd);
+		return CalcPost(X, LX, Y, LY);
 		}
 
+	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
+		Die("HMM overflow, sequence lengths %u, %u (max ~21k)", LX, LY);
+
+	float *Fwd = AllocFB(LX, LY);
+	float *Bwd = AllocFB(LX, LY);
+	const MegaProfile &ProfileX = *Mega::GetProfileByLabel(LabelX);
+	const MegaProfile &ProfileY = *Mega::GetProfileByLabel(LabelY);
+	asserta(SIZE(ProfileX) == LX);
+	asserta(SIZE(ProfileY) == LY);
+	Mega::CalcFwdFlat_mega(ProfileX, ProfileY, Fwd);
+	Mega::CalcBwdFlat_mega(ProfileX, ProfileY, Bwd);
+
 	float *Post = AllocPost(LX, LY);
 	CalcPostFlat(Fwd, Bwd, LX, LY, Post);
 	myfree(Fwd);
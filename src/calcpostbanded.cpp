@@ -0,0 +1,384 @@
+#include "muscle.h"
+#include "mpcflat.h"
+#include "diagbox.h"
+#include "kmerscan.h"
+
+/***
+Banded posterior, enabled by -band.
+
+Diagonals are taken from k-mer seeds shared by X and Y. The band
+covers the seed diagonals (1% outliers trimmed on each side), the
+start and end corners and -bandpad extra diagonals on each side.
+Forward and backward are the same recursions as CalcFwdFlat and
+CalcBwdFlat, cells outside the band are LOG_ZERO and are not
+stored. Memory and time are O(LX*BandWidth).
+
+Returns false, leaving SparsePost unchanged, if there are too few
+seeds, if the band would not be much narrower than the full matrix,
+or if posterior mass >= MIN_SPARSE_PROB reaches the band edge. The
+caller then falls back to the full D.P.
+
+Band offsets o = j - i refer to D.P. cells (i,j), i=0..LX, j=0..LY.
+M(i,j) aligns letters X[i-1] and Y[j-1] which is DiagBox diagonal
+d = LX + o.
+***/
+
+static const uint BAND_MAX_HITS_PER_KMER = 4;
+static const uint BAND_DEFAULT_PAD = 32;
+
+static const float g_ZeroCell[HMMSTATE_COUNT] =
+	{ LOG_ZERO, LOG_ZERO, LOG_ZERO, LOG_ZERO, LOG_ZERO };
+
+struct BandMx
+	{
+	uint m_LX = 0;
+	uint m_LY = 0;
+	int m_OLo = 0;
+	int m_OHi = 0;
+	uint m_W = 0;
+	float *m_Data = 0;
+
+	~BandMx()
+		{
+		myfree(m_Data);
+		}
+
+	void Init(uint LX, uint LY, int OLo, int OHi)
+		{
+		m_LX = LX;
+		m_LY = LY;
+		m_OLo = OLo;
+		m_OHi = OHi;
+		m_W = uint(OHi - OLo + 1);
+		m_Data = myalloc(float, uint64(LX + 1)*m_W*HMMSTATE_COUNT);
+		}
+
+	uint GetLoj(uint i) const
+		{
+		int j = int(i) + m_OLo;
+		return j < 0 ? 0 : uint(j);
+		}
+
+	uint GetHij(uint i) const
+		{
+		int j = int(i) + m_OHi;
+		return j > int(m_LY) ? m_LY : uint(j);
+		}
+
+	float *GetCell(uint i, uint j)
+		{
+		int o = int(j) - int(i);
+		assert(o >= m_OLo && o <= m_OHi);
+		return m_Data + (uint64(i)*m_W + uint(o - m_OLo))*HMMSTATE_COUNT;
+		}
+
+	const float *GetCellOrZero(uint i, uint j) const
+		{
+		int o = int(j) - int(i);
+		if (o < m_OLo || o > m_OHi)
+			return g_ZeroCell;
+		return m_Data + (uint64(i)*m_W + uint(o - m_OLo))*HMMSTATE_COUNT;
+		}
+	};
+
+static bool GetSeedBox(const byte *X, uint LX, const byte *Y, uint LY,
+  uint Pad, DiagBox &Box)
+	{
+	const bool Nucleo = (g_Alpha == ALPHA_Nucleo);
+	const uint k = (Nucleo ? 12 : 4);
+	if (LX < 2*k || LY < 2*k)
+		return false;
+
+	vector<pair<uint32, uint> > YKmers;
+	YKmers.reserve(LY - k + 1);
+	for (uint j = 0; j + k <= LY; ++j)
+		{
+		uint32 Code = SeqToCode(Nucleo, Y + j, k);
+		if (Code != UINT32_MAX)
+			YKmers.push_back(pair<uint32, uint>(Code, j));
+		}
+	sort(YKmers.begin(), YKmers.end());
+
+	vector<int> Offsets;
+	for (uint i = 0; i + k <= LX; ++i)
+		{
+		uint32 Code = SeqToCode(Nucleo, X + i, k);
+		if (Code == UINT32_MAX)
+			continue;
+		pair<uint32, uint> Lo(Code, 0);
+		pair<uint32, uint> Hi(Code, UINT_MAX);
+		vector<pair<uint32, uint> >::const_iterator p =
+		  lower_bound(YKmers.begin(), YKmers.end(), Lo);
+		vector<pair<uint32, uint> >::const_iterator q =
+		  upper_bound(p, YKmers.cend(), Hi);
+		if (uint(q - p) > BAND_MAX_HITS_PER_KMER)
+			continue;
+		for (; p != q; ++p)
+			Offsets.push_back(int(p->second) - int(i));
+		}
+
+	const uint SeedCount = SIZE(Offsets);
+	if (SeedCount < min(LX, LY)/16 || SeedCount < 3)
+		return false;
+
+	sort(Offsets.begin(), Offsets.end());
+	const uint Trim = SeedCount/100;
+	int OLo = Offsets[Trim];
+	int OHi = Offsets[SeedCount - 1 - Trim];
+
+// Band must reach both corners so that global paths exist
+	const int OEnd = int(LY) - int(LX);
+	OLo = min(OLo, min(0, OEnd)) - int(Pad);
+	OHi = max(OHi, max(0, OEnd)) + int(Pad);
+	OLo = max(OLo, 1 - int(LX));
+	OHi = min(OHi, int(LY) - 1);
+	if (2*uint(OHi - OLo + 1) > LY + 1)
+		return false;
+
+	Box.Init(LX, LY, uint(int(LX) + OLo), uint(int(LX) + OHi));
+	return true;
+	}
+
+static void CalcFwdBand(const byte *X, const byte *Y, BandMx &Fwd)
+	{
+#include "hmmscores.h"
+	const uint LX = Fwd.m_LX;
+	for (uint i = 0; i <= LX; ++i)
+		{
+		const uint Loj = Fwd.GetLoj(i);
+		const uint Hij = Fwd.GetHij(i);
+		const float Emit_x = (i == 0 ? 0 : InsScore[X[i-1]]);
+		for (uint j = Loj; j <= Hij; ++j)
+			{
+			float *F = Fwd.GetCell(i, j);
+			if (i == 0 || j == 0)
+				{
+				F[HMMSTATE_M] = LOG_ZERO;
+				F[HMMSTATE_IX] = LOG_ZERO;
+				F[HMMSTATE_JX] = LOG_ZERO;
+				F[HMMSTATE_IY] = LOG_ZERO;
+				F[HMMSTATE_JY] = LOG_ZERO;
+				if (i == 1)
+					{
+					F[HMMSTATE_IX] = tSI + Emit_x;
+					F[HMMSTATE_JX] = tSJ + Emit_x;
+					}
+				else if (i > 1)
+					{
+					const float *F_i1 = Fwd.GetCellOrZero(i-1, 0);
+					F[HMMSTATE_IX] = F_i1[HMMSTATE_IX] + tII + Emit_x;
+					F[HMMSTATE_JX] = F_i1[HMMSTATE_JX] + tJJ + Emit_x;
+					}
+				else if (j == 1)
+					{
+					float Emit_y = InsScore[Y[0]];
+					F[HMMSTATE_IY] = tSI + Emit_y;
+					F[HMMSTATE_JY] = tSJ + Emit_y;
+					}
+				else if (j > 1)
+					{
+					float Emit_y = InsScore[Y[j-1]];
+					const float *F_j1 = Fwd.GetCellOrZero(0, j-1);
+					F[HMMSTATE_IY] = F_j1[HMMSTATE_IY] + tII + Emit_y;
+					F[HMMSTATE_JY] = F_j1[HMMSTATE_JY] + tJJ + Emit_y;
+					}
+				continue;
+				}
+
+			byte y = Y[j-1];
+			float Emit_y = InsScore[y];
+			float Emit_Pair = MatchScore[X[i-1]][y];
+			const float *F_i1_j1 = Fwd.GetCellOrZero(i-1, j-1);
+			const float *F_i1_j = Fwd.GetCellOrZero(i-1, j);
+			const float *F_i_j1 = Fwd.GetCellOrZero(i, j-1);
+
+			if (i == 1 && j == 1)
+				F[HMMSTATE_M] = tSM + Emit_Pair;
+			else
+				{
+				float M_M = F_i1_j1[HMMSTATE_M] + tMM;
+				float IX_M = F_i1_j1[HMMSTATE_IX] + tIM;
+				float JX_M = F_i1_j1[HMMSTATE_JX] + tJM;
+				float IY_M = F_i1_j1[HMMSTATE_IY] + tIM;
+				float JY_M = F_i1_j1[HMMSTATE_JY] + tJM;
+				F[HMMSTATE_M] = LOG_ADD(M_M, IX_M, JX_M, IY_M, JY_M) + Emit_Pair;
+				}
+
+			float M_IX = F_i1_j[HMMSTATE_M] + tMI;
+			float IX_IX = F_i1_j[HMMSTATE_IX] + tII;
+			F[HMMSTATE_IX] = LOG_ADD(IX_IX, M_IX) + Emit_x;
+
+			float M_JX = F_i1_j[HMMSTATE_M] + tMJ;
+			float JX_JX = F_i1_j[HMMSTATE_JX] + tJJ;
+			F[HMMSTATE_JX] = LOG_ADD(JX_JX, M_JX) + Emit_x;
+
+			float M_IY = F_i_j1[HMMSTATE_M] + tMI;
+			float IY_IY = F_i_j1[HMMSTATE_IY] + tII;
+			F[HMMSTATE_IY] = LOG_ADD(IY_IY, M_IY) + Emit_y;
+
+			float M_JY = F_i_j1[HMMSTATE_M] + tMJ;
+			float JY_JY = F_i_j1[HMMSTATE_JY] + tJJ;
+			F[HMMSTATE_JY] = LOG_ADD(JY_JY, M_JY) + Emit_y;
+			}
+		}
+	}
+
+static void CalcBwdBand(const byte *X, const byte *Y, BandMx &Bwd)
+	{
+#include "hmmscores.h"
+	const uint LX = Bwd.m_LX;
+	const uint LY = Bwd.m_LY;
+	for (int i = int(LX); i >= 0; --i)
+		{
+		const uint Loj = Bwd.GetLoj(uint(i));
+		const uint Hij = Bwd.GetHij(uint(i));
+		const float Emit_x = (uint(i) == LX ? 0 : InsScore[X[i]]);
+		for (int j = int(Hij); j >= int(Loj); --j)
+			{
+			float *B = Bwd.GetCell(uint(i), uint(j));
+			B[HMMSTATE_M] = LOG_ZERO;
+			B[HMMSTATE_IX] = LOG_ZERO;
+			B[HMMSTATE_JX] = LOG_ZERO;
+			B[HMMSTATE_IY] = LOG_ZERO;
+			B[HMMSTATE_JY] = LOG_ZERO;
+			if (uint(i) == LX && uint(j) == LY)
+				{
+			// Special case for end-of-alignment
+				B[HMMSTATE_M] = tSM;
+				B[HMMSTATE_IX] = tSI;
+				B[HMMSTATE_IY] = tSI;
+				B[HMMSTATE_JX] = tSJ;
+				B[HMMSTATE_JY] = tSJ;
+				continue;
+				}
+
+			float NextIX = LOG_ZERO;
+			float NextJX = LOG_ZERO;
+			if (uint(i) < LX)
+				{
+				const float *B_i1_j = Bwd.GetCellOrZero(i+1, j);
+				NextIX = B_i1_j[HMMSTATE_IX] + Emit_x;
+				NextJX = B_i1_j[HMMSTATE_JX] + Emit_x;
+				}
+
+			float NextIY = LOG_ZERO;
+			float NextJY = LOG_ZERO;
+			float Emit_y = 0;
+			if (uint(j) < LY)
+				{
+				Emit_y = InsScore[Y[j]];
+				const float *B_i_j1 = Bwd.GetCellOrZero(i, j+1);
+				NextIY = B_i_j1[HMMSTATE_IY] + Emit_y;
+				NextJY = B_i_j1[HMMSTATE_JY] + Emit_y;
+				}
+
+			if (uint(i) < LX && uint(j) < LY)
+				{
+				const float *B_i1_j1 = Bwd.GetCellOrZero(i+1, j+1);
+				float NextM = B_i1_j1[HMMSTATE_M] + MatchScore[X[i]][Y[j]];
+				if (i > 0 && j > 0)
+					{
+					float M_M  = tMM + NextM;
+					float M_IX = tMI + NextIX;
+					float M_JX = tMJ + NextJX;
+					float M_IY = tMI + NextIY;
+					float M_JY = tMJ + NextJY;
+					B[HMMSTATE_M] = LOG_ADD(M_M, M_IX, M_JX, M_IY, M_JY);
+					}
+				if (i > 0)
+					{
+					B[HMMSTATE_IX] = LOG_ADD(tII + NextIX, tIM + NextM);
+					B[HMMSTATE_JX] = LOG_ADD(tJJ + NextJX, tJM + NextM);
+					}
+				if (j > 0)
+					{
+					B[HMMSTATE_IY] = LOG_ADD(tII + NextIY, tIM + NextM);
+					B[HMMSTATE_JY] = LOG_ADD(tJJ + NextJY, tJM + NextM);
+					}
+				}
+			else if (uint(i) < LX)
+				{
+				assert(uint(j) == LY);
+				if (i > 0)
+					{
+					B[HMMSTATE_M] = LOG_ADD(tMI + NextIX, tMJ + NextJX);
+					B[HMMSTATE_IX] = tII + NextIX;
+					B[HMMSTATE_JX] = tJJ + NextJX;
+					}
+				}
+			else
+				{
+				assert(uint(i) == LX && uint(j) < LY);
+				if (j > 0)
+					{
+					B[HMMSTATE_M] = LOG_ADD(tMI + NextIY, tMJ + NextJY);
+					B[HMMSTATE_IY] = tII + NextIY;
+					B[HMMSTATE_JY] = tJJ + NextJY;
+					}
+				}
+			}
+		}
+	}
+
+bool CalcSparsePost_Banded(const byte *X, uint LX, const byte *Y, uint LY,
+  MySparseMx &SparsePost)
+	{
+	asserta(!Mega::m_Loaded);
+	const uint Pad = (optset_bandpad ? opt(bandpad) : BAND_DEFAULT_PAD);
+
+	DiagBox Box;
+	if (!GetSeedBox(X, LX, Y, LY, Pad, Box))
+		return false;
+	const int OLo = int(Box.dlo) - int(LX);
+	const int OHi = int(Box.dhi) - int(LX);
+
+	BandMx Fwd;
+	BandMx Bwd;
+	Fwd.Init(LX, LY, OLo, OHi);
+	Bwd.Init(LX, LY, OLo, OHi);
+	CalcFwdBand(X, Y, Fwd);
+	CalcBwdBand(X, Y, Bwd);
+
+// Same as CalcTotalProbFlat
+	const float *FwdEnd = Fwd.GetCell(LX, LY);
+	const float *BwdEnd = Bwd.GetCell(LX, LY);
+	float Total = LOG_ZERO;
+	for (uint s = 0; s < HMMSTATE_COUNT; ++s)
+		LOG_PLUS_EQUALS(Total, FwdEnd[s] + BwdEnd[s]);
+
+// Posterior mass on the two outermost diagonals of the band means
+// the band is probably cutting off part of the alignment.
+	const bool EdgeLo = (OLo > 1 - int(LX));
+	const bool EdgeHi = (OHi < int(LY) - 1);
+
+	vector<uint> RowStarts(LX);
+	vector<uint> RowSizes(LX);
+	vector<float> Probs;
+	vector<uint> Cols;
+	for (uint i = 1; i <= LX; ++i)
+		{
+		const uint Row = i - 1;
+		RowStarts[Row] = SIZE(Probs);
+		const uint Loj = max(Fwd.GetLoj(i), 1u);
+		const uint Hij = Fwd.GetHij(i);
+		for (uint j = Loj; j <= Hij; ++j)
+			{
+			float Score = Fwd.GetCell(i, j)[HMMSTATE_M] +
+			  Bwd.GetCell(i, j)[HMMSTATE_M] - Total;
+			if (Score < MIN_SPARSE_SCORE)
+				continue;
+			float P = (Score >= LOG_ONE ? 1.0f : expf(Score));
+			if (P < MIN_SPARSE_PROB)
+				continue;
+			int o = int(j) - int(i);
+			if ((EdgeLo && o <= OLo + 1) || (EdgeHi && o >= OHi - 1))
+				return false;
+			Probs.push_back(P);
+			Cols.push_back(j - 1);
+			}
+		RowSizes[Row] = SIZE(Probs) - RowStarts[Row];
+		}
+
+	SparsePost.FromRows(LX, LY, RowStarts, RowSizes, Probs, Cols);
+	return true;
+	}
@@ -51,7 +51,9 @@ void MPCFlat::CalcPosterior(uint PairIndex)
 
 	uint LX = m_MyInputSeqs->GetSeqLength(SeqIndexX);
 	uint LY = m_MyInputSeqs->GetSeqLength(SeqIndexY);
-	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
+	bool Overflow = (double(LX)*double(LY)*5 + 100 > double(INT_MAX));
+	bool LinMem = !Mega::m_Loaded && (opt(linmem) || Overflow);
+	if (Overflow && !LinMem)
 		{
 		ProgressLog("\nSequence length %u >%s\n",
 		  LX, GetLabel(SeqIndexX));
@@ -71,22 +73,43 @@ void MPCFlat::CalcPosterior(uint PairIndex)
 	asserta(LX2 == LX);
 	asserta(LY2 == LY);
 
-	float *Post = CalcPost(LabelX, LabelY);
-
-	MySparseMx &SparsePost = GetSparsePost(PairIndex);
-	SparsePost.FromPost(Post, LX, LY);
-
+// X, Y and their profiles are all from m_MyInputSeqs (InitSeqs)
 	const byte *X = GetBytePtr(SeqIndexX);
 	const byte *Y = GetBytePtr(SeqIndexY);
+	const QueryProf *PX = 0;
+	const QueryProf *PY = 0;
+	if (!Mega::m_Loaded)
+		{
+		asserta(SeqIndexX < SIZE(m_QueryProfs) && SeqIndexY < SIZE(m_QueryProfs));
+		PX = &m_QueryProfs[SeqIndexX];
+		PY = &m_QueryProfs[SeqIndexY];
+		}
+	MySparseMx &SparsePost = GetSparsePost(PairIndex);
+
+	float Score = 0;
+	bool Banded = !Mega::m_Loaded && opt(band) &&
+	  CalcSparsePost_Banded(X, LX, Y, LY, SparsePost);
+	if (Banded)
+		Score = CalcAlnScoreSparse(SparsePost);
+	else if (LinMem)
+		{
+		CalcSparsePost_LinMem(X, LX, Y, LY, SparsePost, PX, PY);
+		Score = CalcAlnScoreSparse(SparsePost);
+		}
+	else
+		{
+		float *Post = Mega::m_Loaded ? CalcPost(LabelX, LabelY) :
+		  CalcPost(X, LX, Y, LY, PX, PY);
+		SparsePost.FromPost(Post, LX, LY);
+
+		float *DPRows = AllocDPRows(LX, LY);
+		Score = CalcAlnScoreFlat(Post, LX, LY, DPRows);
+		myfree(Post);
+		myfree(DPRows);
+		}
 	SparsePost.m_X = X;
 	SparsePost.m_Y = Y;
 
-	float *DPRows = AllocDPRows(LX, LY);
-	float Score = CalcAlnScoreFlat(Post, LX, LY, DPRows);
-	myfree(Post);
-	myfree(DPRows);
-
 	float EA = Score/min(LX, LY);
-	m_DistMx[SeqIndexX][SeqIndexY] = EA;
-	m_DistMx[SeqIndexY][SeqIndexX] = EA;
+	m_DistMx.Set(SeqIndexX, SeqIndexY, EA);
 	}
@@ -0,0 +1,112 @@
+#include "muscle.h"
+#include "fbrows.h"
+
+/***
+Linear-memory posterior, enabled by -linmem and used automatically
+when the full Fwd/Bwd matrices would overflow (LX*LY*5 > INT_MAX).
+
+Forward keeps one checkpoint row every BlockSize rows, BlockSize
+~ sqrt(LX). Backward then runs from row LX down to 0; before each
+block is reached, its forward rows are recomputed from the block's
+checkpoint. Posteriors are the same as CalcPostFlat followed by
+MySparseMx::FromPost, but entries >= MIN_SPARSE_PROB are written
+directly to the sparse matrix and the dense Fwd, Bwd and Post
+matrices are never allocated. Memory is O(sqrt(LX)*LY) floats,
+time is ~1.5x CalcFwdFlat + CalcBwdFlat.
+***/
+
+void CalcSparsePost_LinMem(const byte *X, uint LX, const byte *Y, uint LY,
+  MySparseMx &SparsePost, const QueryProf *PX, const QueryProf *PY)
+	{
+	asserta(!Mega::m_Loaded);
+	asserta(LX > 0 && LY > 0);
+
+	FBRows FB;
+	FB.Init(X, LX, Y, LY, PX, PY);
+	const uint LY1 = LY + 1;
+	const uint64 RowSize = FB.GetRowSize();
+	const uint BlockSize = uint(sqrt(double(LX))) + 1;
+	const uint BlockCount = LX/BlockSize + 1;
+
+	float *Checkpoints = myalloc(float, BlockCount*RowSize);
+	float *Block = myalloc(float, BlockSize*RowSize);
+	float *BwdNext = myalloc(float, RowSize);
+	float *BwdCur = myalloc(float, RowSize);
+
+// Forward, keep rows 0, BlockSize, 2*BlockSize ... and row LX.
+// Block is used as two-row scratch here (BlockSize >= 2).
+	float *FwdPrev = Block;
+	float *FwdCur = Block + RowSize;
+	FB.FwdRow0(Checkpoints);
+	memcpy(FwdPrev, Checkpoints, RowSize*sizeof(float));
+	for (uint i = 1; i <= LX; ++i)
+		{
+		FB.FwdRow(i, FwdPrev, FwdCur);
+		if (i%BlockSize == 0)
+			memcpy(Checkpoints + (i/BlockSize)*RowSize, FwdCur,
+			  RowSize*sizeof(float));
+		swap(FwdPrev, FwdCur);
+		}
+
+// Same as CalcTotalProbFlat
+	FB.BwdRowLX(BwdNext);
+	float Total = LOG_ZERO;
+	for (uint s = 0; s < HMMSTATE_COUNT; ++s)
+		{
+		float FwdScore = FwdPrev[s*LY1 + LY];
+		float BwdScore = BwdNext[s*LY1 + LY];
+		LOG_PLUS_EQUALS(Total, FwdScore + BwdScore);
+		}
+
+// Sparse rows are generated from i=LX-1 down to 0, RowStarts[i]
+// is the offset of row i in Probs/Cols.
+	vector<uint> RowStarts(LX);
+	vector<uint> RowSizes(LX);
+	vector<float> Probs;
+	vector<uint> Cols;
+	for (int b = int(BlockCount) - 1; b >= 0; --b)
+		{
+		const uint Lo = uint(b)*BlockSize;
+		const uint Hi = min(Lo + BlockSize - 1, LX);
+
+		memcpy(Block, Checkpoints + uint(b)*RowSize, RowSize*sizeof(float));
+		for (uint i = Lo + 1; i <= Hi; ++i)
+			FB.FwdRow(i, Block + (i - Lo - 1)*RowSize, Block + (i - Lo)*RowSize);
+
+		for (int i = int(Hi); i >= int(Lo); --i)
+			{
+			if (uint(i) < LX)
+				{
+				FB.BwdRow(uint(i), BwdNext, BwdCur);
+				swap(BwdNext, BwdCur);
+				}
+			if (i == 0)
+				continue;
+
+		// Post[i-1][j-1] from M(i,j), as in CalcPostFlat
+			const float *FwdM = Block + (i - Lo)*RowSize + HMMSTATE_M*LY1;
+			const float *BwdM = BwdNext + HMMSTATE_M*LY1;
+			const uint Row = uint(i) - 1;
+			RowStarts[Row] = SIZE(Probs);
+			for (uint j = 1; j <= LY; ++j)
+				{
+				float Score = FwdM[j] + BwdM[j] - Total;
+				if (Score < MIN_SPARSE_SCORE)
+					continue;
+				float P = (Score >= LOG_ONE ? 1.0f : expf(Score));
+				if (P < MIN_SPARSE_PROB)
+					continue;
+				Probs.push_back(P);
+				Cols.push_back(j - 1);
+				}
+			RowSizes[Row] = SIZE(Probs) - RowStarts[Row];
+			}
+		}
+
+	SparsePost.FromRows(LX, LY, RowStarts, RowSizes, Probs, Cols);
+
+	myfree(Checkpoints);
+	myfree(Block);
+	myfree(BwdNext);
+	myfree(BwdCur);
+	}
@@ -106,5 +106,9 @@ C(swtestmm)
 C(swsimple2)
 C(cloak)
 C(squeeze_gappy)
+C(test_vecfb)
+C(bench_mpcflat)
+C(distmxbin)
+C(mbed_tree)
 
 #undef C
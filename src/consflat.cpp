@@ -2,22 +2,187 @@
 #include "mpcflat.h"
 #include "locallock.h"
 
+/***
+Pack the sparse posteriors of all pairs into one CSR arena.
+
+UpdateFromPost keeps the sparsity pattern of the old matrix, so
+both consistency generations can share m_ArenaOffsets and
+m_ArenaCols and differ only in m_ArenaProbs1/m_ArenaProbs2.
+Pair matrices become views into the arena. Each pair's own
+storage is freed as soon as it has been copied. m_ArenaProbs1
+always belongs to the current generation (m_ptrSparsePosts).
+***/
+void MPCFlat::PackSparsePosts()
+	{
+	if (m_ArenaCols != 0)
+		return;
+
+	const uint PairCount = SIZE(m_Pairs);
+	uint64 TotalVecSize = 0;
+	uint64 TotalOffsetCount = 0;
+	for (uint PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+		{
+		const MySparseMx &Mx = GetSparsePost(PairIndex);
+		asserta(!Mx.m_View);
+		TotalVecSize += Mx.m_VecSize;
+		TotalOffsetCount += Mx.GetLX() + 1;
+		}
+
+	m_ArenaOffsets = myalloc(uint, TotalOffsetCount);
+	m_ArenaCols = myalloc(uint, TotalVecSize);
+	m_ArenaProbs1 = myalloc(float, TotalVecSize);
+	m_ArenaProbs2 = myalloc(float, TotalVecSize);
+
+	uint64 VecBase = 0;
+	uint64 OffsetBase = 0;
+	for (uint PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+		{
+		MySparseMx &Mx = GetSparsePost(PairIndex);
+		const uint LX = Mx.GetLX();
+		const uint LY = Mx.GetLY();
+		const uint VecSize = Mx.m_VecSize;
+
+		uint *Offsets = m_ArenaOffsets + OffsetBase;
+		uint *Cols = m_ArenaCols + VecBase;
+		float *Probs1 = m_ArenaProbs1 + VecBase;
+		float *Probs2 = m_ArenaProbs2 + VecBase;
+		memcpy(Offsets, Mx.m_Offsets, (LX + 1)*sizeof(uint));
+		memcpy(Cols, Mx.m_Cols, VecSize*sizeof(uint));
+		memcpy(Probs1, Mx.m_Probs, VecSize*sizeof(float));
+
+		const byte *X = Mx.m_X;
+		const byte *Y = Mx.m_Y;
+		Mx.SetView(LX, LY, VecSize, Offsets, Cols, Probs1);
+		Mx.m_X = X;
+		Mx.m_Y = Y;
+
+		MySparseMx &UpdatedMx = GetUpdatedSparsePost(PairIndex);
+		UpdatedMx.SetView(LX, LY, VecSize, Offsets, Cols, Probs2);
+
+		VecBase += VecSize;
+		OffsetBase += LX + 1;
+		}
+	}
+
+// Views must be cleared before the arena is freed.
+void MPCFlat::FreeArena()
+	{
+	myfree(m_ArenaOffsets);
+	myfree(m_ArenaCols);
+	myfree(m_ArenaProbs1);
+	myfree(m_ArenaProbs2);
+	m_ArenaOffsets = 0;
+	m_ArenaCols = 0;
+	m_ArenaProbs1 = 0;
+	m_ArenaProbs2 = 0;
+
+	for (uint i = 0; i < SIZE(m_ConsScratches); ++i)
+		delete m_ConsScratches[i];
+	m_ConsScratches.clear();
+	m_ConsTileStarts.clear();
+	}
+
+// Tile = consecutive pairs (X,Y) with the same X, at most
+// CONS_TILE_PAIRS pairs and CONS_TILE_FLOATS dense floats.
+void MPCFlat::InitConsTiles()
+	{
+	m_ConsTileStarts.clear();
+	const uint PairCount = SIZE(m_Pairs);
+	uint TilePairCount = 0;
+	uint64 TileFloats = 0;
+	for (uint PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+		{
+		const pair<uint, uint> &Pair = GetPair(PairIndex);
+		uint64 Floats = uint64(GetSeqLength(Pair.first))*GetSeqLength(Pair.second);
+		bool NewTile = (PairIndex == 0 ||
+		  Pair.first != GetPair(PairIndex - 1).first ||
+		  TilePairCount == CONS_TILE_PAIRS ||
+		  TileFloats + Floats > CONS_TILE_FLOATS);
+		if (NewTile)
+			{
+			m_ConsTileStarts.push_back(PairIndex);
+			TilePairCount = 0;
+			TileFloats = 0;
+			}
+		++TilePairCount;
+		TileFloats += Floats;
+		}
+	m_ConsTileStarts.push_back(PairCount);
+	}
+
+/***
+Sampled consistency (-consz k). Each sequence X gets k/2 nearest
+neighbors by EA (m_DistMx is similarity here) plus random others
+up to k. Pair (X,Y) is relaxed over the union of the samples of X
+and Y, and divided by the number of Z's used (+2 for Z=X, Z=Y)
+rather than by the sequence count.
+***/
+void MPCFlat::InitConsSample()
+	{
+	m_ConsZs.clear();
+	const uint SeqCount = GetSeqCount();
+	if (m_ConsSampleSize == 0 || m_ConsSampleSize + 1 >= SeqCount)
+		return;
+
+	const uint NearCount = m_ConsSampleSize/2;
+	const uint RandCount = m_ConsSampleSize - NearCount;
+	m_ConsZs.resize(SeqCount);
+	vector<uint> Others;
+	for (uint X = 0; X < SeqCount; ++X)
+		{
+		Others.clear();
+		for (uint Z = 0; Z < SeqCount; ++Z)
+			if (Z != X)
+				Others.push_back(Z);
+
+		const TriDistMx &EAs = m_DistMx;
+		partial_sort(Others.begin(), Others.begin() + NearCount, Others.end(),
+		  [&EAs, X](uint Z1, uint Z2)
+			{
+			float EA1 = EAs.Get(X, Z1);
+			float EA2 = EAs.Get(X, Z2);
+			return EA1 > EA2 || (EA1 == EA2 && Z1 < Z2);
+			});
+
+	// Partial Fisher-Yates over the rest
+		const uint n = SIZE(Others);
+		for (uint k = 0; k < RandCount; ++k)
+			{
+			uint i = NearCount + k;
+			uint j = i + HashMix32(X, k)%(n - i);
+			swap(Others[i], Others[j]);
+			}
+
+		vector<uint> &Zs = m_ConsZs[X];
+		Zs.assign(Others.begin(), Others.begin() + NearCount + RandCount);
+		sort(Zs.begin(), Zs.end());
+		}
+	}
+
 void MPCFlat::ConsIter(uint Iter)
 	{
 	uint PairCount = SIZE(m_Pairs);
 	asserta(PairCount > 0);
-	unsigned ThreadCount = GetRequestedThreadCount();
-	uint PairCounter = 0;
+	asserta(m_ArenaCols != 0);
+	unsigned ThreadCount = GetThreadCount();
+	while (SIZE(m_ConsScratches) < ThreadCount)
+		m_ConsScratches.push_back(new ConsScratch);
+
+	const uint TileCount = SIZE(m_ConsTileStarts) - 1;
+	uint TileCounter = 0;
 #pragma omp parallel for num_threads(ThreadCount)
-	for (int PairIndex = 0; PairIndex < (int) PairCount; ++PairIndex)
+	for (int TileIndex = 0; TileIndex < (int) TileCount; ++TileIndex)
 		{
 		Lock();
-		ProgressStep(PairCounter++, PairCount, "Consistency (%u/%u)",
+		ProgressStep(TileCounter++, TileCount, "Consistency (%u/%u)",
 		  Iter+1, m_ConsistencyIterCount);
 		Unlock();
 
-		ConsPair(PairIndex);
+		uint ThreadIndex = GetThreadIndex();
+		asserta(ThreadIndex < SIZE(m_ConsScratches));
+		ConsTile(TileIndex, *m_ConsScratches[ThreadIndex]);
 		}
 
 	swap(m_ptrSparsePosts, m_ptrUpdatedSparsePosts);
+	swap(m_ArenaProbs1, m_ArenaProbs2);
 	}
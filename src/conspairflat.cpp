@@ -1,110 +1,141 @@
 #include "muscle.h"
 #include "mpcflat.h"
 
-#if 0//TRACE
-const byte *g_X;
-const byte *g_Y;
-const byte *g_Z;
-#endif
-
-void MPCFlat::ConsPair(uint PairIndex)
+/***
+Consistency for a tile of pairs (X,Y1), (X,Y2) ... which share X,
+see InitConsTiles. Z is the outer loop so XZ (or ZX) is read once
+per tile rather than once per pair. Each pair still accumulates
+Z in increasing order, so results are the same as relaxing the
+pairs one at a time.
+***/
+void MPCFlat::ConsTile(uint TileIndex, ConsScratch &Scratch)
 	{
-	const pair<uint, uint> &Pair = GetPair(PairIndex);
+	const uint FirstPairIndex = m_ConsTileStarts[TileIndex];
+	const uint TilePairCount = m_ConsTileStarts[TileIndex+1] - FirstPairIndex;
+	asserta(TilePairCount > 0 && TilePairCount <= CONS_TILE_PAIRS);
 
-	uint SeqIndexX = Pair.first;
-	uint SeqIndexY = Pair.second;
+	const uint SeqIndexX = GetPair(FirstPairIndex).first;
+	const uint LX = GetSeqLength(SeqIndexX);
 
-	const MySparseMx &SparsePostXY = GetSparsePost(PairIndex);
+	uint SeqIndexYs[CONS_TILE_PAIRS];
+	float *Posts[CONS_TILE_PAIRS];
+	uint64 PostsSize = 0;
+	for (uint t = 0; t < TilePairCount; ++t)
+		{
+		const pair<uint, uint> &Pair = GetPair(FirstPairIndex + t);
+		asserta(Pair.first == SeqIndexX);
+		SeqIndexYs[t] = Pair.second;
+		PostsSize += uint64(LX)*GetSeqLength(Pair.second);
+		}
 
-	uint LX = GetSeqLength(SeqIndexX);
-	uint LY = GetSeqLength(SeqIndexY);
+	float *Buffer = Scratch.GetPosts(PostsSize);
+	for (uint t = 0; t < TilePairCount; ++t)
+		{
+		const MySparseMx &SparsePostXY = GetSparsePost(FirstPairIndex + t);
+		const uint LY = GetSeqLength(SeqIndexYs[t]);
+		asserta(SparsePostXY.GetLX() == LX);
+		asserta(SparsePostXY.GetLY() == LY);
+
+		float *Post = Buffer;
+		Buffer += uint64(LX)*LY;
+		Posts[t] = Post;
+		SparsePostXY.ToPost(Post);
+
+	// Account for Z=X and Z=Y (hence the factor 2)
+		for (uint k = 0; k < LX*LY; ++k)
+			Post[k] *= 2;
+		}
 
-	asserta(SparsePostXY.GetLX() == LX);
-	asserta(SparsePostXY.GetLY() == LY);
+	const uint SeqCount = GetSeqCount();
 
-	float *Post = AllocPost(LX, LY);
-	SparsePostXY.ToPost(Post);
+// Sampled (-consz), pair t uses Z if bit t is set in m_ZMask[Z]
+	const bool Sampled = !m_ConsZs.empty();
+	vector<uint> &ZList = Scratch.m_ZList;
+	vector<byte> &ZMask = Scratch.m_ZMask;
+	if (Sampled)
+		{
+		ZMask.resize(SeqCount, 0);
+		ZList = m_ConsZs[SeqIndexX];
+		for (uint k = 0; k < SIZE(ZList); ++k)
+			ZMask[ZList[k]] = 0xff;
+		for (uint t = 0; t < TilePairCount; ++t)
+			{
+			const vector<uint> &ZsY = m_ConsZs[SeqIndexYs[t]];
+			for (uint k = 0; k < SIZE(ZsY); ++k)
+				{
+				const uint Z = ZsY[k];
+				if (ZMask[Z] == 0)
+					ZList.push_back(Z);
+				ZMask[Z] |= (1 << t);
+				}
+			}
+		sort(ZList.begin(), ZList.end());
+		}
 
-// Account for Z=X and Z=Y (hence the factor 2)
-	for (uint k = 0; k < LX*LY; ++k)
-		Post[k] *= 2;
-#if 0//TRACE
-	LogFlatMx("ConsPair Z=X Z=Y", Post, LX, LY);
-#endif
+	uint ZCounts[CONS_TILE_PAIRS];
+	for (uint t = 0; t < TilePairCount; ++t)
+		ZCounts[t] = 0;
 
-	const uint SeqCount = GetSeqCount();
-	asserta(SeqIndexX < SeqIndexY); // because convention for pairs
-	for (uint SeqIndexZ = 0; SeqIndexZ < SeqCount; ++SeqIndexZ)
+	const uint ZCount = (Sampled ? SIZE(ZList) : SeqCount);
+	for (uint ZIndex = 0; ZIndex < ZCount; ++ZIndex)
 		{
-		if (SeqIndexZ == SeqIndexX || SeqIndexZ == SeqIndexY)
+		const uint SeqIndexZ = (Sampled ? ZList[ZIndex] : ZIndex);
+		if (SeqIndexZ == SeqIndexX)
 			continue;
+		const byte Mask = (Sampled ? ZMask[SeqIndexZ] : 0xff);
 		float wZ = m_Weights[SeqIndexZ];
 		wZ = 1.0f;
 
-#if 0//TRACE
-		g_X = GetSequence(SeqIndexX)->GetBytePtr();
-		g_Y = GetSequence(SeqIndexY)->GetBytePtr();
-		g_Z = GetSequence(SeqIndexZ)->GetBytePtr();
-#endif
 		if (SeqIndexZ < SeqIndexX)
 			{
-			asserta(SeqIndexZ < SeqIndexY); // because SeqIndexX < SeqIndexY
-
-			uint PairIndexZX = GetPairIndex(SeqIndexZ, SeqIndexX);
-			uint PairIndexZY = GetPairIndex(SeqIndexZ, SeqIndexY);
-
-			const MySparseMx &ZX = GetSparsePost(PairIndexZX);
-			const MySparseMx &ZY = GetSparsePost(PairIndexZY);
-
-			RelaxFlat_ZX_ZY(ZX, ZY, wZ, Post);
-#if 0//TRACE
-		LogFlatMx("ConsPair after RelaxFlat_ZX_ZY", Post, LX, LY);
-#endif
+			const MySparseMx &ZX = GetSparsePost(GetPairIndex(SeqIndexZ, SeqIndexX));
+			for (uint t = 0; t < TilePairCount; ++t)
+				{
+				if ((Mask & (1 << t)) == 0)
+					continue;
+				const uint SeqIndexY = SeqIndexYs[t];
+				asserta(SeqIndexZ < SeqIndexY); // because SeqIndexX < SeqIndexY
+				const MySparseMx &ZY = GetSparsePost(GetPairIndex(SeqIndexZ, SeqIndexY));
+				RelaxFlat_ZX_ZY(ZX, ZY, wZ, Posts[t]);
+				++ZCounts[t];
+				}
+			continue;
 			}
-		else if (SeqIndexZ > SeqIndexX && SeqIndexZ < SeqIndexY)
-			{
-			uint PairIndexXZ = GetPairIndex(SeqIndexX, SeqIndexZ);
-			uint PairIndexZY = GetPairIndex(SeqIndexZ, SeqIndexY);
-
-			const MySparseMx &XZ = GetSparsePost(PairIndexXZ);
-			const MySparseMx &ZY = GetSparsePost(PairIndexZY);
 
-			RelaxFlat_XZ_ZY(XZ, ZY, wZ, Post);
-#if 0//TRACE
-			LogFlatMx("ConsPair after RelaxFlat_XZ_ZY", Post, LX, LY);
-#endif
-			}
-		else if (SeqIndexZ > SeqIndexX && SeqIndexZ > SeqIndexY)
+		const MySparseMx &XZ = GetSparsePost(GetPairIndex(SeqIndexX, SeqIndexZ));
+		for (uint t = 0; t < TilePairCount; ++t)
 			{
-			uint PairIndexXZ = GetPairIndex(SeqIndexX, SeqIndexZ);
-			uint PairIndexYZ = GetPairIndex(SeqIndexY, SeqIndexZ);
-
-			const MySparseMx &XZ = GetSparsePost(PairIndexXZ);
-			const MySparseMx &YZ = GetSparsePost(PairIndexYZ);
-
-			RelaxFlat_XZ_YZ(XZ, YZ, wZ, Post);
-#if 0//TRACE
-			LogFlatMx("ConsPair after RelaxFlat_XZ_YZ", Post, LX, LY);
-#endif
+			const uint SeqIndexY = SeqIndexYs[t];
+			if (SeqIndexZ == SeqIndexY || (Mask & (1 << t)) == 0)
+				continue;
+			if (SeqIndexZ < SeqIndexY)
+				{
+				const MySparseMx &ZY = GetSparsePost(GetPairIndex(SeqIndexZ, SeqIndexY));
+				RelaxFlat_XZ_ZY(XZ, ZY, wZ, Posts[t]);
+				}
+			else
+				{
+			// Transpose YZ so that rows are indexed by Z
+				const MySparseMx &YZ = GetSparsePost(GetPairIndex(SeqIndexY, SeqIndexZ));
+				YZ.Transpose(Scratch.m_T);
+				RelaxFlat_XZ_ZY(XZ, Scratch.m_T, wZ, Posts[t]);
+				}
+			++ZCounts[t];
 			}
-		else
-			asserta(false);
 		}
 
-	MySparseMx &UpdatedSparsePostXY = GetUpdatedSparsePost(PairIndex);
-
-#if 0//TRACE
-	LogFlatMx("Final post before update", Post, LX, LY);
-#endif
-	UpdatedSparsePostXY.UpdateFromPost(SparsePostXY, Post, SeqCount);
-	UpdatedSparsePostXY.m_X = SparsePostXY.m_X;
-	UpdatedSparsePostXY.m_Y = SparsePostXY.m_Y;
-	myfree(Post);
+	if (Sampled)
+		for (uint k = 0; k < SIZE(ZList); ++k)
+			ZMask[ZList[k]] = 0;
 
-#if 0//TRACE
-	Log("\nBefore:");
-	SparsePostXY.LogMe();
-	Log("\nUpdated:");
-	UpdatedSparsePostXY.LogMe();
-#endif
+// +2 for Z=X and Z=Y, same as SeqCount if not sampled
+	for (uint t = 0; t < TilePairCount; ++t)
+		{
+		const uint PairIndex = FirstPairIndex + t;
+		const MySparseMx &SparsePostXY = GetSparsePost(PairIndex);
+		MySparseMx &UpdatedSparsePostXY = GetUpdatedSparsePost(PairIndex);
+		UpdatedSparsePostXY.UpdateFromPost(SparsePostXY, Posts[t], ZCounts[t] + 2);
+		UpdatedSparsePostXY.m_X = SparsePostXY.m_X;
+		UpdatedSparsePostXY.m_Y = SparsePostXY.m_Y;
+		}
 	}
@@ -1,28 +1,82 @@
 #include "muscle.h"
 #include "derep.h"
+#include "locallock.h"
 
 void Derep::Clear()
 	{
 	m_SeqIndexToRepSeqIndex.clear();
 	m_RepSeqIndexes.clear();
 	m_RepSeqIndexToSeqIndexes.clear();
-	m_HashToSeqIndexes.clear();
+	m_FP1.clear();
+	m_FP2.clear();
 	}
 
-// FNV64 hash
-uint Derep::CalcHash(const Sequence *Seq) const
+static inline uint64 FPMix(uint64 x)
 	{
-    uint64 hash = 0xcbf29ce484222325uL;
+	x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+	}
+
+static inline uint64 FPRotl(uint64 x, uint r)
+	{
+	return (x << r) | (x >> (64 - r));
+	}
+
+/***
+Two independent 64-bit hashes over 8 bytes at a time. Bit 0x20 is
+cleared in every byte, so letters that differ only in case hash the
+same; other characters may collide, which SeqsEq resolves.
+***/
+void Derep::CalcFingerprint(const Sequence *Seq, uint64 &FP1, uint64 &FP2) const
+	{
+	const uint64 FOLD = 0xdfdfdfdfdfdfdfdfull;
+	const byte *p = Seq->GetBytePtr();
 	const uint L = Seq->GetLength();
-    for (uint i = 0; i < L; ++i)
-	    {
-		char c = Seq->GetChar(i);
-        byte b = (byte) tolower(c);
-        hash *= 1099511628211uL;
-        hash ^= (uint64) b;
+	uint64 h1 = 0x243f6a8885a308d3ull ^ L;
+	uint64 h2 = 0x13198a2e03707344ull + L;
+	uint i = 0;
+	for (; i + 8 <= L; i += 8)
+		{
+		uint64 w;
+		memcpy(&w, p + i, 8);
+		w &= FOLD;
+		h1 = FPRotl(h1 ^ w, 29)*0x9e3779b97f4a7c15ull;
+		h2 = FPRotl(h2 + w, 31)*0xc2b2ae3d27d4eb4full;
+		}
+	if (i < L)
+		{
+		uint64 w = 0;
+		memcpy(&w, p + i, L - i);
+		w &= FOLD;
+		h1 = FPRotl(h1 ^ w, 29)*0x9e3779b97f4a7c15ull;
+		h2 = FPRotl(h2 + w, 31)*0xc2b2ae3d27d4eb4full;
+		}
+	FP1 = FPMix(h1);
+	FP2 = FPMix(h2 ^ FP1);
+	}
+
+// SeqIndexes is a run of equal fingerprints in increasing order,
+// each sequence maps to the first equal sequence in the run.
+void Derep::ResolveRun(const uint *SeqIndexes, uint n)
+	{
+	for (uint i = 0; i < n; ++i)
+		{
+		const uint SeqIndex = SeqIndexes[i];
+		uint RepSeqIndex = SeqIndex;
+		for (uint j = 0; j < i; ++j)
+			{
+			const uint SeqIndex2 = SeqIndexes[j];
+			if (m_SeqIndexToRepSeqIndex[SeqIndex2] != SeqIndex2)
+				continue;
+			if (SeqsEq(SeqIndex, SeqIndex2))
+				{
+				RepSeqIndex = SeqIndex2;
+				break;
+				}
+			}
+		m_SeqIndexToRepSeqIndex[SeqIndex] = RepSeqIndex;
 		}
-	uint h = uint(hash%m_SlotCount);
-	return h;
 	}
 
 void Derep::Run(MultiSequence &InputSeqs, bool ShowProgress)
@@ -30,35 +84,82 @@ void Derep::Run(MultiSequence &InputSeqs, bool ShowProgress)
 	Clear();
 	m_InputSeqs = &InputSeqs;
 	const uint InputSeqCount = InputSeqs.GetSeqCount();
-	m_SlotCount = 3*InputSeqCount + 7;
-
-	m_HashToSeqIndexes.resize(m_SlotCount);
 	m_SeqIndexToRepSeqIndex.resize(InputSeqCount, UINT_MAX);
 	m_RepSeqIndexToSeqIndexes.resize(InputSeqCount);
+	uint ThreadCount = m_ThreadCount;
+	if (ThreadCount == 0)
+		ThreadCount = (omp_in_parallel() ? 1 : GetRequestedThreadCount());
+	if (ShowProgress)
+		{
+		Lock();
+		ProgressStep(0, 2, "Derep %u seqs", InputSeqCount);
+		Unlock();
+		}
 
-	uint UniqueCount = 0;
-	uint DupeCount = 0;
-	for (uint SeqIndex = 0; SeqIndex < InputSeqCount; ++SeqIndex)
+	if (m_Disable)
 		{
-		uint RepSeqIndex = Search(SeqIndex);
-		if (RepSeqIndex == UINT_MAX)
-			{
-			AddToHash(SeqIndex);
-			asserta(SIZE(m_RepSeqIndexes) == UniqueCount);
-			m_RepSeqIndexes.push_back(SeqIndex);
-			m_RepSeqIndexToSeqIndexes[SeqIndex].push_back(SeqIndex);
+		for (uint SeqIndex = 0; SeqIndex < InputSeqCount; ++SeqIndex)
 			m_SeqIndexToRepSeqIndex[SeqIndex] = SeqIndex;
-			++UniqueCount;
+		}
+	else
+		{
+		m_FP1.resize(InputSeqCount);
+		m_FP2.resize(InputSeqCount);
+#pragma omp parallel for num_threads(ThreadCount)
+		for (int SeqIndex = 0; SeqIndex < (int) InputSeqCount; ++SeqIndex)
+			CalcFingerprint(InputSeqs.GetSequence(SeqIndex),
+			  m_FP1[SeqIndex], m_FP2[SeqIndex]);
+
+		vector<uint> Order(InputSeqCount);
+		for (uint SeqIndex = 0; SeqIndex < InputSeqCount; ++SeqIndex)
+			Order[SeqIndex] = SeqIndex;
+		const vector<uint64> &FP1 = m_FP1;
+		const vector<uint64> &FP2 = m_FP2;
+		sort(Order.begin(), Order.end(),
+		  [&FP1, &FP2](uint i, uint j)
+			{
+			if (FP1[i] != FP1[j])
+				return FP1[i] < FP1[j];
+			if (FP2[i] != FP2[j])
+				return FP2[i] < FP2[j];
+			return i < j;
+			});
+
+		vector<uint> RunStarts;
+		for (uint k = 0; k < InputSeqCount; ++k)
+			{
+			if (k == 0 || FP1[Order[k]] != FP1[Order[k-1]] ||
+			  FP2[Order[k]] != FP2[Order[k-1]])
+				RunStarts.push_back(k);
 			}
-		else
+		RunStarts.push_back(InputSeqCount);
+
+		const uint RunCount = SIZE(RunStarts) - 1;
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1024)
+		for (int RunIndex = 0; RunIndex < (int) RunCount; ++RunIndex)
 			{
-			m_RepSeqIndexToSeqIndexes[RepSeqIndex].push_back(SeqIndex);
-			m_SeqIndexToRepSeqIndex[SeqIndex] = RepSeqIndex;
-			++DupeCount;
+			const uint Lo = RunStarts[RunIndex];
+			const uint Hi = RunStarts[RunIndex+1];
+			ResolveRun(Order.data() + Lo, Hi - Lo);
 			}
-		if (ShowProgress)
-			ProgressStep(SeqIndex, InputSeqCount, "Derep %u uniques, %u dupes",
-				UniqueCount, DupeCount);
+		}
+
+	for (uint SeqIndex = 0; SeqIndex < InputSeqCount; ++SeqIndex)
+		{
+		const uint RepSeqIndex = m_SeqIndexToRepSeqIndex[SeqIndex];
+		asserta(RepSeqIndex <= SeqIndex);
+		if (RepSeqIndex == SeqIndex)
+			m_RepSeqIndexes.push_back(SeqIndex);
+		m_RepSeqIndexToSeqIndexes[RepSeqIndex].push_back(SeqIndex);
+		}
+
+	if (ShowProgress)
+		{
+		const uint UniqueCount = SIZE(m_RepSeqIndexes);
+		Lock();
+		ProgressStep(1, 2, "Derep %u uniques, %u dupes",
+		  UniqueCount, InputSeqCount - UniqueCount);
+		Unlock();
 		}
 	}
 
@@ -82,35 +183,6 @@ bool Derep::SeqsEq(uint SeqIndex1, uint SeqIndex2) const
 	return true;
 	}
 
-uint Derep::Search(uint SeqIndex) const
-	{
-	if (m_Disable)
-		return UINT_MAX;
-	const Sequence *Seq = m_InputSeqs->GetSequence(SeqIndex);
-	asserta(Seq != 0);
-	uint h = CalcHash(Seq);
-	asserta(h < SIZE(m_HashToSeqIndexes));
-	const vector<uint> &Row = m_HashToSeqIndexes[h];
-	const uint n = SIZE(Row);
-	for (uint i = 0; i < n; ++i)
-		{
-		uint SeqIndex2 = Row[i];
-		if (SeqsEq(SeqIndex, SeqIndex2))
-			return SeqIndex2;
-		}
-	return UINT_MAX;
-	}
-
-void Derep::AddToHash(uint SeqIndex)
-	{
-	const Sequence *Seq = m_InputSeqs->GetSequence(SeqIndex);
-	asserta(Seq != 0);
-	uint h = CalcHash(Seq);
-	asserta(h < SIZE(m_HashToSeqIndexes));
-	vector<uint> &Row = m_HashToSeqIndexes[h];
-	Row.push_back(SeqIndex);
-	}
-
 void Derep::GetUniqueSeqs(MultiSequence &UniqueSeqs)
 	{
 	asserta(UniqueSeqs.GetSeqCount() == 0);
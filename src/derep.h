@@ -1,5 +1,12 @@
 #pragma once
 
+/***
+Exact dereplication, case-insensitive. Each sequence gets a 128-bit
+fingerprint (computed in parallel), indexes are sorted by fingerprint
+and full sequences are compared only within runs of equal
+fingerprints. The representative is the first occurrence, so output
+order is the same as a serial scan of the input.
+***/
 class Derep
 	{
 public:
@@ -7,19 +14,21 @@ public:
 	vector<uint> m_SeqIndexToRepSeqIndex;
 	vector<uint> m_RepSeqIndexes;
 	vector<vector<uint> > m_RepSeqIndexToSeqIndexes;
-	
-	uint m_SlotCount = 0;
-	vector<vector<uint> > m_HashToSeqIndexes;
+	vector<uint64> m_FP1;
+	vector<uint64> m_FP2;
 
 	bool m_Disable = false;
 
+// Threads for fingerprints and run resolution, 0=requested threads
+// (1 if already in a parallel region). MPCFlat passes its own count.
+	uint m_ThreadCount = 0;
+
 public:
-	uint CalcHash(const Sequence *Seq) const;
+	void CalcFingerprint(const Sequence *Seq, uint64 &FP1, uint64 &FP2) const;
 	void Clear();
 	void Run(MultiSequence &InputSeqs, bool ShowProgress = true);
-	uint Search(uint SeqIndex) const;
+	void ResolveRun(const uint *SeqIndexes, uint n);
 	void GetUniqueSeqs(MultiSequence &UniqueSeqs);
-	void AddToHash(uint SeqIndex);
 	bool SeqsEq(uint SeqIndex1, uint SeqIndex2) const;
 	void Validate() const;
 	void GetDupeGSIs(vector<uint> &GSIs,
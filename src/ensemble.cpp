@@ -231,9 +231,7 @@ void Ensemble::MakeResampledMSA(const vector<uint> &UniqueIxs, MSA &M) const
 		uint UniqueIx = UniqueIxs[ColIndex];
 		asserta(UniqueIx < SIZE(m_UniqueIxs));
 		uint Ix = m_UniqueIxs[UniqueIx];
-		asserta(Ix < SIZE(m_ColumnStrings));
-		const string &ColumnString = m_ColumnStrings[Ix];
-		asserta(SIZE(ColumnString) == SeqCount);
+		const char *ColumnString = GetColChars(Ix);
 		for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
 			{
 			char c = ColumnString[SeqIndex];
@@ -357,19 +355,14 @@ void Ensemble::SetColToPosVec()
 	}
 
 void Ensemble::GetColumn(uint MSAIndex, uint ColIndex,
-  string &ColStr, vector<int> &PosVec) const
+  char *ColChars, int *PosVec) const
 	{
-	ColStr.clear();
-	PosVec.clear();
-
 	const MSA &M = *m_MSAs[MSAIndex];
 	const uint SeqCount = GetSeqCount();
-	ColStr.resize(SeqCount, '?');
-	PosVec.resize(SeqCount, INT_MAX);
 	for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
 		{
 		char c = M.GetChar(SeqIndex, ColIndex);
-		ColStr[SeqIndex] = c;
+		ColChars[SeqIndex] = c;
 
 		int Pos = m_ColToPosVec[MSAIndex][SeqIndex][ColIndex];
 		PosVec[SeqIndex] = Pos;
@@ -382,18 +375,53 @@ void Ensemble::GetColumn(uint MSAIndex, uint ColIndex,
 			asserta(c2 == c);
 			}
 		}
-#if DEBUG
+	}
+
+const char *Ensemble::GetColChars(uint Ix) const
 	{
-	for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
-		asserta(ColStr[SeqIndex] != '?');
+	const uint SeqCount = GetSeqCount();
+	asserta(Ix < GetIxCount());
+	return m_ColChars.data() + uint64(Ix)*SeqCount;
+	}
+
+const int *Ensemble::GetColPositions(uint Ix) const
+	{
+	const uint SeqCount = GetSeqCount();
+	asserta(Ix < GetIxCount());
+	return m_ColPositions.data() + uint64(Ix)*SeqCount;
+	}
+
+bool Ensemble::ColPositionsEq(uint Ix1, uint Ix2) const
+	{
+	const uint SeqCount = GetSeqCount();
+	return memcmp(GetColPositions(Ix1), GetColPositions(Ix2),
+	  SeqCount*sizeof(int)) == 0;
 	}
-#endif
+
+static uint64 HashColPositions(const int *PosVec, uint SeqCount)
+	{
+	uint64 h = 0x9e3779b97f4a7c15ull ^ SeqCount;
+	for (uint i = 0; i < SeqCount; ++i)
+		{
+		h ^= uint32(PosVec[i]);
+		h *= 0xff51afd7ed558ccdull;
+		h ^= (h >> 32);
+		}
+	h ^= (h >> 29);
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= (h >> 32);
+	return h;
 	}
 
+/***
+Columns of all MSAs are copied into the contiguous m_ColChars and
+m_ColPositions matrices and hashed, in parallel over MSAs.
+***/
 void Ensemble::SetColumns()
 	{
-	m_ColumnStrings.clear();
-	m_ColumnPositions.clear();
+	m_ColChars.clear();
+	m_ColPositions.clear();
+	m_ColHashes.clear();
 	m_IxToMSAIndex.clear();
 	m_IxToColIndex.clear();
 
@@ -402,35 +430,56 @@ void Ensemble::SetColumns()
 	if (MSACount == 0)
 		return;
 
+	vector<uint> MSAToFirstIx;
+	uint IxCount = 0;
 	for (uint MSAIndex = 0; MSAIndex < MSACount; ++MSAIndex)
 		{
-		map<string, uint> LabelToSeqIndex2;
 		const MSA &M = *m_MSAs[MSAIndex];
 		uint SeqCount2 = M.GetSeqCount();
 		asserta(SeqCount2 == SeqCount);
 
+		MSAToFirstIx.push_back(IxCount);
 		const uint ColCount = M.GetColCount();
 		for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 			{
-			string ColStr;
-			vector<int> PosVec;
-			GetColumn(MSAIndex, ColIndex, ColStr, PosVec);
-
-			m_ColumnStrings.push_back(ColStr);
-			m_ColumnPositions.push_back(PosVec);
 			m_IxToMSAIndex.push_back(MSAIndex);
 			m_IxToColIndex.push_back(ColIndex);
 			}
+		IxCount += ColCount;
+		}
+
+	m_ColChars.resize(uint64(IxCount)*SeqCount);
+	m_ColPositions.resize(uint64(IxCount)*SeqCount);
+	m_ColHashes.resize(IxCount);
+	const uint ThreadCount = GetRequestedThreadCount();
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1)
+	for (int iMSAIndex = 0; iMSAIndex < int(MSACount); ++iMSAIndex)
+		{
+		const uint MSAIndex = uint(iMSAIndex);
+		const uint ColCount = m_MSAs[MSAIndex]->GetColCount();
+		for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
+			{
+			const uint Ix = MSAToFirstIx[MSAIndex] + ColIndex;
+			char *ColChars = m_ColChars.data() + uint64(Ix)*SeqCount;
+			int *PosVec = m_ColPositions.data() + uint64(Ix)*SeqCount;
+			GetColumn(MSAIndex, ColIndex, ColChars, PosVec);
+			m_ColHashes[Ix] = HashColPositions(PosVec, SeqCount);
+			}
 		}
 	SetUniqueColMap();
 	}
 
+/***
+Identical columns are found by sorting Ixs on position-vector hash
+and comparing positions only within runs of equal hashes. UniqueIxs
+are numbered in order of first occurrence.
+***/
 void Ensemble::SetUniqueColMap()
 	{
 	m_UniqueIxs.clear();
 	m_UniqueIxToIxs.clear();
 	m_IxToUniqueIx.clear();
-	m_UniqueColMap.clear();
+	m_UniqueHashes.clear();
 	m_MSAColToIx.clear();
 
 	const uint MSACount = GetMSACount();
@@ -441,9 +490,45 @@ void Ensemble::SetUniqueColMap()
 		uint ColCount = M.GetColCount();
 		m_MSAColToIx[MSAIndex].resize(ColCount, UINT_MAX);
 		}
-	
-	const vector<uint> Empty;
-	const uint N = SIZE(m_ColumnPositions);
+
+	const uint N = GetIxCount();
+	vector<uint> Order(N);
+	for (uint Ix = 0; Ix < N; ++Ix)
+		Order[Ix] = Ix;
+	const vector<uint64> &Hashes = m_ColHashes;
+	sort(Order.begin(), Order.end(),
+	  [&Hashes](uint Ix1, uint Ix2)
+		{
+		if (Hashes[Ix1] != Hashes[Ix2])
+			return Hashes[Ix1] < Hashes[Ix2];
+		return Ix1 < Ix2;
+		});
+
+// Rep = first Ix with the same positions
+	vector<uint> IxToRepIx(N, UINT_MAX);
+	for (uint i = 0; i < N; )
+		{
+		uint j = i + 1;
+		while (j < N && Hashes[Order[j]] == Hashes[Order[i]])
+			++j;
+		for (uint k = i; k < j; ++k)
+			{
+			const uint Ix = Order[k];
+			IxToRepIx[Ix] = Ix;
+			for (uint k2 = i; k2 < k; ++k2)
+				{
+				const uint Ix2 = Order[k2];
+				if (IxToRepIx[Ix2] == Ix2 && ColPositionsEq(Ix, Ix2))
+					{
+					IxToRepIx[Ix] = Ix2;
+					break;
+					}
+				}
+			}
+		i = j;
+		}
+
+	m_IxToUniqueIx.resize(N, UINT_MAX);
 	for (uint Ix = 0; Ix < N; ++Ix)
 		{
 		uint MSAIndex = m_IxToMSAIndex[Ix];
@@ -451,36 +536,56 @@ void Ensemble::SetUniqueColMap()
 		asserta(MSAIndex < MSACount);
 		asserta(ColIndex < SIZE(m_MSAColToIx[MSAIndex]));
 		m_MSAColToIx[MSAIndex][ColIndex] = Ix;
-		const vector<int> &PosVec = m_ColumnPositions[Ix];
-		map<vector<int>, uint>::const_iterator p =
-		  m_UniqueColMap.find(PosVec);
-		if (p == m_UniqueColMap.end())
+		const uint RepIx = IxToRepIx[Ix];
+		asserta(RepIx <= Ix);
+		if (RepIx == Ix)
 			{
 			uint UniqueIx = SIZE(m_UniqueIxs);
-			m_UniqueColMap[PosVec] = UniqueIx;
 			m_UniqueIxs.push_back(Ix);
-
-			asserta(SIZE(m_UniqueIxToIxs) == UniqueIx);
-			m_UniqueIxToIxs.push_back(Empty);
+			m_UniqueIxToIxs.resize(UniqueIx + 1);
 			m_UniqueIxToIxs[UniqueIx].push_back(Ix);
-			m_IxToUniqueIx.push_back(UniqueIx);
+			m_IxToUniqueIx[Ix] = UniqueIx;
 			}
 		else
 			{
-			uint UniqueIx = p->second;
+			uint UniqueIx = m_IxToUniqueIx[RepIx];
 			m_UniqueIxToIxs[UniqueIx].push_back(Ix);
-			m_IxToUniqueIx.push_back(UniqueIx);
+			m_IxToUniqueIx[Ix] = UniqueIx;
 			}
 		}
+
+	const uint UniqueCount = SIZE(m_UniqueIxs);
+	m_UniqueHashes.reserve(UniqueCount);
+	for (uint UniqueIx = 0; UniqueIx < UniqueCount; ++UniqueIx)
+		m_UniqueHashes.push_back(pair<uint64, uint>(
+		  Hashes[m_UniqueIxs[UniqueIx]], UniqueIx));
+	sort(m_UniqueHashes.begin(), m_UniqueHashes.end());
 	ValidateUniqueColMap();
 	}
 
+// UINT_MAX if no column of the ensemble has these positions
+uint Ensemble::FindUniqueIx(const int *PosVec) const
+	{
+	const uint SeqCount = GetSeqCount();
+	const uint64 h = HashColPositions(PosVec, SeqCount);
+	vector<pair<uint64, uint> >::const_iterator p =
+	  lower_bound(m_UniqueHashes.begin(), m_UniqueHashes.end(),
+	  pair<uint64, uint>(h, 0));
+	for (; p != m_UniqueHashes.end() && p->first == h; ++p)
+		{
+		uint UniqueIx = p->second;
+		const int *PosVec2 = GetColPositions(m_UniqueIxs[UniqueIx]);
+		if (memcmp(PosVec, PosVec2, SeqCount*sizeof(int)) == 0)
+			return UniqueIx;
+		}
+	return UINT_MAX;
+	}
+
 void Ensemble::ValidateUniqueColMap1(uint MSAIndex, uint ColIndex) const
 	{
 	asserta(ColIndex < SIZE(m_MSAColToIx[MSAIndex]));
 	uint Ix = m_MSAColToIx[MSAIndex][ColIndex];
-	asserta(Ix < SIZE(m_ColumnPositions));
-	const vector<int> &PosVec = m_ColumnPositions[Ix];
+	asserta(Ix < GetIxCount());
 
 	asserta(Ix < SIZE(m_IxToUniqueIx));
 	uint UniqueIx = m_IxToUniqueIx[Ix];
@@ -497,12 +602,7 @@ void Ensemble::ValidateUniqueColMap1(uint MSAIndex, uint ColIndex) const
 			}
 		}
 	asserta(Found);
-
-	map<vector<int>, uint>::const_iterator p =
-	  m_UniqueColMap.find(PosVec);
-	asserta(p != m_UniqueColMap.end());
-	uint UniqueIx2 = p->second;
-	asserta(UniqueIx == UniqueIx2);
+	asserta(ColPositionsEq(Ix, m_UniqueIxs[UniqueIx]));
 	}
 
 void Ensemble::ValidateUniqueIx(uint UniqueIx) const
@@ -511,24 +611,18 @@ void Ensemble::ValidateUniqueIx(uint UniqueIx) const
 	asserta(UniqueIx < SIZE(m_UniqueIxToIxs));
 
 	uint Ix = m_UniqueIxs[UniqueIx];
-	asserta(Ix < SIZE(m_ColumnPositions));
-
-	const vector<int> &PosVec = m_ColumnPositions[Ix];
-	map<vector<int>, uint>::const_iterator p =
-	  m_UniqueColMap.find(PosVec);
-	asserta(p != m_UniqueColMap.end());
-	asserta(p->first == PosVec);
+	asserta(Ix < GetIxCount());
 
 	const vector<uint> &Ixs = m_UniqueIxToIxs[UniqueIx];
+	asserta(!Ixs.empty() && Ixs[0] == Ix);
 	for (uint i = 0; i < SIZE(Ixs); ++i)
 		{
 		uint Ix2 = Ixs[i];
 		asserta(Ix2 < SIZE(m_IxToUniqueIx));
 		uint UniqueIx2 = m_IxToUniqueIx[Ix2];
 		asserta(UniqueIx2 == UniqueIx);
-
-		const vector<int> &PosVec2 = m_ColumnPositions[Ix2];
-		asserta(PosVec2 == PosVec);
+		asserta(m_ColHashes[Ix2] == m_ColHashes[Ix]);
+		asserta(ColPositionsEq(Ix2, Ix));
 		}
 	}
 
@@ -551,10 +645,8 @@ void Ensemble::ValidateUniqueColMap() const
 
 double Ensemble::GetGapFract(uint Ix) const
 	{
-	asserta(Ix < SIZE(m_ColumnStrings));
-	const string &ColStr = m_ColumnStrings[Ix];
+	const char *ColStr = GetColChars(Ix);
 	const uint SeqCount = GetSeqCount();
-	asserta(SIZE(ColStr) == SeqCount);
 	uint GapCount = 0;
 	for (uint i = 0; i < SeqCount; ++i)
 		{
@@ -593,9 +685,7 @@ void Ensemble::SubsampleWithReplacement(const vector<uint> &Ixs,
 		{
 		uint r = randu32()%N;
 		uint Ix = Ixs[r];
-		asserta(Ix < SIZE(m_ColumnStrings));
-		const string &ColStr = m_ColumnStrings[Ix];
-		asserta(SIZE(ColStr) == SeqCount);
+		const char *ColStr = GetColChars(Ix);
 		for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
 			M.m_szSeqs[SeqIndex][i] = ColStr[SeqIndex];
 		}
@@ -604,7 +694,7 @@ void Ensemble::SubsampleWithReplacement(const vector<uint> &Ixs,
 void Ensemble::GetIxSubset(double MaxGapFract, vector<uint> &Ixs) const
 	{
 	Ixs.clear();
-	const uint IxCount = SIZE(m_ColumnStrings);
+	const uint IxCount = GetIxCount();
 	for (uint Ix = 0; Ix < IxCount; ++Ix)
 		{
 		double GapFract = GetGapFract(Ix);
@@ -840,13 +930,9 @@ void Ensemble::GetRefUniqueIxs(const MSA &Ref,
 			int Pos = ColToPosVec[SeqIndex][RefColIndex];
 			PosVec[SeqIndex] = Pos;
 			}
-		map<vector<int>, uint >::const_iterator p =
-		  m_UniqueColMap.find(PosVec);
-		if (p != m_UniqueColMap.end())
-			{
-			uint UniqueIx = p->second;
+		uint UniqueIx = FindUniqueIx(PosVec.data());
+		if (UniqueIx != UINT_MAX)
 			UniqueIxs.insert(UniqueIx);
-			}
 		}
 	}
 
@@ -896,9 +982,7 @@ void Ensemble::GetTestUniqueIxs(uint MSAIndex,
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
 		uint Ix = m_MSAColToIx[MSAIndex][ColIndex];
-		asserta(Ix < SIZE(m_ColumnPositions));
-		const vector<int> &PosVec = m_ColumnPositions[Ix];
-		asserta(SIZE(PosVec) == SeqCount);
+		const int *PosVec = GetColPositions(Ix);
 		uint FoundCount = 0;
 		for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
 			{
@@ -10,8 +10,11 @@ public:
 	vector<string> m_Labels0;
 	map<string, uint> m_LabelToSeqIndex0;
 	vector<string> m_UngappedSeqs;
-	vector<string> m_ColumnStrings;
-	vector<vector<int> > m_ColumnPositions;
+
+// Column Ix of all MSAs, SeqCount entries per column at Ix*SeqCount
+	vector<char> m_ColChars;
+	vector<int> m_ColPositions;
+	vector<uint64> m_ColHashes;
 
 // 1-based positions, if <0 the column has a gap in this
 // sequence which opens at 1-based position (-Pos).
@@ -25,15 +28,18 @@ public:
 	vector<uint> m_UniqueIxs;
 	vector<vector<uint> > m_UniqueIxToIxs;
 	vector<uint> m_IxToUniqueIx;
-	map<vector<int>, uint> m_UniqueColMap;
+
+// (position hash, UniqueIx) sorted, for FindUniqueIx
+	vector<pair<uint64, uint> > m_UniqueHashes;
 
 public:
 	void Clear()
 		{
 		m_MSAs.clear();
 		m_MSANames.clear();
-		m_ColumnStrings.clear();
-		m_ColumnPositions.clear();
+		m_ColChars.clear();
+		m_ColPositions.clear();
+		m_ColHashes.clear();
 		m_Labels0.clear();
 		m_LabelToSeqIndex0.clear();
 		m_ColToPosVec.clear();
@@ -42,7 +48,7 @@ public:
 		m_UniqueIxToIxs.clear();
 		m_UniqueIxs.clear();
 		m_IxToUniqueIx.clear();
-		m_UniqueColMap.clear();
+		m_UniqueHashes.clear();
 		m_MSAColToIx.clear();
 		}
 
@@ -58,7 +64,11 @@ public:
 	uint GetSeqCount() const;
 	void SetColumns();
 	void GetColumn(uint MSAIndex, uint ColIndex,
-	  string &ColStr, vector<int> &ColPos) const;
+	  char *ColChars, int *ColPos) const;
+	const char *GetColChars(uint Ix) const;
+	const int *GetColPositions(uint Ix) const;
+	bool ColPositionsEq(uint Ix1, uint Ix2) const;
+	uint FindUniqueIx(const int *PosVec) const;
 	void GetIxSubset(double MaxGapFract, vector<uint> &Ixs) const;
 	double GetGapFract(uint Ix) const;
 	void SubsampleWithReplacement(double MaxGapFract,
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "queryprof.h"
+
+/***
+Vectorized forward/backward for the flat pair-HMM, one row (i)
+at a time. A row holds all states for j=0..LY as struct-of-arrays,
+state s at column j is Row[s*(LY+1) + j].
+
+FwdRow(i) needs row i-1, BwdRow(i) needs row i+1, so callers
+decide which rows to keep. Used by CalcFwdFlat_Vec/CalcBwdFlat_Vec
+(-vecfb) and by the linear-memory posterior (calcpostlinmem.cpp).
+***/
+class FBRows
+	{
+public:
+	const byte *m_X = 0;
+	const byte *m_Y = 0;
+	uint m_LX = 0;
+	uint m_LY = 0;
+
+// Emission rows, m_InsY and m_MatchRow point into m_Prof
+	QueryPair m_Prof;
+	const float *m_InsY = 0;
+	const float *m_MatchRow = 0;
+
+// Scratch, 5*(LY+1) floats
+	float *m_Buffer = 0;
+	float *m_NextM = 0;
+	float *m_NextIX = 0;
+	float *m_NextJX = 0;
+	float *m_NextIY = 0;
+	float *m_NextJY = 0;
+
+public:
+	~FBRows()
+		{
+		Free();
+		}
+
+	void Init(const byte *X, uint LX, const byte *Y, uint LY,
+	  const QueryProf *PX = 0, const QueryProf *PY = 0);
+	void Free();
+	uint GetRowSize() const { return HMMSTATE_COUNT*(m_LY + 1); }
+	void FwdRow0(float *Row);
+	void FwdRow(uint i, const float *PrevRow, float *Row);
+	void BwdRowLX(float *Row);
+	void BwdRow(uint i, const float *NextRow, float *Row);
+	void RowToFlat(const float *Row, uint i, float *Flat) const;
+	};
@@ -1,5 +1,6 @@
 #include "muscle.h"
 #include "mega.h"
+#include "queryprof.h"
 
 /***
 Fwd[s][i][j] = 
@@ -9,7 +10,8 @@ Fwd[s][i][j] =
 	ending in state s.
 ***/
 
-void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
+void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX, const QueryProf *PY)
 	{
 	asserta(!Mega::m_Loaded);
 
@@ -17,6 +19,10 @@ void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
 	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
 		Die("HMM overflow, sequence lengths %u, %u (max ~21k)", LX, LY);
 
+	QueryPair QP;
+	QP.Init(X, LX, Y, LY, PX, PY);
+	const float *InsY = QP.m_InsY;
+
 	char x0 = X[0];
 	char y0 = Y[0];
 	float Ins_x0 = InsScore[x0];
@@ -101,12 +107,12 @@ void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat)
 		{
 		char x = X[i-1];
 		float Emit_x = InsScore[x];
+		const float *MatchRow = QP.GetMatchRow(i-1);
 
 		for (uint j = 1; j <= LY; ++j)
 			{
-			char y = Y[j-1];
-			float Emit_y = InsScore[y];
-			float Emit_Pair = MatchScore[x][y];
+			float Emit_y = InsY[j-1];
+			float Emit_Pair = MatchRow[j-1];
 			if (i == 1 && j == 1)
 				Flat[Base_1_1 + HMMSTATE_M] = tSM + Emit_x0_y0;
 			else
@@ -12,8 +12,8 @@ Fwd[s][i][j] =
 ***/
 
 void Mega::CalcFwdFlat_mega(
-  const vector<vector<byte> > &ProfileX,
-  const vector<vector<byte> > &ProfileY, float *Flat)
+  const MegaProfile &ProfileX,
+  const MegaProfile &ProfileY, float *Flat)
 	{
 #include "hmmscores.h"
 	const uint LX = SIZE(ProfileX);
@@ -26,8 +26,14 @@ void Mega::CalcFwdFlat_mega(
 	//float Ins_x0 = InsScore[x0];
 	//float Ins_y0 = InsScore[y0];
 	//float Emit_x0_y0 = MatchScore[x0][y0];
-	float Ins_x0 = Mega::GetInsScore(ProfileX, 0);
-	float Ins_y0 = Mega::GetInsScore(ProfileY, 0);
+	const uint IdxX = Mega::GetProfileIdx(ProfileX);
+	const uint IdxY = Mega::GetProfileIdx(ProfileY);
+	const float *InsX = Mega::GetInsScores(IdxX);
+	const float *InsY = Mega::GetInsScores(IdxY);
+	vector<float> MatchRow(LY);
+
+	float Ins_x0 = InsX[0];
+	float Ins_y0 = InsY[0];
 	float Emit_x0_y0 = Mega::GetMatchScore(ProfileX, 0, ProfileY, 0);
 
 	const uint LY1 = LY+1;
@@ -77,7 +83,7 @@ void Mega::CalcFwdFlat_mega(
 		{
 		//char x = X[i];
 		//float Emit_x = InsScore[x];
-		float Emit_x = Mega::GetInsScore(ProfileX, i);
+		float Emit_x = InsX[i];
 
 		Flat[NextBase + HMMSTATE_IX] = Flat[Base + HMMSTATE_IX] + tII + Emit_x;
 		Flat[NextBase + HMMSTATE_JX] = Flat[Base + HMMSTATE_JX] + tJJ + Emit_x;
@@ -92,7 +98,7 @@ void Mega::CalcFwdFlat_mega(
 		{
 		//char y = Y[j];
 		//float Emit_y = InsScore[y];
-		float Emit_y = Mega::GetInsScore(ProfileY, j);
+		float Emit_y = InsY[j];
 
 		Flat[NextBase + HMMSTATE_IY] = Flat[Base + HMMSTATE_IY] + tII + Emit_y;
 		Flat[NextBase + HMMSTATE_JY] = Flat[Base + HMMSTATE_JY] + tJJ + Emit_y;
@@ -110,15 +116,16 @@ void Mega::CalcFwdFlat_mega(
 		{
 		//char x = X[i-1];
 		//float Emit_x = InsScore[x];
-		float Emit_x = Mega::GetInsScore(ProfileX, i-1);
+		float Emit_x = InsX[i-1];
+		Mega::GetMatchScoreRow(false, IdxX, i-1, IdxY, MatchRow.data());
 
 		for (uint j = 1; j <= LY; ++j)
 			{
 			//char y = Y[j-1];
 			//float Emit_y = InsScore[y];
 			//float Emit_Pair = MatchScore[x][y];
-			float Emit_y = Mega::GetInsScore(ProfileY, j-1);
-			float Emit_Pair = Mega::GetMatchScore(ProfileX, i-1, ProfileY, j-1);
+			float Emit_y = InsY[j-1];
+			float Emit_Pair = MatchRow[j-1];
 			if (i == 1 && j == 1)
 				Flat[Base_1_1 + HMMSTATE_M] = tSM + Emit_x0_y0;
 			else
@@ -0,0 +1,198 @@
+#include "muscle.h"
+#include "logaddvec.h"
+#include "fbrows.h"
+
+/***
+Vectorized CalcFwdFlat, enabled by -vecfb.
+
+Same recursion and Flat layout as CalcFwdFlat (fwdflat3.cpp).
+In row i, M, IX and JX depend only on row i-1, so they are
+computed for the whole row at once (SIMD over j). IY and JY
+chain along the row and are filled in by a scalar scan.
+***/
+
+VEC_DISPATCH
+static void FwdRow_M_X(uint LY, const float *VEC_RESTRICT PrevM,
+  const float *VEC_RESTRICT PrevIX, const float *VEC_RESTRICT PrevJX,
+  const float *VEC_RESTRICT PrevIY, const float *VEC_RESTRICT PrevJY,
+  const float *VEC_RESTRICT MatchRow, float Emit_x,
+  float *VEC_RESTRICT M, float *VEC_RESTRICT IX, float *VEC_RESTRICT JX)
+	{
+#include "hmmscores.h"
+	for (uint j = 1; j <= LY; ++j)
+		{
+		float M_M = PrevM[j-1] + tMM;
+		float IX_M = PrevIX[j-1] + tIM;
+		float JX_M = PrevJX[j-1] + tJM;
+		float IY_M = PrevIY[j-1] + tIM;
+		float JY_M = PrevJY[j-1] + tJM;
+		M[j] = LOG_ADD_VEC(M_M, IX_M, JX_M, IY_M, JY_M) + MatchRow[j-1];
+
+		float M_IX = PrevM[j] + tMI;
+		float IX_IX = PrevIX[j] + tII;
+		IX[j] = LOG_ADD_VEC(IX_IX, M_IX) + Emit_x;
+
+		float M_JX = PrevM[j] + tMJ;
+		float JX_JX = PrevJX[j] + tJJ;
+		JX[j] = LOG_ADD_VEC(JX_JX, M_JX) + Emit_x;
+		}
+	}
+
+void FBRows::Init(const byte *X, uint LX, const byte *Y, uint LY,
+  const QueryProf *PX, const QueryProf *PY)
+	{
+	Free();
+	m_X = X;
+	m_Y = Y;
+	m_LX = LX;
+	m_LY = LY;
+
+	const uint LY1 = LY + 1;
+	m_Buffer = myalloc(float, 5*LY1);
+	m_NextM = m_Buffer;
+	m_NextIX = m_Buffer + LY1;
+	m_NextJX = m_Buffer + 2*LY1;
+	m_NextIY = m_Buffer + 3*LY1;
+	m_NextJY = m_Buffer + 4*LY1;
+
+	m_Prof.Init(X, LX, Y, LY, PX, PY);
+	m_InsY = m_Prof.m_InsY;
+	m_MatchRow = 0;
+	}
+
+void FBRows::Free()
+	{
+	if (m_Buffer != 0)
+		myfree(m_Buffer);
+	m_Buffer = 0;
+	}
+
+void FBRows::RowToFlat(const float *Row, uint i, float *Flat) const
+	{
+	const uint LY1 = m_LY + 1;
+	const float *M = Row + HMMSTATE_M*LY1;
+	const float *IX = Row + HMMSTATE_IX*LY1;
+	const float *JX = Row + HMMSTATE_JX*LY1;
+	const float *IY = Row + HMMSTATE_IY*LY1;
+	const float *JY = Row + HMMSTATE_JY*LY1;
+	Flat += uint64(HMMSTATE_COUNT)*uint64(i)*LY1;
+	for (uint j = 0; j <= m_LY; ++j)
+		{
+		Flat[HMMSTATE_M] = M[j];
+		Flat[HMMSTATE_IX] = IX[j];
+		Flat[HMMSTATE_JX] = JX[j];
+		Flat[HMMSTATE_IY] = IY[j];
+		Flat[HMMSTATE_JY] = JY[j];
+		Flat += HMMSTATE_COUNT;
+		}
+	}
+
+void FBRows::FwdRow0(float *Row)
+	{
+#include "hmmscores.h"
+	const uint LY = m_LY;
+	const uint LY1 = LY + 1;
+	float *M = Row + HMMSTATE_M*LY1;
+	float *IX = Row + HMMSTATE_IX*LY1;
+	float *JX = Row + HMMSTATE_JX*LY1;
+	float *IY = Row + HMMSTATE_IY*LY1;
+	float *JY = Row + HMMSTATE_JY*LY1;
+	for (uint j = 0; j <= LY; ++j)
+		{
+		M[j] = LOG_ZERO;
+		IX[j] = LOG_ZERO;
+		JX[j] = LOG_ZERO;
+		}
+	IY[0] = LOG_ZERO;
+	JY[0] = LOG_ZERO;
+	IY[1] = tSI + m_InsY[0];
+	JY[1] = tSJ + m_InsY[0];
+	for (uint j = 2; j <= LY; ++j)
+		{
+		IY[j] = IY[j-1] + tII + m_InsY[j-1];
+		JY[j] = JY[j-1] + tJJ + m_InsY[j-1];
+		}
+	}
+
+void FBRows::FwdRow(uint i, const float *PrevRow, float *Row)
+	{
+#include "hmmscores.h"
+	assert(i > 0 && i <= m_LX);
+	const uint LY = m_LY;
+	const uint LY1 = LY + 1;
+
+	byte x = m_X[i-1];
+	float Emit_x = InsScore[x];
+	m_MatchRow = m_Prof.GetMatchRow(i-1);
+
+	const float *PrevM = PrevRow + HMMSTATE_M*LY1;
+	const float *PrevIX = PrevRow + HMMSTATE_IX*LY1;
+	const float *PrevJX = PrevRow + HMMSTATE_JX*LY1;
+	const float *PrevIY = PrevRow + HMMSTATE_IY*LY1;
+	const float *PrevJY = PrevRow + HMMSTATE_JY*LY1;
+
+	float *M = Row + HMMSTATE_M*LY1;
+	float *IX = Row + HMMSTATE_IX*LY1;
+	float *JX = Row + HMMSTATE_JX*LY1;
+	float *IY = Row + HMMSTATE_IY*LY1;
+	float *JY = Row + HMMSTATE_JY*LY1;
+
+	M[0] = LOG_ZERO;
+	IY[0] = LOG_ZERO;
+	JY[0] = LOG_ZERO;
+	if (i == 1)
+		{
+		IX[0] = tSI + Emit_x;
+		JX[0] = tSJ + Emit_x;
+		}
+	else
+		{
+		IX[0] = PrevIX[0] + tII + Emit_x;
+		JX[0] = PrevJX[0] + tJJ + Emit_x;
+		}
+
+	FwdRow_M_X(LY, PrevM, PrevIX, PrevJX, PrevIY, PrevJY,
+	  m_MatchRow, Emit_x, M, IX, JX);
+	if (i == 1)
+		M[1] = tSM + m_MatchRow[0];
+
+	for (uint j = 1; j <= LY; ++j)
+		{
+		float Emit_y = m_InsY[j-1];
+		float PrevM_i_j1 = M[j-1];
+
+		float M_IY = PrevM_i_j1 + tMI;
+		float IY_IY = IY[j-1] + tII;
+		IY[j] = LOG_ADD(IY_IY, M_IY) + Emit_y;
+
+		float M_JY = PrevM_i_j1 + tMJ;
+		float JY_JY = JY[j-1] + tJJ;
+		JY[j] = LOG_ADD(JY_JY, M_JY) + Emit_y;
+		}
+	}
+
+void CalcFwdFlat_Vec(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX, const QueryProf *PY)
+	{
+	asserta(!Mega::m_Loaded);
+	if (double(LX)*double(LY)*5 + 100 > double(INT_MAX))
+		Die("HMM overflow, sequence lengths %u, %u (max ~21k)", LX, LY);
+
+	FBRows FB;
+	FB.Init(X, LX, Y, LY, PX, PY);
+	const uint RowSize = FB.GetRowSize();
+	float *Prev = myalloc(float, RowSize);
+	float *Cur = myalloc(float, RowSize);
+
+	FB.FwdRow0(Prev);
+	FB.RowToFlat(Prev, 0, Flat);
+	for (uint i = 1; i <= LX; ++i)
+		{
+		FB.FwdRow(i, Prev, Cur);
+		FB.RowToFlat(Cur, i, Flat);
+		swap(Prev, Cur);
+		}
+
+	myfree(Prev);
+	myfree(Cur);
+	}
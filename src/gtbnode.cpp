@@ -72,17 +72,14 @@ void GTBNode::DoAll()
 	asserta(SeqCount > 0);
 	if (SeqCount < 3)
 		return;
-	vector<vector<float> > &DistMx = m_UPGMA.m_DistMx;
-	DistMx.resize(SeqCount);
+	TriDistMx &DistMx = m_UPGMA.m_DistMx;
+	DistMx.Alloc(SeqCount, FLT_MAX);
 	m_UPGMA.m_Labels.clear();
 	for (uint i = 0; i < SeqCount; ++i)
 		{
 		uint SeqIndex = m_SeqIndexes[i];
 		const char *Label = m_Builder->m_Seqs->GetLabel(SeqIndex);
 		m_UPGMA.m_Labels.push_back(Label);
-
-		DistMx[i].resize(SeqCount, FLT_MAX);
-		DistMx[i][i] = 0;
 		}
 
 	uint PairCount = (SeqCount*(SeqCount-1))/2;
@@ -99,8 +96,7 @@ void GTBNode::DoAll()
 		uint SeqIndexi = m_SeqIndexes[i];
 		uint SeqIndexj = m_SeqIndexes[j];
 		double d = GetProtDist(SeqIndexi, SeqIndexj);
-		DistMx[i][j] = float(d);
-		DistMx[j][i] = float(d);
+		DistMx.Set(i, j, float(d));
 
 		++j;
 		assert(j <= i);
@@ -139,14 +135,9 @@ void GTBNode::Run()
 		m_SeedSeqIndexes.push_back(*p);
 	asserta(SIZE(m_SeedSeqIndexes) == SeedCount);
 
-	vector<vector<float> > &DistMx = m_UPGMA.m_DistMx;
-	DistMx.resize(SeedCount);
+	TriDistMx &DistMx = m_UPGMA.m_DistMx;
+	DistMx.Alloc(SeedCount, FLT_MAX);
 	m_UPGMA.m_Labels.clear();
-	for (uint i = 0; i < SeedCount; ++i)
-		{
-		DistMx[i].resize(SeedCount, FLT_MAX);
-		DistMx[i][i] = 0;
-		}
 
 	uint PairCount = (SeedCount*(SeedCount-1))/2;
 	uint i = 1;
@@ -162,8 +153,7 @@ void GTBNode::Run()
 		uint SeqIndexi = m_SeedSeqIndexes[i];
 		uint SeqIndexj = m_SeedSeqIndexes[j];
 		double d = GetProtDist(SeqIndexi, SeqIndexj);
-		DistMx[i][j] = float(d);
-		DistMx[j][i] = float(d);
+		DistMx.Set(i, j, float(d));
 
 		++j;
 		assert(j <= i);
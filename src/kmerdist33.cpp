@@ -1,6 +1,7 @@
 #include "myutils.h"
 #include "muscle.h"
 #include "kmerdist33.h"
+#include "locallock.h"
 
 uint KmerDist33::SeqToKmer(const byte *Seq) const
 	{
@@ -37,58 +38,111 @@ uint KmerDist33::GetCommonKmerCount(const byte *KmerToCount1,
 	return Sum;
 	}
 
-void KmerDist33::GetDistMx(const MultiSequence &MS,
-  vector<vector<float> > &DistMx)
+// Sparse k-mer profile, (Kmer << 8) | Count sorted by Kmer, with
+// the same byte counts as CountKmers. KmerToCount must be zero on
+// entry and is zero on return.
+void KmerDist33::GetKmerProfile(const byte *Seq, uint L,
+  byte *KmerToCount, vector<uint> &Profile) const
 	{
-	vector<vector<float> > CommonKmerCountMx;
+	Profile.clear();
+	for (uint i = 0; i + 5 < L; ++i)
+		{
+		uint Kmer = SeqToKmer(Seq+i);
+		if (Kmer >= DICT_SIZE_33)
+			continue;
+		if (KmerToCount[Kmer] == 0)
+			Profile.push_back(Kmer << 8);
+		KmerToCount[Kmer] += 1;
+		}
+	sort(Profile.begin(), Profile.end());
+
+	uint n = 0;
+	for (uint k = 0; k < SIZE(Profile); ++k)
+		{
+		uint Kmer = (Profile[k] >> 8);
+		byte Count = KmerToCount[Kmer];
+		KmerToCount[Kmer] = 0;
+		if (Count > 0)
+			Profile[n++] = (Kmer << 8) | Count;
+		}
+	Profile.resize(n);
+	}
 
+/***
+Profiles are computed once per sequence. Rows i are split over
+threads, each thread expands the profile of i into a dense table
+and sums min counts over the sparse profile of each j < i.
+***/
+void KmerDist33::GetDistMx(const MultiSequence &MS, TriDistMx &DistMx)
+	{
 	const uint SeqCount = MS.GetSeqCount();
-	DistMx.resize(SeqCount);
-	CommonKmerCountMx.resize(SeqCount);
-	for (uint i = 0; i < SeqCount; ++i)
+	DistMx.Alloc(SeqCount, 0);
+
+// Muscle3 may itself run inside a parallel loop (cmd_batch)
+	const uint ThreadCount = (omp_in_parallel() ? 1 : GetRequestedThreadCount());
+	vector<byte *> ThreadKmerToCount(ThreadCount);
+	for (uint i = 0; i < ThreadCount; ++i)
+		{
+		ThreadKmerToCount[i] = myalloc(byte, DICT_SIZE_33);
+		memset(ThreadKmerToCount[i], 0, DICT_SIZE_33);
+		}
+
+	vector<vector<uint> > Profiles(SeqCount);
+	vector<float> SelfCounts(SeqCount);
+#pragma omp parallel for num_threads(ThreadCount)
+	for (int SeqIndex = 0; SeqIndex < (int) SeqCount; ++SeqIndex)
 		{
-		DistMx[i].resize(SeqCount);
-		CommonKmerCountMx[i].resize(SeqCount);
+		uint L;
+		const byte *Seq = MS.GetByteSeq(SeqIndex, L);
+		vector<uint> &Profile = Profiles[SeqIndex];
+		GetKmerProfile(Seq, L, ThreadKmerToCount[GetThreadIndex()], Profile);
+		uint Sum = 0;
+		for (uint k = 0; k < SIZE(Profile); ++k)
+			Sum += (Profile[k] & 0xff);
+		SelfCounts[SeqIndex] = (float) Sum;
 		}
 
-	byte *KmerToCounti = myalloc(byte, DICT_SIZE_33);
-	byte *KmerToCountj = myalloc(byte, DICT_SIZE_33);
-	uint PairCount = (SeqCount*(SeqCount - 1))/2;
-	uint PairIndex = 0;
-	for (uint SeqIndexi = 0; SeqIndexi < SeqCount; ++SeqIndexi)
+	uint RowCounter = 0;
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1)
+	for (int iSeqIndexi = 0; iSeqIndexi < (int) SeqCount; ++iSeqIndexi)
 		{
-		uint Li;
-		const byte *Seqi = MS.GetByteSeq(SeqIndexi, Li);
-		CountKmers(Seqi, Li, KmerToCounti);
-		float CommonCountii = (float) GetCommonKmerCount(KmerToCounti, KmerToCounti);
-		DistMx[SeqIndexi][SeqIndexi] = 0;
+		const uint SeqIndexi = uint(iSeqIndexi);
+		Lock();
+		ProgressStep(RowCounter++, SeqCount, "Kmer33 distance");
+		Unlock();
+
+		byte *KmerToCounti = ThreadKmerToCount[GetThreadIndex()];
+		const vector<uint> &Profilei = Profiles[SeqIndexi];
+		for (uint k = 0; k < SIZE(Profilei); ++k)
+			KmerToCounti[Profilei[k] >> 8] = byte(Profilei[k] & 0xff);
 
+		const float CommonCountii = SelfCounts[SeqIndexi];
+		float *DistRowi = DistMx.GetRow(SeqIndexi);
 		for (uint SeqIndexj = 0; SeqIndexj < SeqIndexi; ++SeqIndexj)
 			{
-			ProgressStep(PairIndex++, PairCount, "Kmer33 distance");
-			uint Lj;
-			const byte *Seqj = MS.GetByteSeq(SeqIndexj, Lj);
-			CountKmers(Seqj, Lj, KmerToCountj);
-			float CommonCountjj = (float) GetCommonKmerCount(KmerToCountj, KmerToCountj);
-			float CommonCountij = (float) GetCommonKmerCount(KmerToCounti, KmerToCountj);
+			const vector<uint> &Profilej = Profiles[SeqIndexj];
+			const uint n = SIZE(Profilej);
+			const uint *Pj = Profilej.data();
+			uint Common = 0;
+			for (uint k = 0; k < n; ++k)
+				{
+				uint nj = (Pj[k] & 0xff);
+				uint ni = KmerToCounti[Pj[k] >> 8];
+				Common += min(ni, nj);
+				}
 
+			const float CommonCountjj = SelfCounts[SeqIndexj];
+			const float CommonCountij = (float) Common;
 			const float d1 = 3.0f*(CommonCountii - CommonCountij)/CommonCountii;
 			const float d2 = 3.0f*(CommonCountjj - CommonCountij)/CommonCountjj;
 			const float dMin = min(d1, d2);
-			DistMx[SeqIndexi][SeqIndexj] = dMin;
-			DistMx[SeqIndexj][SeqIndexi] = dMin;
-#if 0
-			{
-			const char *Label1 = MS.GetLabel(SeqIndexi);
-			const char *Label2 = MS.GetLabel(SeqIndexj);
-			Log("%6.0f  %6.0f  %6.0f  %8.3g  %s, %s\n",
-			  CommonCountjj, CommonCountii, CommonCountjj,
-			  dMin, Label1, Label2);
-			}
-#endif
+			DistRowi[SeqIndexj] = dMin;
 			}
+
+		for (uint k = 0; k < SIZE(Profilei); ++k)
+			KmerToCounti[Profilei[k] >> 8] = 0;
 		}
 
-	myfree(KmerToCounti);
-	myfree(KmerToCountj);
+	for (uint i = 0; i < ThreadCount; ++i)
+		myfree(ThreadKmerToCount[i]);
 	}
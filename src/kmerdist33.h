@@ -1,6 +1,7 @@
 #pragma once
 
 #include "alpha.h"
+#include "tridistmx.h"
 
 class MultiSequence;
 
@@ -10,10 +11,11 @@ class KmerDist33
 	{
 public:
 	uint SeqToKmer(const byte *Seq) const;
-	void GetDistMx(const MultiSequence &MS,
-	  vector<vector<float> > &DistMx);
+	void GetDistMx(const MultiSequence &MS, TriDistMx &DistMx);
 	void CountKmers(const byte *Seq, uint L,
 	  byte *KmerToCount);
 	uint GetCommonKmerCount(const byte *KmerToCount1,
 	  const byte *KmerToCount2) const;
+	void GetKmerProfile(const byte *Seq, uint L, byte *KmerToCount,
+	  vector<uint> &Profile) const;
 	};
@@ -0,0 +1,122 @@
+#include "muscle.h"
+#include "kmerscan.h"
+
+/***
+Packed k-mer codes, 2 bits per letter for nucleotides and 5 bits
+per letter for amino acids, first letter in the high bits.
+Returns UINT32_MAX if the k-mer contains a wildcard.
+***/
+
+uint32 GetKmerMaskNt(uint k)
+	{
+	asserta(k > 0 && k <= 16);
+	if (k == 16)
+		return UINT32_MAX;
+	return (uint32(1) << (2*k)) - 1;
+	}
+
+uint32 GetKmerMaskAa(uint k)
+	{
+	asserta(k > 0 && k <= 6);
+	return (uint32(1) << (5*k)) - 1;
+	}
+
+uint32 SeqToCodeNt(const byte *Seq, uint k)
+	{
+	asserta(k > 0 && k <= 16);
+	uint32 Code = 0;
+	for (uint i = 0; i < k; ++i)
+		{
+		byte Letter = g_CharToLetterNucleo[Seq[i]];
+		if (Letter >= 4)
+			return UINT32_MAX;
+		Code = (Code << 2) | Letter;
+		}
+	return Code;
+	}
+
+uint32 SeqToCodeAa(const byte *Seq, uint k)
+	{
+	asserta(k > 0 && k <= 6);
+	uint32 Code = 0;
+	for (uint i = 0; i < k; ++i)
+		{
+		byte Letter = g_CharToLetterAmino[Seq[i]];
+		if (Letter >= 20)
+			return UINT32_MAX;
+		Code = (Code << 5) | Letter;
+		}
+	return Code;
+	}
+
+uint32 SeqToCode(bool Nucleo, const byte *Seq, uint k)
+	{
+	if (Nucleo)
+		return SeqToCodeNt(Seq, k);
+	return SeqToCodeAa(Seq, k);
+	}
+
+static inline uint32 SmerHash(uint32 Smer)
+	{
+	uint32 h = Smer*0x9e3779b1u;
+	h ^= (h >> 15);
+	h *= 0x85ebca6bu;
+	h ^= (h >> 13);
+	return h;
+	}
+
+/***
+Open syncmers. A k-mer is reported if the first of its d overlapping
+s-mers (s = k + 1 - d) has the smallest hash, ties to the first.
+Selection depends only on the k-mer, so the same k-mer is picked in
+every sequence, and about 1/d of k-mers are picked. d <= 1 reports
+every k-mer. Wildcard k-mers are skipped. The scan stops if OnKmer
+returns 0.
+***/
+static void SyncmerScan(bool Nucleo, const byte *Seq, uint Lo, uint Len,
+  uint k, uint d, fn_OnKmer OnKmer, void *UserData)
+	{
+	if (Len < k)
+		return;
+	if (d == 0)
+		d = 1;
+	asserta(d <= k);
+	const uint s = k + 1 - d;
+	const uint BitsPerLetter = (Nucleo ? 2 : 5);
+	const uint32 SmerMask = (Nucleo ? GetKmerMaskNt(s) : GetKmerMaskAa(s));
+	const uint Hi = Lo + Len - k;
+	for (uint Pos = Lo; Pos <= Hi; ++Pos)
+		{
+		uint32 Code = SeqToCode(Nucleo, Seq + Pos, k);
+		if (Code == UINT32_MAX)
+			continue;
+		bool Selected = true;
+		if (d > 1)
+			{
+			const uint32 FirstHash = SmerHash(Code >> (BitsPerLetter*(d - 1)));
+			for (uint j = 1; j < d; ++j)
+				{
+				uint32 Smer = (Code >> (BitsPerLetter*(d - 1 - j))) & SmerMask;
+				if (SmerHash(Smer) < FirstHash)
+					{
+					Selected = false;
+					break;
+					}
+				}
+			}
+		if (Selected && OnKmer(Code, Pos, UserData) == 0)
+			return;
+		}
+	}
+
+void SyncmerScanNt(const byte *Seq, uint Lo, uint Len, uint k, uint d,
+  fn_OnKmer OnKmer, void *UserData)
+	{
+	SyncmerScan(true, Seq, Lo, Len, k, d, OnKmer, UserData);
+	}
+
+void SyncmerScanAa(const byte *Seq, uint Lo, uint Len, uint k, uint d,
+  fn_OnKmer OnKmer, void *UserData)
+	{
+	SyncmerScan(false, Seq, Lo, Len, k, d, OnKmer, UserData);
+	}
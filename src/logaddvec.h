@@ -0,0 +1,58 @@
+#pragma once
+
+/***
+Branch-free log-sum-exp for the vectorized forward/backward kernels
+(fwdflatvec.cpp, bwdflatvec.cpp).
+
+LOG_ADD_VEC does the same arithmetic as LOG_ADD in scoretype.h, but
+the early exits and the piecewise polynomial of LOGEXP1 are written as
+selects so that loops over j can be auto-vectorized (if-converted to
+blends). Results match LOG_ADD up to floating-point contraction.
+
+VEC_DISPATCH compiles the row kernels for AVX2, SSE4.2 and baseline
+and picks one at load time (gcc function multi-versioning). On other
+compilers and targets it expands to nothing and the kernels are built
+for the baseline instruction set only (SSE2 on x86-64, NEON on arm64).
+***/
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define VEC_DISPATCH	__attribute__((target_clones("avx2", "sse4.2", "default")))
+#else
+#define VEC_DISPATCH
+#endif
+
+#if defined(__GNUC__)
+#define VEC_RESTRICT	__restrict__
+#elif defined(_MSC_VER)
+#define VEC_RESTRICT	__restrict
+#else
+#define VEC_RESTRICT
+#endif
+
+// Same as LOGEXP1() but x is not required to be <= 7.5,
+// callers discard the value in that case.
+inline float LOGEXP1_VEC(float x)
+	{
+	bool r1 = (x <= 1.00f);
+	bool r2 = (x <= 2.50f);
+	bool r3 = (x <= 4.50f);
+	float a = r1 ? -0.009350833524763f : r2 ? -0.014532321752540f : r3 ? -0.004605031767994f : -0.000458661602210f;
+	float b = r1 ?  0.130659527668286f : r2 ?  0.139942324101744f : r3 ?  0.063427417320019f :  0.009695946122598f;
+	float c = r1 ?  0.498799810682272f : r2 ?  0.495635523139337f : r3 ?  0.695956496475118f :  0.930734667215156f;
+	float d = r1 ?  0.693203116424741f : r2 ?  0.692140569840976f : r3 ?  0.514272634594009f :  0.168037164329057f;
+	return ((a*x + b)*x + c)*x + d;
+	}
+
+inline float LOG_ADD_VEC(float x, float y)
+	{
+	float Hi = (x < y ? y : x);
+	float Lo = (x < y ? x : y);
+	float Diff = Hi - Lo;
+	float Sum = LOGEXP1_VEC(Diff) + Lo;
+	return (Lo == LOG_ZERO || Diff >= LOG_UNDERFLOW_THRESHOLD) ? Hi : Sum;
+	}
+
+inline float LOG_ADD_VEC(float x1, float x2, float x3, float x4, float x5)
+	{
+	return LOG_ADD_VEC(x1, LOG_ADD_VEC(x2, LOG_ADD_VEC(x3, LOG_ADD_VEC(x4, x5))));
+	}
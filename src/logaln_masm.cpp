@@ -1,7 +1,7 @@
 #include "muscle.h"
 #include "masm.h"
 
-void GetMegaProfileAASeq(const vector<vector<byte> > &Profile, string &Seq)
+void GetMegaProfileAASeq(const MegaProfile &Profile, string &Seq)
 	{
 	Seq.clear();
 	uint PI = UINT_MAX;
@@ -16,11 +16,11 @@ void GetMegaProfileAASeq(const vector<vector<byte> > &Profile, string &Seq)
 	asserta(PI != UINT_MAX);
 	const uint L = SIZE(Profile);
 	for (uint i = 0; i < L; ++i)
-		Seq += g_LetterToCharAmino[Profile[i][PI]];
+		Seq += g_LetterToCharAmino[Profile.Get(i, PI)];
 	}
 
 void WriteLocalAln_MASM(FILE *f, const string &LabelA, const MASM &MA,
-  const string &LabelB, const vector<vector<byte> > &PB,
+  const string &LabelB, const MegaProfile &PB,
   uint Loi, uint Loj, const char *Path)
 	{
 	if (f == 0)
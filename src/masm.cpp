@@ -2,7 +2,8 @@
 #include "masm.h"
 #include "mega.h"
 
-static float ScorePP(const MASMCol &PPA, const vector<byte> &ProfColB)
+static float ScorePP(const MASMCol &PPA, const MegaProfile &ProfB,
+  uint PosB)
 	{
 	const uint FeatureCount = Mega::GetFeatureCount();
 
@@ -10,7 +11,7 @@ static float ScorePP(const MASMCol &PPA, const vector<byte> &ProfColB)
 	for (uint FeatureIdx = 0; FeatureIdx < FeatureCount; ++FeatureIdx)
 		{
 		const vector<float> &ScoresA = PPA.m_ScoresVec[FeatureIdx];
-		byte LetterB = ProfColB[FeatureIdx];
+		byte LetterB = ProfB.Get(PosB, FeatureIdx);
 		if (LetterB != UINT8_MAX)
 			TotalScore += ScoresA[LetterB];
 		}
@@ -18,7 +19,7 @@ static float ScorePP(const MASMCol &PPA, const vector<byte> &ProfColB)
 	return TotalScore;
 	}
 
-void MASM::MakeSMx(const vector<vector<byte> > &ProfB, Mx<float> &SMx) const
+void MASM::MakeSMx(const MegaProfile &ProfB, Mx<float> &SMx) const
 	{
 	const uint LA = m_ColCount;
 	const uint LB = SIZE(ProfB);
@@ -28,8 +29,7 @@ void MASM::MakeSMx(const vector<vector<byte> > &ProfB, Mx<float> &SMx) const
 		const MASMCol &ColA = GetCol(PosA);
 		for (uint PosB = 0; PosB < LB; ++PosB)
 			{
-			const vector<byte> &ColB = ProfB[PosB];
-			float Score = ScorePP(ColA, ColB);
+			float Score = ScorePP(ColA, ProfB, PosB);
 			SMx.Put(PosA, PosB, Score);
 			}
 		}
@@ -222,9 +222,9 @@ void MASM::SetFeatureAln(uint FeatureIdx)
 	for (uint SeqIdx = 0; SeqIdx < m_SeqCount; ++SeqIdx)
 		{
 		const string &UngappedSeq = m_UngappedSeqs[SeqIdx];
-		const vector<vector<byte> > *ptrMegaProfile = 
+		const MegaProfile *ptrMegaProfile =
 		  Mega::GetProfileBySeq(UngappedSeq, true);
-		const vector<vector<byte> > &MegaProfile = *ptrMegaProfile;
+		const MegaProfile &Profile = *ptrMegaProfile;
 		vector<byte> &Row = FeatureAln[SeqIdx];
 		const Sequence &seq = *m_Aln->GetSequence(SeqIdx);
 		asserta(seq.GetLength() == m_ColCount);
@@ -237,7 +237,7 @@ void MASM::SetFeatureAln(uint FeatureIdx)
 				Row.push_back(UINT8_MAX);
 			else
 				{
-				byte Letter = MegaProfile[Pos][FeatureIdx];
+				byte Letter = Profile.Get(Pos, FeatureIdx);
 				Row.push_back(Letter);
 				++Pos;
 				}
@@ -272,12 +272,23 @@ void MASM::FromFile(const string &FileName)
 	if (FileName == "")
 		Die("Missing MASM input file");
 
-	Clear();
 	FILE *f = OpenStdioFile(FileName);
+	bool Ok = FromFile(f);
+	if (!Ok)
+		Die("Empty MASM file %s", FileName.c_str());
+	CloseStdioFile(f);
+	}
+
+// Next MASM in f, false at end of file. A file may hold
+// several MASMs written one after another by ToFile(FILE *).
+bool MASM::FromFile(FILE *f)
+	{
+	Clear();
 	string Line;
 	vector<string> Fields;
 	bool Ok = ReadLineStdioFile(f, Line);
-	asserta(Ok);
+	if (!Ok)
+		return false;
 	Split(Line, Fields, '\t');
 	asserta(SIZE(Fields) == 7);
 	asserta(Fields[0] == "MASM");
@@ -313,7 +324,7 @@ void MASM::FromFile(const string &FileName)
 		MC->FromFile(f);
 		m_Cols.push_back(MC);
 		}
-	CloseStdioFile(f);
+	return true;
 	}
 
 void MASM::GetConsensusSeq(string &Seq) const
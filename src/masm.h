@@ -52,7 +52,7 @@ public:
 	void SetUngappedSeqs();
 	void SetFeatureAlnVec();
 	void SetFeatureAln(uint FeatureIdx);
-	void MakeSMx(const vector<vector<byte> > &ProfB, Mx<float> &SMx) const;
+	void MakeSMx(const MegaProfile &ProfB, Mx<float> &SMx) const;
 	void GetCounts(uint ColIndex, uint &LetterCount,
 	  uint &GapOpenCount, uint &GapExtCount, uint &GapCloseCount);
 	void GetFreqsVec(uint ColIndex, vector<vector<float> > &FreqsVec);
@@ -61,6 +61,7 @@ public:
 	void ToFile(FILE *f) const;
 	void LogMe() const;
 	void FromFile(const string &FileName);
+	bool FromFile(FILE *f);
 	void MakeSMx_Sequence(const Sequence &Q, Mx<float> &SMx) const;
 	void GetConsensusSeq(string &Seq) const;
 	};
@@ -40,18 +40,18 @@ void MASMCol::SetScoreVec()
 		uint AlphaSize = Mega::GetAlphaSize(FeatureIdx);
 
 	// Weights are already applied to ScoreMx
-		const vector<vector<float> > &ScoreMx = Mega::m_LogOddsMxVec[FeatureIdx];
-		asserta(SIZE(ScoreMx) == AlphaSize);
+		const float *ScoreMx = Mega::GetLogOddsMx(FeatureIdx);
 		const vector<float> &Freqs = m_FreqsVec[FeatureIdx];
 		asserta(SIZE(Freqs) == AlphaSize);
 		vector<float> &Scores = m_ScoresVec[FeatureIdx];
 		for (byte Letter = 0; Letter < AlphaSize; ++Letter)
 			{
+			const float *ScoreRow = ScoreMx + Letter*AlphaSize;
 			float Total = 0;
 			for (byte Letter2 = 0; Letter2 < AlphaSize; ++Letter2)
 				{
 				float Freq2 = Freqs[Letter2];
-				Total += Freq2*ScoreMx[Letter][Letter2];
+				Total += Freq2*ScoreRow[Letter2];
 				}
 
 		// Weights are already applied to ScoreMx
@@ -172,15 +172,16 @@ void MASMCol::FromFile(FILE *f)
 		}
 	}
 
-float MASMCol::GetMatchScore_MegaProfilePos(const vector<byte> &ProfPos) const
+float MASMCol::GetMatchScore_MegaProfilePos(const MegaProfile &Prof,
+  uint Pos) const
 	{
 	float Total = 0;
-	const uint FeatureCount = SIZE(ProfPos);
+	const uint FeatureCount = Prof.m_FeatureCount;
 	assert(FeatureCount == m_MASM->m_FeatureCount);
 	assert(SIZE(m_ScoresVec) == FeatureCount);
 	for (uint FeatureIdx = 0; FeatureIdx < FeatureCount; ++FeatureIdx)
 		{
-		byte Letter = ProfPos[FeatureIdx];
+		byte Letter = Prof.Get(Pos, FeatureIdx);
 		Total += m_ScoresVec[FeatureIdx][Letter];
 		}
 	return Total;
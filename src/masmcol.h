@@ -1,6 +1,7 @@
 #pragma once
 
 class MASM;
+class MegaProfile;
 
 class MASMCol
 	{
@@ -30,6 +31,7 @@ public:
 	void FromFile(FILE *f);
 	const vector<float> &GetAAScores() const;
 	char GetConsensusAAChar() const;
-	float GetMatchScore_MegaProfilePos(const vector<byte> &ProfPos) const;
+	float GetMatchScore_MegaProfilePos(const MegaProfile &Prof,
+	  uint Pos) const;
 	void LogMe() const;
 	};
@@ -0,0 +1,459 @@
+#include "muscle.h"
+#include "mbedtree.h"
+#include "kmerdist66.h"
+#include "upgma5.h"
+#include "locallock.h"
+
+// Amino acids in the 6 MAFFT groups used by KmerDist66, k=6.
+// Nucleotides ACGT, k=8. Both give < 2^16 k-mers.
+static uint GetLetter(byte c, bool Nucleo)
+	{
+	if (Nucleo)
+		{
+		uint Letter = g_CharToLetterNucleo[c];
+		return Letter < 4 ? Letter : 0;
+		}
+	uint Group = KmerDist66::m_CharToGroup[c];
+	return Group < 6 ? Group : 0;
+	}
+
+void MBedTree::InitProfiles()
+	{
+	const bool Nucleo = m_Seqs->GuessIsNucleo();
+	const uint AlphaSize = (Nucleo ? 4 : 6);
+	m_K = (Nucleo ? 8 : 6);
+	m_DictSize = 1;
+	for (uint i = 0; i < m_K; ++i)
+		m_DictSize *= AlphaSize;
+
+	m_Profiles.clear();
+	m_Profiles.resize(m_SeqCount);
+	m_SelfCounts.clear();
+	m_SelfCounts.resize(m_SeqCount, 0);
+
+	const uint ThreadCount = GetRequestedThreadCount();
+	vector<uint16 *> ThreadCounts(ThreadCount);
+	for (uint i = 0; i < ThreadCount; ++i)
+		{
+		ThreadCounts[i] = myalloc(uint16, m_DictSize);
+		memset(ThreadCounts[i], 0, m_DictSize*sizeof(uint16));
+		}
+
+#pragma omp parallel for num_threads(ThreadCount)
+	for (int SeqIndex = 0; SeqIndex < (int) m_SeqCount; ++SeqIndex)
+		{
+		uint16 *KmerToCount = ThreadCounts[GetThreadIndex()];
+		uint L;
+		const byte *Seq = m_Seqs->GetByteSeq(SeqIndex, L);
+		vector<uint> &Profile = m_Profiles[SeqIndex];
+		for (uint i = 0; i + m_K <= L; ++i)
+			{
+			uint Kmer = 0;
+			for (uint k = 0; k < m_K; ++k)
+				Kmer = Kmer*AlphaSize + GetLetter(Seq[i+k], Nucleo);
+			if (KmerToCount[Kmer] == 0)
+				Profile.push_back(Kmer << 8);
+			if (KmerToCount[Kmer] < 255)
+				KmerToCount[Kmer] += 1;
+			}
+		sort(Profile.begin(), Profile.end());
+
+		uint Sum = 0;
+		for (uint k = 0; k < SIZE(Profile); ++k)
+			{
+			uint Kmer = (Profile[k] >> 8);
+			uint Count = KmerToCount[Kmer];
+			KmerToCount[Kmer] = 0;
+			Profile[k] |= Count;
+			Sum += Count;
+			}
+		m_SelfCounts[SeqIndex] = Sum;
+		}
+
+	for (uint i = 0; i < ThreadCount; ++i)
+		myfree(ThreadCounts[i]);
+	}
+
+// 1 - (shared k-mers)/(k-mers in shorter sequence)
+float MBedTree::GetKmerDist(uint SeqIndex1, uint SeqIndex2) const
+	{
+	const vector<uint> &P1 = m_Profiles[SeqIndex1];
+	const vector<uint> &P2 = m_Profiles[SeqIndex2];
+	const uint n1 = SIZE(P1);
+	const uint n2 = SIZE(P2);
+	uint Common = 0;
+	uint k1 = 0;
+	uint k2 = 0;
+	while (k1 < n1 && k2 < n2)
+		{
+		uint Kmer1 = (P1[k1] >> 8);
+		uint Kmer2 = (P2[k2] >> 8);
+		if (Kmer1 < Kmer2)
+			++k1;
+		else if (Kmer2 < Kmer1)
+			++k2;
+		else
+			{
+			Common += min(P1[k1] & 0xff, P2[k2] & 0xff);
+			++k1;
+			++k2;
+			}
+		}
+	uint MinSelf = min(m_SelfCounts[SeqIndex1], m_SelfCounts[SeqIndex2]);
+	if (MinSelf == 0)
+		return 1;
+	return 1 - float(Common)/MinSelf;
+	}
+
+// S = ceil(log2(N))^2 seeds evenly spaced in length order
+void MBedTree::InitSeeds()
+	{
+	uint Log2N = 1;
+	while ((1u << Log2N) < m_SeqCount && Log2N < 31)
+		++Log2N;
+	m_SeedCount = min(m_SeqCount, Log2N*Log2N);
+
+	vector<uint> Order(m_SeqCount);
+	vector<uint> Lengths(m_SeqCount);
+	for (uint i = 0; i < m_SeqCount; ++i)
+		{
+		Order[i] = i;
+		Lengths[i] = m_Seqs->GetSeqLength(i);
+		}
+	stable_sort(Order.begin(), Order.end(),
+	  [&Lengths](uint i, uint j) { return Lengths[i] < Lengths[j]; });
+
+	m_SeedSeqIndexes.clear();
+	for (uint s = 0; s < m_SeedCount; ++s)
+		{
+		uint64 k = ((2*uint64(s) + 1)*m_SeqCount)/(2*m_SeedCount);
+		m_SeedSeqIndexes.push_back(Order[k]);
+		}
+	}
+
+void MBedTree::InitVecs()
+	{
+	myfree(m_Vecs);
+	m_Vecs = myalloc(float, uint64(m_SeqCount)*m_SeedCount);
+
+	const uint ThreadCount = GetRequestedThreadCount();
+	uint Counter = 0;
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 64)
+	for (int SeqIndex = 0; SeqIndex < (int) m_SeqCount; ++SeqIndex)
+		{
+		Lock();
+		ProgressStep(Counter++, m_SeqCount, "mBed %u seeds", m_SeedCount);
+		Unlock();
+
+		float *Vec = m_Vecs + uint64(SeqIndex)*m_SeedCount;
+		for (uint s = 0; s < m_SeedCount; ++s)
+			Vec[s] = GetKmerDist(SeqIndex, m_SeedSeqIndexes[s]);
+		}
+	}
+
+float MBedTree::GetVecDist2(const float *v1, const float *v2) const
+	{
+	float Sum = 0;
+	for (uint s = 0; s < m_SeedCount; ++s)
+		{
+		float d = v1[s] - v2[s];
+		Sum += d*d;
+		}
+	return Sum;
+	}
+
+/***
+2-means on the embedding. Initial centers are the member farthest
+from the mean and the member farthest from that one. Returns the
+distance between the final centers in k-mer distance units (RMS
+over seeds). Members that cannot be separated (identical vectors)
+are split in half.
+***/
+float MBedTree::Split(const vector<uint> &Members, vector<uint> &Members1,
+  vector<uint> &Members2) const
+	{
+	const uint n = SIZE(Members);
+	const uint S = m_SeedCount;
+	asserta(n >= 2);
+	Members1.clear();
+	Members2.clear();
+
+	vector<float> Center1(S, 0);
+	vector<float> Center2(S, 0);
+	for (uint k = 0; k < n; ++k)
+		{
+		const float *v = m_Vecs + uint64(Members[k])*S;
+		for (uint s = 0; s < S; ++s)
+			Center1[s] += v[s];
+		}
+	for (uint s = 0; s < S; ++s)
+		Center1[s] /= n;
+
+	uint Far1 = 0;
+	float MaxDist2 = -1;
+	for (uint k = 0; k < n; ++k)
+		{
+		float d2 = GetVecDist2(m_Vecs + uint64(Members[k])*S, Center1.data());
+		if (d2 > MaxDist2)
+			{
+			MaxDist2 = d2;
+			Far1 = k;
+			}
+		}
+	const float *v1 = m_Vecs + uint64(Members[Far1])*S;
+	uint Far2 = Far1;
+	MaxDist2 = 0;
+	for (uint k = 0; k < n; ++k)
+		{
+		float d2 = GetVecDist2(m_Vecs + uint64(Members[k])*S, v1);
+		if (d2 > MaxDist2)
+			{
+			MaxDist2 = d2;
+			Far2 = k;
+			}
+		}
+
+	vector<byte> Assign(n, 0);
+	bool Separated = (Far2 != Far1);
+	if (Separated)
+		{
+		const float *v2 = m_Vecs + uint64(Members[Far2])*S;
+		Center1.assign(v1, v1 + S);
+		Center2.assign(v2, v2 + S);
+		const uint ThreadCount =
+		  (omp_in_parallel() || n < 1024 ? 1 : GetRequestedThreadCount());
+		for (uint Iter = 0; Iter < MBED_KMEANS_ITERS; ++Iter)
+			{
+			vector<byte> NewAssign(n);
+#pragma omp parallel for num_threads(ThreadCount)
+			for (int k = 0; k < (int) n; ++k)
+				{
+				const float *v = m_Vecs + uint64(Members[k])*S;
+				float d1 = GetVecDist2(v, Center1.data());
+				float d2 = GetVecDist2(v, Center2.data());
+				NewAssign[k] = (d2 < d1 ? 1 : 0);
+				}
+
+			uint n2 = 0;
+			for (uint k = 0; k < n; ++k)
+				n2 += NewAssign[k];
+			if (n2 == 0 || n2 == n)
+				break;
+			bool Changed = (Iter == 0 || NewAssign != Assign);
+			Assign.swap(NewAssign);
+			if (!Changed)
+				break;
+
+			Center1.assign(S, 0);
+			Center2.assign(S, 0);
+			for (uint k = 0; k < n; ++k)
+				{
+				const float *v = m_Vecs + uint64(Members[k])*S;
+				float *c = (Assign[k] ? Center2.data() : Center1.data());
+				for (uint s = 0; s < S; ++s)
+					c[s] += v[s];
+				}
+			for (uint s = 0; s < S; ++s)
+				{
+				Center1[s] /= (n - n2);
+				Center2[s] /= n2;
+				}
+			}
+
+		uint n2 = 0;
+		for (uint k = 0; k < n; ++k)
+			n2 += Assign[k];
+		Separated = (n2 > 0 && n2 < n);
+		}
+
+	if (!Separated)
+		{
+		for (uint k = 0; k < n; ++k)
+			(k < n/2 ? Members1 : Members2).push_back(Members[k]);
+		return 0;
+		}
+
+	for (uint k = 0; k < n; ++k)
+		(Assign[k] ? Members2 : Members1).push_back(Members[k]);
+	return sqrtf(GetVecDist2(Center1.data(), Center2.data())/S);
+	}
+
+uint MBedTree::AddJoin(uint Left, uint Right, float Height)
+	{
+	const float HeightLeft = m_Heights[Left];
+	const float HeightRight = m_Heights[Right];
+	Height = max(Height, max(HeightLeft, HeightRight));
+	const uint Node = m_SeqCount + SIZE(m_Left);
+	m_Left.push_back(Left);
+	m_Right.push_back(Right);
+	m_LeftLength.push_back(Height - HeightLeft);
+	m_RightLength.push_back(Height - HeightRight);
+	m_Heights[Node] = Height;
+	return Node;
+	}
+
+// UPGMA on k-mer distances within one cluster
+uint MBedTree::JoinCluster(const vector<uint> &Members)
+	{
+	const uint n = SIZE(Members);
+	asserta(n > 0);
+	if (n == 1)
+		return Members[0];
+	if (n == 2)
+		return AddJoin(Members[0], Members[1],
+		  GetKmerDist(Members[0], Members[1])/2);
+
+	TriDistMx DistMx;
+	DistMx.Alloc(n, 0);
+	const uint ThreadCount = GetRequestedThreadCount();
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 8)
+	for (int i = 1; i < (int) n; ++i)
+		{
+		float *Row = DistMx.GetRow(i);
+		for (uint j = 0; j < uint(i); ++j)
+			Row[j] = GetKmerDist(Members[i], Members[j]);
+		}
+
+	vector<string> Labels;
+	for (uint i = 0; i < n; ++i)
+		{
+		string Label;
+		Ps(Label, "%u", i);
+		Labels.push_back(Label);
+		}
+
+	UPGMA5 U;
+	U.InitSwap(Labels, DistMx);
+	Tree T;
+	U.Run(LINKAGE_Avg, T);
+
+	const uint TreeNodeCount = T.GetNodeCount();
+	vector<uint> TreeNodeToNode(TreeNodeCount, UINT_MAX);
+	uint TreeNode = T.FirstDepthFirstNode();
+	do
+		{
+		if (T.IsLeaf(TreeNode))
+			{
+			uint i = T.GetLeafId(TreeNode);
+			asserta(i < n);
+			TreeNodeToNode[TreeNode] = Members[i];
+			}
+		else
+			{
+			uint TreeLeft = T.GetLeft(TreeNode);
+			uint TreeRight = T.GetRight(TreeNode);
+			uint Left = TreeNodeToNode[TreeLeft];
+			uint Right = TreeNodeToNode[TreeRight];
+			asserta(Left != UINT_MAX && Right != UINT_MAX);
+			float Height = m_Heights[Left] +
+			  (float) T.GetEdgeLength(TreeNode, TreeLeft);
+			TreeNodeToNode[TreeNode] = AddJoin(Left, Right, Height);
+			}
+		TreeNode = T.NextDepthFirstNode(TreeNode);
+		}
+	while (TreeNode != UINT_MAX);
+	return TreeNodeToNode[T.GetRootNodeIndex()];
+	}
+
+void MBedTree::Run(const MultiSequence &Seqs, const vector<string> &Labels,
+  Tree &T)
+	{
+	m_Seqs = &Seqs;
+	m_SeqCount = Seqs.GetSeqCount();
+	asserta(SIZE(Labels) == m_SeqCount);
+	if (m_SeqCount < 2)
+		Die("mBed guide tree needs at least two sequences");
+	if (optset_mbed_clustersize)
+		m_MaxClusterSize = opt(mbed_clustersize);
+	if (m_MaxClusterSize < 2)
+		m_MaxClusterSize = 2;
+
+	InitProfiles();
+	InitSeeds();
+	InitVecs();
+
+// Bisect top-down. Children always follow their parent in
+// Splits, so a reverse scan joins bottom-up.
+	struct MBedSplit
+		{
+		vector<uint> Members;
+		uint Child1 = UINT_MAX;
+		uint Child2 = UINT_MAX;
+		float Dist = 0;
+		};
+	vector<MBedSplit> Splits(1);
+	Splits[0].Members.resize(m_SeqCount);
+	for (uint i = 0; i < m_SeqCount; ++i)
+		Splits[0].Members[i] = i;
+
+	uint ClusterCount = 0;
+	for (uint k = 0; k < SIZE(Splits); ++k)
+		{
+		if (SIZE(Splits[k].Members) <= m_MaxClusterSize)
+			{
+			++ClusterCount;
+			continue;
+			}
+		vector<uint> Members1;
+		vector<uint> Members2;
+		float Dist = Split(Splits[k].Members, Members1, Members2);
+		vector<uint>().swap(Splits[k].Members);
+
+		Splits[k].Dist = Dist;
+		Splits[k].Child1 = SIZE(Splits);
+		Splits[k].Child2 = SIZE(Splits) + 1;
+		Splits.resize(SIZE(Splits) + 2);
+		Splits[Splits[k].Child1].Members.swap(Members1);
+		Splits[Splits[k].Child2].Members.swap(Members2);
+		}
+	ProgressLog("mBed %u seqs, %u seeds, %u clusters\n",
+	  m_SeqCount, m_SeedCount, ClusterCount);
+
+	m_Left.clear();
+	m_Right.clear();
+	m_LeftLength.clear();
+	m_RightLength.clear();
+	m_Heights.clear();
+	m_Heights.resize(2*m_SeqCount - 1, 0);
+
+	const uint SplitCount = SIZE(Splits);
+	vector<uint> SplitToNode(SplitCount, UINT_MAX);
+	for (uint k = SplitCount; k > 0; --k)
+		{
+		MBedSplit &Sp = Splits[k-1];
+		if (Sp.Child1 == UINT_MAX)
+			SplitToNode[k-1] = JoinCluster(Sp.Members);
+		else
+			{
+			uint Left = SplitToNode[Sp.Child1];
+			uint Right = SplitToNode[Sp.Child2];
+			asserta(Left != UINT_MAX && Right != UINT_MAX);
+			SplitToNode[k-1] = AddJoin(Left, Right, Sp.Dist/2);
+			}
+		}
+	asserta(SIZE(m_Left) == m_SeqCount - 1);
+	asserta(SplitToNode[0] == 2*m_SeqCount - 2);
+
+	vector<uint> Ids(m_SeqCount);
+	vector<char *> Names(m_SeqCount);
+	for (uint i = 0; i < m_SeqCount; ++i)
+		{
+		Ids[i] = i;
+		Names[i] = mystrsave(Labels[i].c_str());
+		}
+	T.Create(m_SeqCount, m_SeqCount - 2, m_Left.data(), m_Right.data(),
+	  m_LeftLength.data(), m_RightLength.data(), Ids.data(), Names.data());
+	for (uint i = 0; i < m_SeqCount; ++i)
+		myfree(Names[i]);
+	}
+
+void MakeGuideTree_MBed(const MultiSequence &Seqs, Tree &GuideTree);
+
+void cmd_mbed_tree()
+	{
+	MultiSequence Input;
+	Input.FromFASTA(opt(mbed_tree), true);
+	Tree T;
+	MakeGuideTree_MBed(Input, T);
+	T.ToFile(opt(output));
+	}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "tree.h"
+
+static const uint DEFAULT_MBED_CLUSTER_SIZE = 256;
+static const uint MBED_KMEANS_ITERS = 10;
+
+/***
+Guide tree for large inputs without an N x N distance matrix,
+after mBed (Blackshields et al. 2010). Each sequence is embedded
+as its vector of k-mer distances to S seeds (S ~ log2(N)^2, evenly
+spaced by length). The embedding is bisected by 2-means until each
+cluster has at most m_MaxClusterSize sequences, each cluster is
+joined by UPGMA5 on k-mer distances, and the bisections are the
+top of the tree. Memory O(N S) plus one cluster matrix, time
+O(N S log N).
+***/
+class MBedTree
+	{
+public:
+	const MultiSequence *m_Seqs = 0;
+	uint m_SeqCount = 0;
+	uint m_SeedCount = 0;
+	uint m_MaxClusterSize = DEFAULT_MBED_CLUSTER_SIZE;
+	uint m_K = 0;
+	uint m_DictSize = 0;
+
+// Sparse k-mer profiles, (Kmer << 8) | Count sorted by Kmer
+	vector<vector<uint> > m_Profiles;
+	vector<uint> m_SelfCounts;
+	vector<uint> m_SeedSeqIndexes;
+
+// m_SeqCount rows of m_SeedCount distances
+	float *m_Vecs = 0;
+
+// Internal nodes in Tree::Create order, leaf nodes are
+// sequence indexes. m_Heights is indexed by node.
+	vector<uint> m_Left;
+	vector<uint> m_Right;
+	vector<float> m_LeftLength;
+	vector<float> m_RightLength;
+	vector<float> m_Heights;
+
+public:
+	~MBedTree() { myfree(m_Vecs); }
+
+	void Run(const MultiSequence &Seqs, const vector<string> &Labels,
+	  Tree &T);
+	void InitProfiles();
+	void InitSeeds();
+	void InitVecs();
+	float GetKmerDist(uint SeqIndex1, uint SeqIndex2) const;
+	float GetVecDist2(const float *v1, const float *v2) const;
+	float Split(const vector<uint> &Members, vector<uint> &Members1,
+	  vector<uint> &Members2) const;
+	uint JoinCluster(const vector<uint> &Members);
+	uint AddJoin(uint Left, uint Right, float Height);
+	};
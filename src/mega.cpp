@@ -13,12 +13,21 @@ vector<string> Mega::m_FeatureNames;
 vector<float> Mega::m_Weights;
 vector<uint> Mega::m_AlphaSizes;
 vector<string> Mega::m_Labels;
-vector<vector<vector<byte> > > Mega::m_Profiles;
+vector<byte> Mega::m_ProfileData;
+vector<uint64> Mega::m_PosStarts;
+vector<MegaProfile> Mega::m_Profiles;
 vector<string> Mega::m_Seqs;
 vector<vector<float> > Mega::m_LogProbsVec;
-vector<vector<vector<float> > > Mega::m_LogProbMxVec;
-vector<vector<vector<float> > > Mega::m_LogOddsMxVec;
+vector<uint> Mega::m_MxOffsets;
+vector<float> Mega::m_LogProbMx;
+vector<float> Mega::m_LogOddsMx;
 vector<string> m_Labels;
+vector<float> Mega::m_WeightedLogProbMx;
+vector<float> Mega::m_WeightedLogOddsMx;
+vector<float> Mega::m_PairLogProbMx;
+vector<float> Mega::m_PairLogOddsMx;
+vector<uint16> Mega::m_PairCodes;
+vector<float> Mega::m_InsScores;
 uint Mega::m_NextLineNr;
 uint Mega::m_FeatureCount;
 bool Mega::m_Loaded = false;
@@ -42,13 +51,13 @@ const string &Mega::GetLabelByGSI(uint GSI)
 	return m_Labels[GSI];
 	}
 
-const vector<vector<byte> > *Mega::GetProfileByGSI(uint GSI)
+const MegaProfile *Mega::GetProfileByGSI(uint GSI)
 	{
 	asserta(GSI < SIZE(m_Profiles));
 	return &m_Profiles[GSI];
 	}
 
-const vector<vector<byte> > *Mega::GetProfileByLabel(const string &Label)
+const MegaProfile *Mega::GetProfileByLabel(const string &Label)
 	{
 	unordered_map<string, uint>::const_iterator iter = m_LabelToIdx.find(Label);
 	if (iter == m_LabelToIdx.end())
@@ -58,7 +67,7 @@ const vector<vector<byte> > *Mega::GetProfileByLabel(const string &Label)
 	return &m_Profiles[Idx];
 	}
 
-const vector<vector<byte> > *Mega::GetProfileBySeq(const string &Seq,
+const MegaProfile *Mega::GetProfileBySeq(const string &Seq,
   bool FailOnError)
 	{
 	unordered_map<string, uint>::const_iterator iter = m_SeqToIdx.find(Seq);
@@ -124,18 +133,83 @@ void Mega::FromFile(const string &FileName)
 	{
 	if (FileName == "")
 		Die("Missing mega filename");
+	if (IsBinFile(FileName))
+		{
+		FromBinFile(FileName);
+		return;
+		}
+
+	string CacheFileName;
+	if (opt(megacache))
+		{
+		CacheFileName = GetCacheFileName(FileName);
+		if (CacheIsCurrent(FileName, CacheFileName))
+			{
+			FromBinFile(CacheFileName);
+			return;
+			}
+		}
+
+	FromTextFile(FileName);
+	if (CacheFileName != "")
+		ToBinFile(CacheFileName, FileName);
+	}
+
+static uint ParseUint(const char *&p, const char *End)
+	{
+	const char *Start = p;
+	uint n = 0;
+	while (p < End && *p >= '0' && *p <= '9')
+		n = n*10 + uint(*p++ - '0');
+	if (p == Start)
+		Die("Invalid mega file, expected integer");
+	return n;
+	}
+
+static void ExpectTab(const char *&p, const char *End)
+	{
+	if (p >= End || *p != '\t')
+		Die("Invalid mega file, expected tab");
+	++p;
+	}
+
+/***
+The file is mapped (or read) once. Header lines before the first
+"chain" record go through GetNextFields. Chain records are then
+located by a serial scan for line ends, which also gives the
+profile lengths, so m_ProfileData is allocated once and the position
+lines are parsed in parallel straight into it and m_Seqs.
+***/
+void Mega::FromTextFile(const string &FileName)
+	{
 	m_Loaded = true;
 
 	asserta(m_FeatureNames.empty());
 	asserta(m_FeatureCount == 0);
 	asserta(m_Profiles.empty());
 
-    FILE *f = OpenStdioFile(FileName);
-    string Line;
-    while (ReadLineStdioFile(f, Line))
-        m_Lines.push_back(Line);
-    CloseStdioFile(f);
-    
+	MegaFileBuffer Buffer;
+	Buffer.Open(FileName);
+	const char *Data = Buffer.m_Data;
+	const char *End = Data + Buffer.m_Size;
+
+	const char *p = Data;
+	m_Lines.clear();
+	m_NextLineNr = 0;
+	while (p < End)
+		{
+		const char *EOL = (const char *) memchr(p, '\n', End - p);
+		if (EOL == 0)
+			EOL = End;
+		if (EOL - p >= 6 && memcmp(p, "chain\t", 6) == 0)
+			break;
+		const char *LineEnd = EOL;
+		if (LineEnd > p && LineEnd[-1] == '\r')
+			--LineEnd;
+		m_Lines.push_back(string(p, LineEnd));
+		p = (EOL < End ? EOL + 1 : End);
+		}
+
     vector<string> flds;
     GetNextFields(flds, 5);
     asserta(flds[0] == "mega");
@@ -144,8 +218,9 @@ void Mega::FromFile(const string &FileName)
 	m_GapOpen = (float) StrToFloat(flds[3]);
 	m_GapExt = (float) StrToFloat(flds[4]);
     m_LogProbsVec.resize(m_FeatureCount);
-    m_LogProbMxVec.resize(m_FeatureCount);
-    m_LogOddsMxVec.resize(m_FeatureCount);
+	m_MxOffsets.clear();
+	m_LogProbMx.clear();
+	m_LogOddsMx.clear();
     for (uint FeatureIdx = 0; FeatureIdx < m_FeatureCount; ++FeatureIdx)
 		{
         GetNextFields(flds, 4);
@@ -171,10 +246,11 @@ void Mega::FromFile(const string &FileName)
             LogProbs.push_back(LogProb);
 			}
         
-        vector<vector<float> > &LogProbMx = m_LogProbMxVec[FeatureIdx];
-        LogProbMx.resize(AlphaSize);
-        for (uint Letter1 = 0; Letter1 < AlphaSize; ++Letter1)
-            LogProbMx[Letter1].resize(AlphaSize);
+		const uint MxOffset = SIZE(m_LogProbMx);
+		m_MxOffsets.push_back(MxOffset);
+		m_LogProbMx.resize(MxOffset + AlphaSize*AlphaSize);
+		m_LogOddsMx.resize(MxOffset + AlphaSize*AlphaSize);
+        float *LogProbMx = m_LogProbMx.data() + MxOffset;
         for (uint Letter1 = 0; Letter1 < AlphaSize; ++Letter1)
 			{
             GetNextFields(flds, Letter1 + 2);
@@ -186,8 +262,8 @@ void Mega::FromFile(const string &FileName)
                 if (Prob < VERY_SMALL_FREQ)
                     Prob = VERY_SMALL_FREQ;
                 float LogProb = logf(Prob);
-                LogProbMx[Letter1][Letter2] = LogProb;
-                LogProbMx[Letter2][Letter1] = LogProb;
+                LogProbMx[Letter1*AlphaSize + Letter2] = LogProb;
+                LogProbMx[Letter2*AlphaSize + Letter1] = LogProb;
 				}
 			}
 
@@ -195,10 +271,7 @@ void Mega::FromFile(const string &FileName)
 		GetNextFields(flds, 1);
 		asserta(flds[0] == "logoddsmx");
 
-		vector<vector<float> > &LogOddsMx = m_LogOddsMxVec[FeatureIdx];
-        LogOddsMx.resize(AlphaSize);
-        for (uint Letter1 = 0; Letter1 < AlphaSize; ++Letter1)
-            LogOddsMx[Letter1].resize(AlphaSize);
+		float *LogOddsMx = m_LogOddsMx.data() + MxOffset;
         for (uint Letter1 = 0; Letter1 < AlphaSize; ++Letter1)
 			{
             GetNextFields(flds, Letter1 + 3);
@@ -208,77 +281,360 @@ void Mega::FromFile(const string &FileName)
             for (uint Letter2 = 0; Letter2 <= Letter1; ++Letter2)
 				{
                 float Score = (float) StrToFloat(flds[Letter2+2]);
-                LogOddsMx[Letter1][Letter2] = Score;
-                LogOddsMx[Letter2][Letter1] = Score;
+                LogOddsMx[Letter1*AlphaSize + Letter2] = Score;
+                LogOddsMx[Letter2*AlphaSize + Letter1] = Score;
 				}
 			}
 		}
-    m_Profiles.resize(ProfileCount);
-    m_Seqs.resize(ProfileCount);
+	m_MxOffsets.push_back(SIZE(m_LogProbMx));
+	if (m_NextLineNr != SIZE(m_Lines))
+		Die("Invalid mega file, unexpected line before chains '%s'",
+		  m_Lines[m_NextLineNr].c_str());
+	m_Lines.clear();
+
+	vector<const char *> RowStarts(ProfileCount);
+	vector<uint> Ls(ProfileCount);
+	m_Seqs.resize(ProfileCount);
+	for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+		{
+		if (p >= End || End - p < 6 || memcmp(p, "chain\t", 6) != 0)
+			Die("Invalid mega file, expected chain %u", ProfileIdx);
+		p += 6;
+		if (ParseUint(p, End) != ProfileIdx)
+			Die("Invalid mega file, chain %u out of order", ProfileIdx);
+		ExpectTab(p, End);
+		const char *LabelStart = p;
+		while (p < End && *p != '\t')
+			++p;
+		const string Label(LabelStart, p);
+		ExpectTab(p, End);
+		const uint L = ParseUint(p, End);
+		while (p < End && *p != '\n')
+			++p;
+		if (p < End)
+			++p;
 
-    for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
-	    {
-        vector<vector<byte> > &Profile = m_Profiles[ProfileIdx];
-        string &S = m_Seqs[ProfileIdx];
-        GetNextFields(flds, 4);
-        asserta(flds[0] == "chain");
-        asserta(StrToUint(flds[1]) == ProfileIdx);
-        const string &Label = flds[2];
 		if (m_LabelToIdx.find(Label) != m_LabelToIdx.end())
 			Die("Duplicate label in mega file >%s", Label.c_str());
 		m_LabelToIdx[Label] = ProfileIdx;
-        m_Labels.push_back(Label);
-        const uint L = StrToUint(flds[3]);
-        Profile.resize(L);
-        for (uint Pos = 0; Pos < L; ++Pos)
-		    {
-            GetNextFields(flds, 3);
-            asserta(StrToUint(flds[0]) == ProfileIdx);
-            asserta(StrToUint(flds[1]) == Pos);
-            const string &Syms = flds[2];
-            asserta(SIZE(Syms) == m_FeatureCount);
-            for (uint FeatureIdx = 0; FeatureIdx < m_FeatureCount; ++FeatureIdx)
-			    {
-                byte Sym = Syms[FeatureIdx];
-                if (FeatureIdx == 0)
-				    {
-                    uint Letter = g_CharToLetterAmino[Sym];
-					if (Letter >= 20)
-						Letter = 0;
-                    Profile[Pos].push_back(Letter);
-                    S += Sym;
-					}
-                else
-					{
-                    uint Letter = uint(Sym - 'A');
-                    asserta(Letter < 16);
-                    Profile[Pos].push_back(Letter);
-					}
+		m_Labels.push_back(Label);
+		RowStarts[ProfileIdx] = p;
+		Ls[ProfileIdx] = L;
+		for (uint Pos = 0; Pos < L; ++Pos)
+			{
+			const char *EOL = (const char *) memchr(p, '\n', End - p);
+			if (EOL == 0)
+				{
+				if (Pos + 1 < L)
+					Die("Invalid mega file, truncated chain %u", ProfileIdx);
+				p = End;
 				}
+			else
+				p = EOL + 1;
+			}
+		}
+
+	AllocProfiles(Ls);
+	const uint ThreadCount = GetRequestedThreadCount();
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 16)
+	for (int ProfileIdx = 0; ProfileIdx < (int) ProfileCount; ++ProfileIdx)
+		ParseProfile(uint(ProfileIdx), RowStarts[ProfileIdx], End);
+
+	for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+		IndexSeq(ProfileIdx);
+	InitFlat();
+	}
+
+// Shared by the text and .megab loaders so both warn the same way
+void Mega::IndexSeq(uint ProfileIdx)
+	{
+	const string &S = m_Seqs[ProfileIdx];
+	if (m_SeqToIdx.find(S) != m_SeqToIdx.end())
+		{
+		static bool WarningDone = false;
+		if (!WarningDone)
+			{
+			Warning("Duplicate sequences found\n");
+			WarningDone = true;
+			}
+		}
+	m_SeqToIdx[S] = ProfileIdx;
+	}
+
+// Position lines "ProfileIdx<tab>Pos<tab>Syms"
+void Mega::ParseProfile(uint ProfileIdx, const char *p, const char *End)
+	{
+	const uint F = m_FeatureCount;
+	const uint L = m_Profiles[ProfileIdx].m_L;
+	byte *Data = GetProfileData(ProfileIdx);
+	string &S = m_Seqs[ProfileIdx];
+	S.reserve(L);
+	for (uint Pos = 0; Pos < L; ++Pos)
+		{
+		asserta(ParseUint(p, End) == ProfileIdx);
+		ExpectTab(p, End);
+		asserta(ParseUint(p, End) == Pos);
+		ExpectTab(p, End);
+		const char *Syms = p;
+		while (p < End && *p != '\n' && *p != '\r' && *p != '\t')
+			++p;
+		asserta(uint(p - Syms) == F);
+		while (p < End && *p != '\n')
+			++p;
+		if (p < End)
+			++p;
+
+		for (uint FeatureIdx = 0; FeatureIdx < F; ++FeatureIdx)
+			{
+			byte Sym = Syms[FeatureIdx];
+			uint Letter = UINT_MAX;
+			if (FeatureIdx == 0)
+				{
+				Letter = g_CharToLetterAmino[Sym];
+				if (Letter >= 20)
+					Letter = 0;
+				S += Sym;
+				}
+			else
+				{
+				Letter = uint(Sym - 'A');
+				asserta(Letter < 16);
+				}
+			Data[FeatureIdx*L + Pos] = byte(Letter);
+			}
+		}
+	}
+
+void MegaProfile::Copy(const MegaProfile &rhs)
+	{
+	if (&rhs == this)
+		return;
+	m_L = rhs.m_L;
+	m_FeatureCount = rhs.m_FeatureCount;
+	m_Idx = rhs.m_Idx;
+	m_Buffer = rhs.m_Buffer;
+	m_Data = (m_Buffer.empty() ? rhs.m_Data : m_Buffer.data());
+	}
+
+void MegaProfile::SetView(const byte *Data, uint L, uint FeatureCount,
+  uint Idx)
+	{
+	m_Buffer.clear();
+	m_Data = Data;
+	m_L = L;
+	m_FeatureCount = FeatureCount;
+	m_Idx = Idx;
+	}
+
+void MegaProfile::FromAASeq(const string &Seq)
+	{
+	const uint L = SIZE(Seq);
+	m_Buffer.resize(L);
+	for (uint Pos = 0; Pos < L; ++Pos)
+		{
+		byte Letter = g_CharToLetterAmino[(byte) Seq[Pos]];
+		if (Letter >= 20)
+			Letter = 0;
+		m_Buffer[Pos] = Letter;
+		}
+	m_Data = m_Buffer.data();
+	m_L = L;
+	m_FeatureCount = 1;
+	m_Idx = UINT_MAX;
+	}
+
+// Sets m_PosStarts, allocates m_ProfileData and points m_Profiles
+// into it, letters are filled in by the caller.
+void Mega::AllocProfiles(const vector<uint> &Ls)
+	{
+	const uint F = m_FeatureCount;
+	const uint ProfileCount = SIZE(Ls);
+	m_PosStarts.resize(ProfileCount + 1);
+	uint64 PosCount = 0;
+	for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+		{
+		m_PosStarts[ProfileIdx] = PosCount;
+		PosCount += Ls[ProfileIdx];
+		}
+	m_PosStarts[ProfileCount] = PosCount;
+
+	m_ProfileData.clear();
+	m_ProfileData.resize(PosCount*F);
+	m_Profiles.clear();
+	m_Profiles.resize(ProfileCount);
+	for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+		m_Profiles[ProfileIdx].SetView(GetProfileData(ProfileIdx),
+		  Ls[ProfileIdx], F, ProfileIdx);
+	}
+
+byte *Mega::GetProfileData(uint ProfileIdx)
+	{
+	asserta(ProfileIdx + 1 < SIZE(m_PosStarts));
+	return m_ProfileData.data() + m_PosStarts[ProfileIdx]*m_FeatureCount;
+	}
+
+static void InitWeightedMx(const vector<float> &Mx,
+  const vector<float> &Weights, const vector<uint> &AlphaSizes,
+  const vector<uint> &Offsets, vector<float> &WeightedMx,
+  const vector<uint16> &PairCodes, vector<float> &PairMx)
+	{
+	WeightedMx.clear();
+	PairMx.clear();
+	if (Mx.empty())
+		return;
+	const uint FeatureCount = SIZE(Weights);
+	asserta(SIZE(Mx) == Offsets[FeatureCount]);
+	WeightedMx.resize(Offsets[FeatureCount]);
+	for (uint f = 0; f < FeatureCount; ++f)
+		{
+		const uint A = AlphaSizes[f];
+		const float *FMx = Mx.data() + Offsets[f];
+		float *WMx = WeightedMx.data() + Offsets[f];
+		for (uint x = 0; x < A; ++x)
+			for (uint y = 0; y < A; ++y)
+				WMx[x*A + y] = FMx[x*A + y]*Weights[f];
+		}
+	if (PairCodes.empty())
+		return;
+
+	const uint A0 = AlphaSizes[0];
+	const uint A1 = AlphaSizes[1];
+	const uint A01 = A0*A1;
+	asserta(A01 <= MEGA_MAX_PAIR_ALPHA);
+	const float *W0 = WeightedMx.data() + Offsets[0];
+	const float *W1 = WeightedMx.data() + Offsets[1];
+	PairMx.resize(A01*A01);
+	for (uint x = 0; x < A01; ++x)
+		{
+		const uint x0 = x/A1;
+		const uint x1 = x%A1;
+		for (uint y = 0; y < A01; ++y)
+			{
+			float Score = 0;
+			Score += W0[x0*A0 + y/A1];
+			Score += W1[x1*A1 + y%A1];
+			PairMx[x*A01 + y] = Score;
 			}
-		if (m_SeqToIdx.find(S) != m_SeqToIdx.end())
+		}
+	}
+
+void Mega::InitFlat()
+	{
+	const uint F = m_FeatureCount;
+	const uint ProfileCount = SIZE(m_Profiles);
+	asserta(SIZE(m_AlphaSizes) == F && SIZE(m_Weights) == F);
+	asserta(SIZE(m_MxOffsets) == F + 1);
+	asserta(SIZE(m_PosStarts) == ProfileCount + 1);
+	const uint64 PosCount = m_PosStarts[ProfileCount];
+
+// The pair table has (A0*A1)^2 entries and codes must fit in uint16,
+// larger alphabets fall back to per-feature lookups.
+	m_PairCodes.clear();
+	if (F >= 2 && m_AlphaSizes[0]*m_AlphaSizes[1] <= MEGA_MAX_PAIR_ALPHA)
+		{
+		const uint A0 = m_AlphaSizes[0];
+		const uint A1 = m_AlphaSizes[1];
+		asserta(A0*A1 <= 65536);
+		m_PairCodes.resize(PosCount);
+		for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
 			{
-			static bool WarningDone = false;
-			if (!WarningDone)
+			const MegaProfile &Profile = m_Profiles[ProfileIdx];
+			const uint L = Profile.m_L;
+			const byte *X0 = Profile.GetFeatureRow(0);
+			const byte *X1 = Profile.GetFeatureRow(1);
+			uint16 *Codes = m_PairCodes.data() + m_PosStarts[ProfileIdx];
+			for (uint Pos = 0; Pos < L; ++Pos)
 				{
-				Warning("Duplicate sequences found\n");
-				WarningDone = true;
+				asserta(X0[Pos] < A0 && X1[Pos] < A1);
+				Codes[Pos] = uint16(X0[Pos]*A1 + X1[Pos]);
 				}
 			}
-		m_SeqToIdx[S] = ProfileIdx;
 		}
-    m_Lines.clear();
+
+	InitWeightedMx(m_LogProbMx, m_Weights, m_AlphaSizes, m_MxOffsets,
+	  m_WeightedLogProbMx, m_PairCodes, m_PairLogProbMx);
+	InitWeightedMx(m_LogOddsMx, m_Weights, m_AlphaSizes, m_MxOffsets,
+	  m_WeightedLogOddsMx, m_PairCodes, m_PairLogOddsMx);
+
+	m_InsScores.clear();
+	if (SIZE(m_LogProbsVec) == F)
+		{
+		m_InsScores.resize(PosCount);
+		for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+			{
+			const MegaProfile &Profile = m_Profiles[ProfileIdx];
+			float *InsScores = m_InsScores.data() + m_PosStarts[ProfileIdx];
+			for (uint Pos = 0; Pos < Profile.m_L; ++Pos)
+				InsScores[Pos] = GetInsScore(Profile, Pos);
+			}
+		}
 	}
 
-float Mega::GetInsScore(const vector<vector<byte> > &Profile, uint Pos)
+// Profiles passed to the DP routines are elements of m_Profiles
+uint Mega::GetProfileIdx(const MegaProfile &Profile)
+	{
+	const uint Idx = Profile.m_Idx;
+	asserta(Idx < SIZE(m_Profiles) && &m_Profiles[Idx] == &Profile);
+	return Idx;
+	}
+
+const float *Mega::GetInsScores(uint ProfileIdx)
+	{
+	asserta(ProfileIdx < SIZE(m_Profiles));
+	asserta(!m_InsScores.empty());
+	return m_InsScores.data() + m_PosStarts[ProfileIdx];
+	}
+
+// Row[j] = GetMatchScore(X, PosX, Y, j) (or _LogOdds) for all j in Y
+void Mega::GetMatchScoreRow(bool LogOdds, uint ProfileIdxX, uint PosX,
+  uint ProfileIdxY, float *Row)
+	{
+	const uint F = m_FeatureCount;
+	const vector<float> &WeightedMx =
+	  (LogOdds ? m_WeightedLogOddsMx : m_WeightedLogProbMx);
+	const vector<float> &PairMx = (LogOdds ? m_PairLogOddsMx : m_PairLogProbMx);
+	asserta(!WeightedMx.empty());
+	const MegaProfile &ProfileX = m_Profiles[ProfileIdxX];
+	const MegaProfile &ProfileY = m_Profiles[ProfileIdxY];
+	const uint LY = ProfileY.m_L;
+	asserta(PosX < ProfileX.m_L);
+
+	uint FirstFeature = 0;
+	if (!PairMx.empty())
+		{
+		const uint A01 = m_AlphaSizes[0]*m_AlphaSizes[1];
+		const float *PairRow = PairMx.data() +
+		  m_PairCodes[m_PosStarts[ProfileIdxX] + PosX]*A01;
+		const uint16 *CodesY = m_PairCodes.data() + m_PosStarts[ProfileIdxY];
+		for (uint j = 0; j < LY; ++j)
+			Row[j] = PairRow[CodesY[j]];
+		FirstFeature = 2;
+		}
+	else
+		{
+		for (uint j = 0; j < LY; ++j)
+			Row[j] = 0;
+		}
+
+	for (uint f = FirstFeature; f < F; ++f)
+		{
+		const uint A = m_AlphaSizes[f];
+		const float *MxRow = WeightedMx.data() + m_MxOffsets[f] +
+		  ProfileX.Get(PosX, f)*A;
+		const byte *Yf = ProfileY.GetFeatureRow(f);
+		for (uint j = 0; j < LY; ++j)
+			Row[j] += MxRow[Yf[j]];
+		}
+	}
+
+float Mega::GetInsScore(const MegaProfile &Profile, uint Pos)
 	{
 	asserta(Pos < SIZE(Profile));
-	const vector<byte> &ProfCol = Profile[Pos];
 	float Score = 0;
 	for (uint i = 0; i < m_FeatureCount; ++i)
 		{
 		const vector<float> &LogProbs = m_LogProbsVec[i];
-		byte Letter = ProfCol[i];
+		byte Letter = Profile.Get(Pos, i);
 		Score += LogProbs[Letter]*m_Weights[i];
 		}
 	return Score;
@@ -308,51 +664,52 @@ const string &Mega::GetLabel(uint ProfileIdx)
 	return m_Labels[ProfileIdx];
 	}
 
-const vector<vector<byte> > &Mega::GetProfile(uint ProfileIdx)
+const MegaProfile &Mega::GetProfile(uint ProfileIdx)
 	{
 	asserta(ProfileIdx < SIZE(m_Profiles));
 	return m_Profiles[ProfileIdx];
 	}
 
+const float *Mega::GetLogOddsMx(uint FeatureIdx)
+	{
+	asserta(FeatureIdx < m_FeatureCount);
+	asserta(!m_LogOddsMx.empty());
+	return m_LogOddsMx.data() + m_MxOffsets[FeatureIdx];
+	}
+
 float Mega::GetMatchScore_LogOdds(
-  const vector<vector<byte> > &ProfileX, uint PosX,
-  const vector<vector<byte> > &ProfileY, uint PosY)
-	{
-	const uint LX = SIZE(ProfileX);
-	const uint LY = SIZE(ProfileY);
-	asserta(PosX < LX);
-	asserta(PosY < LY);
-	const vector<byte> &ProfColX = ProfileX[PosX];
-	const vector<byte> &ProfColY = ProfileY[PosY];
+  const MegaProfile &ProfileX, uint PosX,
+  const MegaProfile &ProfileY, uint PosY)
+	{
+	asserta(PosX < SIZE(ProfileX));
+	asserta(PosY < SIZE(ProfileY));
 	float Score = 0;
 	for (uint i = 0; i < m_FeatureCount; ++i)
 		{
-		const vector<vector<float> > &SubstMx = m_LogOddsMxVec[i];
-		byte LetterX = ProfColX[i];
-		byte LetterY = ProfColY[i];
-		float LetterPairScore = SubstMx[LetterX][LetterY];
+		const uint A = m_AlphaSizes[i];
+		const float *SubstMx = m_LogOddsMx.data() + m_MxOffsets[i];
+		byte LetterX = ProfileX.Get(PosX, i);
+		byte LetterY = ProfileY.Get(PosY, i);
+		float LetterPairScore = SubstMx[LetterX*A + LetterY];
 		Score += LetterPairScore*m_Weights[i];
 		}
 	return Score;
 	}
 
 float Mega::GetMatchScore(
-  const vector<vector<byte> > &ProfileX, uint PosX,
-  const vector<vector<byte> > &ProfileY, uint PosY)
-	{
-	const uint LX = SIZE(ProfileX);
-	const uint LY = SIZE(ProfileY);
-	asserta(PosX < LX);
-	asserta(PosY < LY);
-	const vector<byte> &ProfColX = ProfileX[PosX];
-	const vector<byte> &ProfColY = ProfileY[PosY];
+  const MegaProfile &ProfileX, uint PosX,
+  const MegaProfile &ProfileY, uint PosY)
+	{
+	asserta(PosX < SIZE(ProfileX));
+	asserta(PosY < SIZE(ProfileY));
 	float Score = 0;
 	for (uint i = 0; i < m_FeatureCount; ++i)
 		{
-		const vector<vector<float> > &SubstMx = m_LogProbMxVec[i];
-		byte LetterX = ProfColX[i];
-		byte LetterY = ProfColY[i];
-		float LetterPairScore = SubstMx[LetterX][LetterY];
+		const uint A = m_AlphaSizes[i];
+		const float *SubstMx = m_LogProbMx.data() + m_MxOffsets[i];
+		byte LetterX = ProfileX.Get(PosX, i);
+		byte LetterY = ProfileY.Get(PosY, i);
+		float LetterPairScore = SubstMx[LetterX*A + LetterY];
 		Score += LetterPairScore*m_Weights[i];
 		}
 	return Score;
@@ -373,10 +730,8 @@ void Mega::LogVec(const string &Name, const vector<float> &Vec)
 	Log("\n");
 	}
 
-void Mega::LogMx(const string &Name,
-  const vector<vector<float> > &Mx)
+void Mega::LogMx(const string &Name, const float *Mx, uint N)
 	{
-	const uint N = SIZE(Mx);
 	Log("\n%s/%u\n", Name.c_str(), N);
 
 	Log("     ");
@@ -386,8 +741,7 @@ void Mega::LogMx(const string &Name,
 	for (uint i = 0; i < N; ++i)
 		{
 		Log("[%2u] ", i);
-		const vector<float> &Row = Mx[i];
-		asserta(SIZE(Row) == N);
+		const float *Row = Mx + i*N;
 		for (uint j = 0; j < N; ++j)
 			Log(" %7.2f", Row[j]);
 		Log("\n");
@@ -397,14 +751,14 @@ void Mega::LogMx(const string &Name,
 void Mega::LogFeatureParams(uint Idx)
 	{
 	asserta(Idx < SIZE(m_FeatureNames));
-	asserta(Idx < SIZE(m_LogProbMxVec));
 	asserta(Idx < SIZE(m_LogProbsVec));
+	asserta(!m_LogProbMx.empty());
 	const string &Name = m_FeatureNames[Idx];
 	Log("\n");
 	Log("Feature %s, weight %.3g\n",
 	  Name.c_str(), m_Weights[Idx]);
 	LogVec(Name, m_LogProbsVec[Idx]);
-	LogMx(Name, m_LogProbMxVec[Idx]);
+	LogMx(Name, m_LogProbMx.data() + m_MxOffsets[Idx], m_AlphaSizes[Idx]);
 	}
 
 uint Mega::GetAAFeatureIdx()
@@ -436,9 +790,8 @@ void Mega::FromMSA_AAOnly(const MultiSequence &Aln,
 	m_SeqToIdx.clear();
 	m_Labels.clear();
 	m_Seqs.clear();
-	m_Profiles.clear();
 	const uint SeqCount = Aln.GetSeqCount();
-	m_Profiles.resize(SeqCount);
+	vector<uint> Ls;
 	for (uint SeqIdx = 0; SeqIdx < SeqCount; ++SeqIdx)
 		{
 		const string &Label = Aln.GetLabelStr(SeqIdx);
@@ -455,26 +808,41 @@ void Mega::FromMSA_AAOnly(const MultiSequence &Aln,
 		m_Seqs.push_back(UngappedSeq);
 		m_LabelToIdx[Label] = SeqIdx;
 		m_SeqToIdx[UngappedSeq] = SeqIdx;
+		Ls.push_back(SIZE(UngappedSeq));
+		}
 
-		vector<vector<byte> > &Profile = m_Profiles[SeqIdx];
+	AllocProfiles(Ls);
+	for (uint SeqIdx = 0; SeqIdx < SeqCount; ++SeqIdx)
+		{
+		const string &UngappedSeq = m_Seqs[SeqIdx];
+		byte *Data = GetProfileData(SeqIdx);
 		for (uint i = 0; i < SIZE(UngappedSeq); ++i)
 			{
 			char c = UngappedSeq[i];
 			byte Letter = g_CharToLetterAmino[c];
 			if (Letter >= 20)
 				Letter = 0;
-			vector<byte> Col;
-			Col.push_back(Letter);
-			Profile.push_back(Col);
+			Data[i] = Letter;
 			}
 		}
 
+	vector<vector<float> > Blosum62;
+	GetBlosum62LogOddsLetterMx(Blosum62);
+	asserta(SIZE(Blosum62) == 20);
 	m_LogProbsVec.clear();
-	m_LogProbMxVec.clear();
-	m_LogOddsMxVec.clear();
-	m_LogOddsMxVec.resize(1);
-	GetBlosum62LogOddsLetterMx(m_LogOddsMxVec[0]);
+	m_LogProbMx.clear();
+	m_LogOddsMx.clear();
+	for (uint i = 0; i < 20; ++i)
+		{
+		asserta(SIZE(Blosum62[i]) == 20);
+		m_LogOddsMx.insert(m_LogOddsMx.end(), Blosum62[i].begin(),
+		  Blosum62[i].end());
+		}
+	m_MxOffsets.clear();
+	m_MxOffsets.push_back(0);
+	m_MxOffsets.push_back(SIZE(m_LogOddsMx));
 	m_GapOpen = GapOpen;
 	m_GapExt = GapExt;
 	m_Loaded = true;
+	InitFlat();
 	}
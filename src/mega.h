@@ -3,6 +3,88 @@
 #include "multisequence.h"
 #include <unordered_map>
 
+// Read-only view of a whole file, memory-mapped where available
+class MegaFileBuffer
+	{
+public:
+	const char *m_Data = 0;
+	uint64 m_Size = 0;
+	void *m_MapBase = 0;
+	byte *m_Buffer = 0;
+
+public:
+	~MegaFileBuffer() { Close(); }
+	void Open(const string &FileName);
+	void Close();
+	};
+
+/***
+Binary cache (.megab), native byte order: MegaBinHdr, then for each
+feature name, alphabet size, weight, log-probs, log-prob and
+log-odds matrices, then for each profile label, length and
+sequence, then Mega::m_ProfileData as one block. Written by
+-megacache next to the text file and used while the size and mtime
+of the text file equal SrcSize and SrcMtime.
+***/
+static const uint32 MEGABIN_MAGIC = 0x4247454d;	// "MEGB"
+static const uint32 MEGABIN_VERSION = 2;
+
+struct MegaBinHdr
+	{
+	uint32 Magic;
+	uint32 Version;
+	uint32 FeatureCount;
+	uint32 ProfileCount;
+	float GapOpen;
+	float GapExt;
+	uint64 Bytes;
+	uint64 SrcSize;
+	int64 SrcMtime;
+	};
+
+// Largest A0*A1 for the combined feature 0+1 table, (A0*A1)^2 floats
+static const uint MEGA_MAX_PAIR_ALPHA = 1024;
+
+/***
+Letters of one profile, feature-major: feature f at m_Data[f*m_L].
+Profiles loaded by Mega are views into Mega::m_ProfileData with
+m_Idx set. FromAASeq builds a standalone AA-only profile which owns
+its letters in m_Buffer.
+***/
+class MegaProfile
+	{
+public:
+	const byte *m_Data = 0;
+	uint m_L = 0;
+	uint m_FeatureCount = 0;
+	uint m_Idx = UINT_MAX;
+	vector<byte> m_Buffer;
+
+public:
+	MegaProfile() {}
+	MegaProfile(const MegaProfile &rhs) { Copy(rhs); }
+	MegaProfile &operator=(const MegaProfile &rhs)
+		{
+		Copy(rhs);
+		return *this;
+		}
+
+	void Copy(const MegaProfile &rhs);
+	void SetView(const byte *Data, uint L, uint FeatureCount, uint Idx);
+	void FromAASeq(const string &Seq);
+	uint size() const { return m_L; }
+	const byte *GetFeatureRow(uint FeatureIdx) const
+		{
+		assert(FeatureIdx < m_FeatureCount);
+		return m_Data + FeatureIdx*m_L;
+		}
+	byte Get(uint Pos, uint FeatureIdx) const
+		{
+		assert(Pos < m_L && FeatureIdx < m_FeatureCount);
+		return m_Data[FeatureIdx*m_L + Pos];
+		}
+	};
+
 class Mega
 	{
 public:
@@ -17,14 +99,43 @@ public:
 // log(P_i) for each letter (for HMM Insert states)
 	static vector<vector<float> > m_LogProbsVec;
 
-// log(P_ij) for each letter pair (for HMM Match state)
-	static vector<vector<vector<float> > > m_LogProbMxVec;
-
-// log-odds score matrix for S-W / N-W
-	static vector<vector<vector<float> > > m_LogOddsMxVec;
+/***
+Substitution matrices, feature f at m_MxOffsets[f] with row stride
+m_AlphaSizes[f]. m_LogProbMx has log(P_ij) for each letter pair (for
+HMM Match state), m_LogOddsMx log-odds scores for S-W / N-W.
+m_LogProbMx is empty for FromMSA_AAOnly.
+***/
+	static vector<uint> m_MxOffsets;
+	static vector<float> m_LogProbMx;
+	static vector<float> m_LogOddsMx;
 
 	static vector<string> m_Labels;
-	static vector<vector<vector<byte> > > m_Profiles;
+
+/***
+All profile letters in one buffer. Profile p covers positions
+m_PosStarts[p] .. m_PosStarts[p+1]-1 of the concatenated profiles,
+its letters start at m_ProfileData[F*m_PosStarts[p]] (feature-major,
+see MegaProfile). m_Profiles are views into m_ProfileData.
+***/
+	static vector<byte> m_ProfileData;
+	static vector<uint64> m_PosStarts;
+	static vector<MegaProfile> m_Profiles;
+
+/***
+Built by InitFlat for the DP inner loops. Weighted tables are the
+matrices pre-multiplied by the feature weight, same layout. If
+(A0*A1) <= MEGA_MAX_PAIR_ALPHA, features 0 and 1 (AA and the first
+structure feature) are also combined into one (A0*A1)^2 table
+indexed by pair codes x0*A1 + x1. Pair codes and insert scores are
+indexed like m_PosStarts. Sums are accumulated in feature order, so
+scores are bit-identical to GetMatchScore and GetInsScore.
+***/
+	static vector<float> m_WeightedLogProbMx;
+	static vector<float> m_WeightedLogOddsMx;
+	static vector<float> m_PairLogProbMx;
+	static vector<float> m_PairLogOddsMx;
+	static vector<uint16> m_PairCodes;
+	static vector<float> m_InsScores;
 	static vector<string> m_Seqs;
 	static uint m_NextLineNr;
 	static uint m_FeatureCount;
@@ -36,8 +147,19 @@ public:
 	static void FromMSA_AAOnly(const MultiSequence &Aln,
 	  float GapOpen, float GapExt);
 	static void FromFile(const string &FileName);
+	static void FromTextFile(const string &FileName);
+	static void IndexSeq(uint ProfileIdx);
+	static void ParseProfile(uint ProfileIdx, const char *p, const char *End);
+	static void AllocProfiles(const vector<uint> &Ls);
+	static byte *GetProfileData(uint ProfileIdx);
+	static bool IsBinFile(const string &FileName);
+	static void FromBinFile(const string &FileName);
+	static void ToBinFile(const string &FileName, const string &SrcFileName);
+	static string GetCacheFileName(const string &FileName);
+	static bool CacheIsCurrent(const string &FileName,
+	  const string &CacheFileName);
 	static uint GetProfileCount() { return SIZE(m_Profiles); }
-	static const vector<vector<byte> > &GetProfile(uint ProfileIdx);
+	static const MegaProfile &GetProfile(uint ProfileIdx);
 	static const string &GetLabel(uint ProfileIdx);
 	static uint GetFeatureCount() { return m_FeatureCount; }
 	static uint GetAlphaSize(uint FeatureIndex);
@@ -46,32 +168,38 @@ public:
 	static const string &GetNextLine();
 	static void GetNextFields(vector<string> &Fields,
 	  uint ExpectedNrFields = UINT_MAX);
-	static float GetInsScore(const vector<vector<byte> > &Profile, uint Pos);
+	static const float *GetLogOddsMx(uint FeatureIdx);
+	static float GetInsScore(const MegaProfile &Profile, uint Pos);
 	static float GetMatchScore(
-	  const vector<vector<byte> > &ProfileX, uint PosX,
-	  const vector<vector<byte> > &ProfileY, uint PosY);
+	  const MegaProfile &ProfileX, uint PosX,
+	  const MegaProfile &ProfileY, uint PosY);
 	static float GetMatchScore_LogOdds(
-	  const vector<vector<byte> > &ProfileX, uint PosX,
-	  const vector<vector<byte> > &ProfileY, uint PosY);
+	  const MegaProfile &ProfileX, uint PosX,
+	  const MegaProfile &ProfileY, uint PosY);
 	static void CalcMarginalFreqs(const vector<vector<float > > &FreqsMx,
 	  vector<float> &Freqs);
 	static void LogFeatureParams(uint Idx);
-	static void LogMx(const string &Name, const vector<vector<float> > &Mx);
+	static void LogMx(const string &Name, const float *Mx, uint N);
 	static void LogVec(const string &Name, const vector<float> &Vec);
 	static void AssertSymmetrical(const vector<vector<float> > &Mx);
 	static void CalcFwdFlat_mega(
-	  const vector<vector<byte> > &ProfileX,
-	  const vector<vector<byte> > &ProfileY, float *Flat);
+	  const MegaProfile &ProfileX,
+	  const MegaProfile &ProfileY, float *Flat);
 	static void CalcBwdFlat_mega(
-	  const vector<vector<byte> > &ProfileX,
-	  const vector<vector<byte> > &ProfileY, float *Flat);
+	  const MegaProfile &ProfileX,
+	  const MegaProfile &ProfileY, float *Flat);
 	static uint GetAAFeatureIdx();
+	static void InitFlat();
+	static uint GetProfileIdx(const MegaProfile &Profile);
+	static const float *GetInsScores(uint ProfileIdx);
+	static void GetMatchScoreRow(bool LogOdds, uint ProfileIdxX, uint PosX,
+	  uint ProfileIdxY, float *Row);
 
 public:
 	static uint GetGSIByLabel(const string &Label);
 	static const string &GetLabelByGSI(uint GSI);
-	static const vector<vector<byte> > *GetProfileByGSI(uint GSI);
-	static const vector<vector<byte> > *GetProfileByLabel(const string &Label);
-	static const vector<vector<byte> > *GetProfileBySeq(const string &Seq,
+	static const MegaProfile *GetProfileByGSI(uint GSI);
+	static const MegaProfile *GetProfileByLabel(const string &Label);
+	static const MegaProfile *GetProfileBySeq(const string &Seq,
 	  bool FailOnError);
 	};
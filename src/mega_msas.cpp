@@ -41,8 +41,7 @@ void cmd_mega_msas()
 			{
 			const char *AARow = Aln.GetSeqCharPtr(SeqIdx);
 			const string &Label = Aln.GetLabel(SeqIdx);
-			const vector<vector<byte> > &Profile =
-			  *Mega::GetProfileByLabel(Label);
+			const MegaProfile &Profile = *Mega::GetProfileByLabel(Label);
 			uint Pos = 0;
 			string FeatureRow;
 			for (uint Col = 0; Col < ColCount; ++Col)
@@ -52,8 +51,8 @@ void cmd_mega_msas()
 					FeatureRow += c;
 				else
 					{
-					asserta(SIZE(Profile[Pos]) == FeatureCount);
-					byte FeatureLetter = Profile[Pos][FeatureIdx];
+					asserta(Profile.m_FeatureCount == FeatureCount);
+					byte FeatureLetter = Profile.Get(Pos, FeatureIdx);
 					FeatureRow += GetFeatureChar(IsAA, FeatureLetter);
 					++Pos;
 					}
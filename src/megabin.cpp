@@ -0,0 +1,291 @@
+#include "muscle.h"
+#include "mega.h"
+#include <sys/stat.h>
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#endif
+
+void MegaFileBuffer::Open(const string &FileName)
+	{
+	Close();
+	FILE *f = OpenStdioFile(FileName);
+	m_Size = GetStdioFileSize64(f);
+	if (m_Size == 0)
+		{
+		CloseStdioFile(f);
+		m_Data = "";
+		return;
+		}
+#ifdef _MSC_VER
+	m_Buffer = myalloc(byte, m_Size);
+	ReadStdioFile64(f, 0, m_Buffer, m_Size);
+	m_Data = (const char *) m_Buffer;
+#else
+	void *p = mmap(0, m_Size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if (p == MAP_FAILED)
+		Die("mmap(%s) failed, errno=%d", FileName.c_str(), errno);
+	madvise(p, m_Size, MADV_SEQUENTIAL);
+	m_MapBase = p;
+	m_Data = (const char *) p;
+#endif
+	CloseStdioFile(f);
+	}
+
+void MegaFileBuffer::Close()
+	{
+#ifndef _MSC_VER
+	if (m_MapBase != 0)
+		munmap(m_MapBase, m_Size);
+#endif
+	myfree(m_Buffer);
+	m_MapBase = 0;
+	m_Buffer = 0;
+	m_Data = 0;
+	m_Size = 0;
+	}
+
+static void PutBytes(string &Buf, const void *Data, uint64 Bytes)
+	{
+	Buf.append((const char *) Data, Bytes);
+	}
+
+static void PutUint(string &Buf, uint32 n)
+	{
+	PutBytes(Buf, &n, sizeof(n));
+	}
+
+static void PutStr(string &Buf, const string &s)
+	{
+	PutUint(Buf, SIZE(s));
+	PutBytes(Buf, s.data(), s.size());
+	}
+
+static void PutFloats(string &Buf, const vector<float> &v)
+	{
+	PutBytes(Buf, v.data(), v.size()*sizeof(float));
+	}
+
+static void PutMx(string &Buf, const vector<float> &Mx, uint Offset, uint A)
+	{
+	asserta(Offset + A*A <= SIZE(Mx));
+	PutBytes(Buf, Mx.data() + Offset, A*A*sizeof(float));
+	}
+
+class MegaBinReader
+	{
+public:
+	string m_FileName;
+	const char *m_p = 0;
+	const char *m_End = 0;
+
+public:
+	void Get(void *Data, uint64 Bytes)
+		{
+		if (uint64(m_End - m_p) < Bytes)
+			Die("%s: truncated mega cache", m_FileName.c_str());
+		memcpy(Data, m_p, Bytes);
+		m_p += Bytes;
+		}
+
+	uint32 GetUint()
+		{
+		uint32 n;
+		Get(&n, sizeof(n));
+		return n;
+		}
+
+	void GetStr(string &s)
+		{
+		const uint32 n = GetUint();
+		if (uint64(m_End - m_p) < n)
+			Die("%s: truncated mega cache", m_FileName.c_str());
+		s.assign(m_p, n);
+		m_p += n;
+		}
+
+	void GetFloats(vector<float> &v, uint n)
+		{
+		v.resize(n);
+		Get(v.data(), n*sizeof(float));
+		}
+
+	void GetMx(vector<float> &Mx, uint A)
+		{
+		const uint Offset = SIZE(Mx);
+		Mx.resize(Offset + A*A);
+		Get(Mx.data() + Offset, A*A*sizeof(float));
+		}
+	};
+
+static bool ReadBinHdr(const string &FileName, MegaBinHdr &Hdr)
+	{
+	FILE *f = OpenStdioFile(FileName);
+	bool Ok = false;
+	if (GetStdioFileSize64(f) >= sizeof(MegaBinHdr))
+		{
+		ReadStdioFile64(f, 0, &Hdr, sizeof(Hdr));
+		Ok = (Hdr.Magic == MEGABIN_MAGIC);
+		}
+	CloseStdioFile(f);
+	return Ok;
+	}
+
+bool Mega::IsBinFile(const string &FileName)
+	{
+	MegaBinHdr Hdr;
+	return ReadBinHdr(FileName, Hdr);
+	}
+
+string Mega::GetCacheFileName(const string &FileName)
+	{
+	if (EndsWith(FileName, ".mega"))
+		return FileName + "b";
+	return FileName + ".megab";
+	}
+
+// Exact match, a cache written in the same second as an edit of the
+// text file is not trusted unless the size also matches.
+bool Mega::CacheIsCurrent(const string &FileName, const string &CacheFileName)
+	{
+	struct stat SD;
+	struct stat CacheSD;
+	if (stat(FileName.c_str(), &SD) != 0 ||
+	  stat(CacheFileName.c_str(), &CacheSD) != 0)
+		return false;
+	MegaBinHdr Hdr;
+	if (!ReadBinHdr(CacheFileName, Hdr))
+		return false;
+	return Hdr.Version == MEGABIN_VERSION &&
+	  Hdr.SrcSize == uint64(SD.st_size) &&
+	  Hdr.SrcMtime == int64(SD.st_mtime);
+	}
+
+void Mega::ToBinFile(const string &FileName, const string &SrcFileName)
+	{
+	struct stat SD;
+	if (stat(SrcFileName.c_str(), &SD) != 0)
+		Die("stat(%s) failed, errno=%d", SrcFileName.c_str(), errno);
+
+	const uint F = m_FeatureCount;
+	const uint ProfileCount = SIZE(m_Profiles);
+	asserta(SIZE(m_LogProbsVec) == F && SIZE(m_MxOffsets) == F + 1 &&
+	  SIZE(m_LogProbMx) == m_MxOffsets[F] && SIZE(m_LogOddsMx) == m_MxOffsets[F]);
+
+	string Buf;
+	MegaBinHdr Hdr;
+	memset(&Hdr, 0, sizeof(Hdr));
+	PutBytes(Buf, &Hdr, sizeof(Hdr));
+	for (uint f = 0; f < F; ++f)
+		{
+		const uint A = m_AlphaSizes[f];
+		PutStr(Buf, m_FeatureNames[f]);
+		PutUint(Buf, A);
+		PutBytes(Buf, &m_Weights[f], sizeof(float));
+		asserta(SIZE(m_LogProbsVec[f]) == A);
+		PutFloats(Buf, m_LogProbsVec[f]);
+		PutMx(Buf, m_LogProbMx, m_MxOffsets[f], A);
+		PutMx(Buf, m_LogOddsMx, m_MxOffsets[f], A);
+		}
+
+	for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+		{
+		const uint L = SIZE(m_Profiles[ProfileIdx]);
+		asserta(SIZE(m_Seqs[ProfileIdx]) == L);
+		PutStr(Buf, m_Labels[ProfileIdx]);
+		PutUint(Buf, L);
+		PutBytes(Buf, m_Seqs[ProfileIdx].data(), L);
+		}
+	asserta(m_ProfileData.size() == m_PosStarts[ProfileCount]*F);
+	PutBytes(Buf, m_ProfileData.data(), m_ProfileData.size());
+
+	Hdr.Magic = MEGABIN_MAGIC;
+	Hdr.Version = MEGABIN_VERSION;
+	Hdr.FeatureCount = F;
+	Hdr.ProfileCount = ProfileCount;
+	Hdr.GapOpen = m_GapOpen;
+	Hdr.GapExt = m_GapExt;
+	Hdr.Bytes = Buf.size();
+	Hdr.SrcSize = uint64(SD.st_size);
+	Hdr.SrcMtime = int64(SD.st_mtime);
+	memcpy(&Buf[0], &Hdr, sizeof(Hdr));
+
+	FILE *f = CreateStdioFile(FileName);
+	WriteStdioFile64(f, Buf.data(), Buf.size());
+	CloseStdioFile(f);
+	}
+
+void Mega::FromBinFile(const string &FileName)
+	{
+	m_Loaded = true;
+	asserta(m_FeatureNames.empty());
+	asserta(m_FeatureCount == 0);
+	asserta(m_Profiles.empty());
+
+	MegaFileBuffer Buffer;
+	Buffer.Open(FileName);
+	MegaBinReader R;
+	R.m_FileName = FileName;
+	R.m_p = Buffer.m_Data;
+	R.m_End = Buffer.m_Data + Buffer.m_Size;
+
+	MegaBinHdr Hdr;
+	R.Get(&Hdr, sizeof(Hdr));
+	if (Hdr.Magic != MEGABIN_MAGIC)
+		Die("%s: not a mega cache file", FileName.c_str());
+	if (Hdr.Version != MEGABIN_VERSION)
+		Die("%s: mega cache version %u, expected %u",
+		  FileName.c_str(), Hdr.Version, MEGABIN_VERSION);
+	if (Hdr.Bytes != Buffer.m_Size)
+		Die("%s: mega cache size mismatch", FileName.c_str());
+
+	const uint F = Hdr.FeatureCount;
+	const uint ProfileCount = Hdr.ProfileCount;
+	m_FeatureCount = F;
+	m_GapOpen = Hdr.GapOpen;
+	m_GapExt = Hdr.GapExt;
+	m_FeatureNames.resize(F);
+	m_AlphaSizes.resize(F);
+	m_Weights.resize(F);
+	m_LogProbsVec.resize(F);
+	m_MxOffsets.clear();
+	m_LogProbMx.clear();
+	m_LogOddsMx.clear();
+	for (uint f = 0; f < F; ++f)
+		{
+		R.GetStr(m_FeatureNames[f]);
+		const uint A = R.GetUint();
+		m_AlphaSizes[f] = A;
+		R.Get(&m_Weights[f], sizeof(float));
+		R.GetFloats(m_LogProbsVec[f], A);
+		m_MxOffsets.push_back(SIZE(m_LogProbMx));
+		R.GetMx(m_LogProbMx, A);
+		R.GetMx(m_LogOddsMx, A);
+		}
+	m_MxOffsets.push_back(SIZE(m_LogProbMx));
+
+	m_Labels.resize(ProfileCount);
+	m_Seqs.resize(ProfileCount);
+	vector<uint> Ls(ProfileCount);
+	for (uint ProfileIdx = 0; ProfileIdx < ProfileCount; ++ProfileIdx)
+		{
+		const string &Label = m_Labels[ProfileIdx];
+		R.GetStr(m_Labels[ProfileIdx]);
+		const uint L = R.GetUint();
+		string &S = m_Seqs[ProfileIdx];
+		S.resize(L);
+		if (L > 0)
+			R.Get(&S[0], L);
+		Ls[ProfileIdx] = L;
+
+		if (m_LabelToIdx.find(Label) != m_LabelToIdx.end())
+			Die("Duplicate label in mega file >%s", Label.c_str());
+		m_LabelToIdx[Label] = ProfileIdx;
+		IndexSeq(ProfileIdx);
+		}
+
+	AllocProfiles(Ls);
+	if (!m_ProfileData.empty())
+		R.Get(m_ProfileData.data(), m_ProfileData.size());
+	InitFlat();
+	}
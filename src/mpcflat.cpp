@@ -11,16 +11,18 @@ void MPCFlat::Clear()
 	m_MSA = 0;
 	m_Labels.clear();
 	m_LabelToIndex.clear();
+	m_QueryAlpha.Clear();
+	m_QueryProfs.clear();
 	m_Upgma5.Clear();
 	m_GuideTree.Clear();
-	m_DistMx.clear();
+	m_DistMx.Free();
 	m_Pairs.clear();
-	m_PairToIndex.clear();
+	m_PairSeqCount = 0;
 	m_JoinIndexes1.clear();
 	m_JoinIndexes2.clear();
 	m_Weights.clear();
 	FreeSparsePosts();
-	FreeProgMSAs();
+	FreeProgNodes();
 	}
 
 uint MPCFlat::GetMyInputSeqIndex(const string &Label) const
@@ -56,18 +58,6 @@ const byte *MPCFlat::GetBytePtr(uint SeqIndex) const
 	return Ptr;
 	}
 
-uint MPCFlat::GetPairIndex(uint SMI1, uint SMI2) const
-	{
-	//asserta(SMI1 > SMI2);
-	//uint PairIndex = SMI2 + (SMI1*(SMI1 - 1))/2;
-	asserta(SMI1 < SMI2);
-	const pair<uint, uint> Pair(SMI1, SMI2);
-	map<pair<uint, uint>, uint>::const_iterator p = m_PairToIndex.find(Pair);
-	asserta(p != m_PairToIndex.end());
-	uint PairIndex = p->second;
-	return PairIndex;
-	}
-
 const pair<uint, uint> &MPCFlat::GetPair(uint PairIndex) const
 	{
 	assert(PairIndex < SIZE(m_Pairs));
@@ -134,21 +124,31 @@ void MPCFlat::InitSeqs(MultiSequence *InputSeqs)
 			Die("Duplicate label >%s", Label.c_str());
 		m_LabelToIndex[Label] = i;
 		}
+
+	m_QueryAlpha.Clear();
+	m_QueryProfs.clear();
+	if (Mega::m_Loaded)
+		return;
+	for (uint i = 0; i < SeqCount; ++i)
+		m_QueryAlpha.Add(InputSeqs->GetBytePtr(i),
+		  InputSeqs->GetSeqLength(i));
+	m_QueryProfs.resize(SeqCount);
+	for (uint i = 0; i < SeqCount; ++i)
+		m_QueryProfs[i].Init(m_QueryAlpha, InputSeqs->GetBytePtr(i),
+		  InputSeqs->GetSeqLength(i));
 	}
 
 void MPCFlat::InitPairs()
 	{
 	const uint SeqCount = GetSeqCount();
 	m_Pairs.clear();
-	m_PairToIndex.clear();
+	m_PairSeqCount = SeqCount;
 	uint PairIndex = 0;
 	for (uint SeqIndex1 = 0; SeqIndex1 < SeqCount; ++SeqIndex1)
 		for (uint SeqIndex2 = SeqIndex1 + 1; SeqIndex2 < SeqCount; ++SeqIndex2)
 			{
 			const pair<uint, uint> Pair(SeqIndex1, SeqIndex2);
 			m_Pairs.push_back(Pair);
-			assert(m_PairToIndex.find(Pair) == m_PairToIndex.end());
-			m_PairToIndex[Pair] = PairIndex;
 			uint PairIndex2 = GetPairIndex(SeqIndex1, SeqIndex2);
 			asserta(PairIndex2 == PairIndex);
 			++PairIndex;
@@ -161,13 +161,7 @@ void MPCFlat::InitPairs()
 void MPCFlat::InitDistMx()
 	{
 	const uint SeqCount = GetSeqCount();
-	m_DistMx.clear();
-	m_DistMx.resize(SeqCount);
-	for (uint i = 0; i < SeqCount; ++i)
-		{
-		m_DistMx[i].resize(SeqCount, FLT_MAX);
-		m_DistMx[i][i] = 0;
-		}
+	m_DistMx.Alloc(SeqCount, FLT_MAX);
 	}
 
 void MPCFlat::Consistency()
@@ -176,8 +170,25 @@ void MPCFlat::Consistency()
 	if (SeqCount < 3)
 		return;
 
+	if (m_ConsistencyIterCount == 0)
+		return;
+
+	PackSparsePosts();
+	InitConsTiles();
+	InitConsSample();
 	for (uint Iter = 0; Iter < m_ConsistencyIterCount; ++Iter)
 		ConsIter(Iter);
+
+// Old generation is not needed after consistency
+	const uint PairCount = SIZE(m_Pairs);
+	for (uint PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+		GetUpdatedSparsePost(PairIndex).Clear();
+	myfree(m_ArenaProbs2);
+	m_ArenaProbs2 = 0;
+	for (uint i = 0; i < SIZE(m_ConsScratches); ++i)
+		delete m_ConsScratches[i];
+	m_ConsScratches.clear();
+	m_ConsZs.clear();
 	}
 
 void MPCFlat::CalcGuideTree()
@@ -189,6 +200,7 @@ void MPCFlat::CalcGuideTree()
 		}
 
 	m_Upgma5.Init(m_Labels, m_DistMx);
+	m_Upgma5.m_Quiet = m_Quiet;
 	m_Upgma5.FixEADistMx();
 
 	m_Upgma5.Run(LINKAGE_Biased, m_GuideTree);
@@ -238,7 +250,7 @@ void MPCFlat::CalcPosteriors()
 
 	uint PairCount = SIZE(m_Pairs);
 	asserta(PairCount > 0);
-	unsigned ThreadCount = GetRequestedThreadCount();
+	unsigned ThreadCount = GetThreadCount();
 	uint PairCounter = 0;
 #pragma omp parallel for num_threads(ThreadCount)
 	for (int PairIndex = 0; PairIndex < (int) PairCount; ++PairIndex)
@@ -251,14 +263,34 @@ void MPCFlat::CalcPosteriors()
 		}
 	}
 
+// Settings only, not inputs or results
+void MPCFlat::CopyParams(const MPCFlat &rhs)
+	{
+	m_ConsistencyIterCount = rhs.m_ConsistencyIterCount;
+	m_RefineIterCount = rhs.m_RefineIterCount;
+	m_ConsSampleSize = rhs.m_ConsSampleSize;
+	m_RefineBatchSize = rhs.m_RefineBatchSize;
+	m_RefineStopRounds = rhs.m_RefineStopRounds;
+	m_RefineSeed = rhs.m_RefineSeed;
+	m_RefineIterSeeded = rhs.m_RefineIterSeeded;
+	m_ThreadCount = rhs.m_ThreadCount;
+	m_D.m_Disable = rhs.m_D.m_Disable;
+	}
+
 void MPCFlat::Refine()
 	{
 	const uint SeqCount = GetSeqCount();
-	if (SeqCount < 3)
+	if (SeqCount < 3 || m_RefineIterCount == 0)
+		return;
+	if (m_RefineBatchSize > 0)
+		{
+		RefineBatch();
 		return;
+		}
 	for (uint Iter = 0; Iter < m_RefineIterCount; ++Iter)
 		{
-		ProgressStep(Iter, m_RefineIterCount, "Refining");
+		if (!m_Quiet)
+			ProgressStep(Iter, m_RefineIterCount, "Refining");
 		RefineIter();
 		}
 	}
@@ -267,6 +299,7 @@ void MPCFlat::Run_Super4(MultiSequence *ConsensusSeqs)
 	{
 	assert(ConsensusSeqs != 0);
 	Clear();
+	m_OmpLevel = omp_get_level();
 
 	const uint SeqCount = ConsensusSeqs->GetSeqCount();
 	asserta(SeqCount > 1);
@@ -283,10 +316,31 @@ void MPCFlat::Run_Super4(MultiSequence *ConsensusSeqs)
 	}
 
 void MPCFlat::Run(MultiSequence *OriginalInputSeqs)
+	{
+	vector<TREEPERM> TPs(1, m_TreePerm);
+	vector<MultiSequence *> MSAs;
+	RunPerms(OriginalInputSeqs, TPs, MSAs);
+	asserta(SIZE(MSAs) == 1);
+	m_MSA = MSAs[0];
+	}
+
+/***
+One MSA per tree permutation. Posteriors and consistency do not
+depend on the guide tree (sequence weights are all 1), so they are
+computed once and only the guide tree, progressive alignment and
+refinement are repeated for each TREEPERM. Caller owns MSAs.
+***/
+void MPCFlat::RunPerms(MultiSequence *OriginalInputSeqs,
+  const vector<TREEPERM> &TPs, vector<MultiSequence *> &MSAs)
 	{
 	assert(OriginalInputSeqs != 0);
+	const uint TPCount = SIZE(TPs);
+	asserta(TPCount > 0);
+	MSAs.clear();
 	Clear();
+	m_OmpLevel = omp_get_level();
 
+	m_D.m_ThreadCount = GetThreadCount();
 	m_D.Run(*OriginalInputSeqs);
 	m_D.Validate();
 	
@@ -296,17 +350,21 @@ void MPCFlat::Run(MultiSequence *OriginalInputSeqs)
 	const uint SeqCount = UniqueSeqs->GetSeqCount();
 	if (SeqCount == 1)
 		{
-		m_MSA = new MultiSequence;
-		m_MSA->Copy(*OriginalInputSeqs);
+		for (uint i = 0; i < TPCount; ++i)
+			{
+			MultiSequence *MSA = new MultiSequence;
+			MSA->Copy(*OriginalInputSeqs);
+			MSAs.push_back(MSA);
+			}
 		return;
 		}
 	unordered_map<string, vector<string> > RepSeqLabelToDupeLabels;
 	m_D.GetRepLabelToDupeLabels(RepSeqLabelToDupeLabels);
-	const uint DupeCount = SIZE(RepSeqLabelToDupeLabels);
 
 	const uint PairCount = (SeqCount*(SeqCount-1))/2;
 	AllocPairCount(PairCount);
 
+	m_TreePerm = TPs[0];
 	InitSeqs(UniqueSeqs);
 	InitPairs();
 	InitDistMx();
@@ -326,16 +384,146 @@ void MPCFlat::Run(MultiSequence *OriginalInputSeqs)
 	asserta(feq(Sum, SeqCount));
 
 	Consistency();
+	if (TPCount == 1)
+		{
+		AlignPerm(RepSeqLabelToDupeLabels);
+		MSAs.push_back(m_MSA);
+		m_MSA = 0;
+		return;
+		}
+	AlignPerms(TPs, RepSeqLabelToDupeLabels, MSAs);
+	}
+
+// Guide tree for m_TreePerm must be set
+void MPCFlat::AlignPerm(
+  const unordered_map<string, vector<string> > &RepSeqLabelToDupeLabels)
+	{
 	CalcJoinOrder();
 	ProgressiveAlign();
 	Refine();
 	asserta(m_MSA != 0);
 	SortMSA();
-
-	if (DupeCount > 0)
+	if (!RepSeqLabelToDupeLabels.empty())
 		InsertDupes(RepSeqLabelToDupeLabels);
 	}
 
+/***
+Posteriors and consistency are read-only after Consistency(), so
+the TREEPERMs can be aligned concurrently. Each permutation thread
+has its own guide tree, progressive and refinement state: this
+MPCFlat or a worker of the same class that borrows the posteriors
+(NewMPC, InitPermWorker). The number of concurrent permutations is
+capped by free memory (GetPermThreadCount). The remaining threads
+go to the pair-level loops if nested parallelism is enabled
+(OMP_MAX_ACTIVE_LEVELS), otherwise to more permutations.
+
+With one permutation thread the TREEPERMs run in order on this
+MPCFlat, as before. Concurrent permutations seed refinement by
+TREEPERM so their MSAs do not depend on scheduling.
+***/
+void MPCFlat::AlignPerms(const vector<TREEPERM> &TPs,
+  const unordered_map<string, vector<string> > &RepSeqLabelToDupeLabels,
+  vector<MultiSequence *> &MSAs)
+	{
+	const uint TPCount = SIZE(TPs);
+	const uint ThreadCount = GetThreadCount();
+	const uint PermThreads = GetPermThreadCount(TPCount);
+	MSAs.clear();
+	if (PermThreads == 1)
+		{
+		for (uint i = 0; i < TPCount; ++i)
+			{
+			if (i > 0)
+				{
+				m_TreePerm = TPs[i];
+				CalcGuideTree();
+				}
+			AlignPerm(RepSeqLabelToDupeLabels);
+			MSAs.push_back(m_MSA);
+			m_MSA = 0;
+			}
+		return;
+		}
+
+	const bool Nested = (omp_get_max_active_levels() >= m_OmpLevel + 2);
+	const uint PairThreads = Nested ? max(1u, ThreadCount/PermThreads) : 1;
+	Log("AlignPerms %u perms, %u perm threads x %u pair threads\n",
+	  TPCount, PermThreads, PairThreads);
+
+// Progress state is global, permutation threads run quiet
+	vector<MPCFlat *> Workers(PermThreads, 0);
+	for (uint i = 0; i < PermThreads; ++i)
+		{
+		Workers[i] = NewMPC();
+		Workers[i]->InitPermWorker(*this);
+		Workers[i]->m_ThreadCount = PairThreads;
+		Workers[i]->m_RefineIterSeeded = true;
+		Workers[i]->m_Quiet = true;
+		}
+
+	MSAs.resize(TPCount, 0);
+#pragma omp parallel for num_threads(PermThreads) schedule(dynamic, 1)
+	for (int i = 0; i < (int) TPCount; ++i)
+		{
+		MPCFlat &M = *Workers[GetThreadIndex()];
+		M.m_OmpLevel = omp_get_level();
+		M.m_TreePerm = TPs[i];
+		M.m_RefineIterState = HashMix32(m_RefineSeed, uint32(TPs[i]));
+		M.CalcGuideTree();
+		M.AlignPerm(RepSeqLabelToDupeLabels);
+		MSAs[i] = M.m_MSA;
+		M.m_MSA = 0;
+		}
+
+	for (uint i = 0; i < PermThreads; ++i)
+		delete Workers[i];
+	}
+
+// Concurrent permutations each hold a copy of the distance matrix
+// (UPGMA5) and the DP buffers of their largest join, estimated as
+// 2 x longest sequence columns per side.
+uint MPCFlat::GetPermThreadCount(uint TPCount) const
+	{
+	const uint n = min(TPCount, GetThreadCount());
+	if (n <= 1)
+		return 1;
+
+	const uint SeqCount = GetSeqCount();
+	uint MaxL = 0;
+	for (uint i = 0; i < SeqCount; ++i)
+		MaxL = max(MaxL, GetSeqLength(i));
+	const double ColCount = 2.0*MaxL;
+	const double PermBytes =
+	  double(TriDistMx::GetTriangleSize(SeqCount))*sizeof(float) +
+	  ColCount*ColCount*(sizeof(float) + sizeof(char));
+	const double FreeBytes = 0.8*GetUsableMemBytes() - GetMemUseBytes();
+	if (FreeBytes < 2*PermBytes)
+		return 1;
+	return min(n, uint(FreeBytes/PermBytes));
+	}
+
+// Worker for AlignPerms: shares Owner's input, weights, distance
+// matrix and posteriors (not freed by this MPCFlat). Posteriors are
+// not recomputed, so m_QueryProfs is left empty.
+void MPCFlat::InitPermWorker(const MPCFlat &Owner)
+	{
+	Clear();
+	CopyParams(Owner);
+	m_SharedPosts = true;
+	m_OriginalInputSeqs = Owner.m_OriginalInputSeqs;
+	m_MyInputSeqs = Owner.m_MyInputSeqs;
+	m_Labels = Owner.m_Labels;
+	m_LabelToIndex = Owner.m_LabelToIndex;
+	m_Weights = Owner.m_Weights;
+	m_PairSeqCount = Owner.m_PairSeqCount;
+	m_DistMx.SetView(Owner.m_DistMx.GetN(), Owner.m_DistMx.m_Data,
+	  Owner.m_DistMx.m_Diag);
+	m_SparsePosts1 = *Owner.m_ptrSparsePosts;
+	m_SparsePosts2.clear();
+	m_ptrSparsePosts = &m_SparsePosts1;
+	m_ptrUpdatedSparsePosts = &m_SparsePosts2;
+	}
+
 void MPCFlat::SortMSA()
 	{
 	if (opt(input_order))
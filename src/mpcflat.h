@@ -7,11 +7,71 @@
 #include "mysparsemx.h"
 #include "derep.h"
 #include "clustalweights.h"
+#include "queryprof.h"
 #include <unordered_map>
 
 static const uint DEFAULT_CONSISTENCY_ITERS_FLAT = 2;
 static const uint DEFAULT_REFINE_ITERS_FLAT = 100;
 
+// Max pairs per consistency tile, and max dense post floats per tile
+static const uint CONS_TILE_PAIRS = 8;
+static const uint64 CONS_TILE_FLOATS = 16*1024*1024;
+
+// Refinement accepts a candidate only if the cross-group score
+// improves by more than this fraction
+static const float REFINE_MIN_GAIN = 1e-5f;
+
+// BuildPost splits rows over threads if at least this many seq pairs
+static const uint64 BUILDPOST_PARALLEL_PAIRS = 64;
+
+// Per-thread scratch for MPCFlat::ConsTile
+class ConsScratch
+	{
+public:
+	float *m_Posts = 0;
+	uint64 m_MaxPostsSize = 0;
+	MySparseMx m_T;
+
+// Sampled consistency, Z's used by the tile and bit t set
+// in m_ZMask[Z] if pair t uses Z
+	vector<uint> m_ZList;
+	vector<byte> m_ZMask;
+
+public:
+	~ConsScratch()
+		{
+		myfree(m_Posts);
+		}
+
+	float *GetPosts(uint64 Size)
+		{
+		if (Size > m_MaxPostsSize)
+			{
+			myfree(m_Posts);
+			m_MaxPostsSize = Size;
+			m_Posts = myalloc(float, Size);
+			}
+		return m_Posts;
+		}
+	};
+
+/***
+Progressive alignment node without gapped rows. For each member,
+m_SMIs is its index in m_MyInputSeqs and m_PosToCols maps its
+letters to columns. A join moves the members of both children
+into the parent and maps their columns through the join path in
+place, so it costs O(letters) rather than O(rows x columns), and
+the gapped MSA is materialized only at the root (MakeProgMSA).
+Members are in the same order as the rows of the equivalent MSA.
+***/
+class ProgNode
+	{
+public:
+	uint m_ColCount = 0;
+	vector<uint> m_SMIs;
+	vector<vector<uint> > m_PosToCols;
+	};
+
 // Multi-threaded ProbCons, flat memory layout
 class MPCFlat
 	{
@@ -25,20 +85,59 @@ public:
 
 	uint m_ConsistencyIterCount = DEFAULT_CONSISTENCY_ITERS_FLAT;
 	uint m_RefineIterCount = DEFAULT_REFINE_ITERS_FLAT;
+
+// Consistency uses at most this many Z per sequence, 0=all
+	uint m_ConsSampleSize = 0;
+
+// Refinement evaluates this many bipartitions per round in parallel,
+// 0=serial RefineIter. Stop after m_RefineStopRounds rounds without
+// improvement, 0=never.
+	uint m_RefineBatchSize = 0;
+	uint m_RefineStopRounds = 0;
+	uint m_RefineSeed = 1;
+
+// Serial RefineIter draws bipartitions from rand() unless
+// m_RefineIterSeeded, then from m_RefineIterState (independent
+// of other MPCFlat instances running concurrently).
+	bool m_RefineIterSeeded = false;
+	uint32 m_RefineIterState = 0;
+
+// Threads for pair-level loops, 0=GetRequestedThreadCount()
+	uint m_ThreadCount = 0;
+
+// omp_get_level() when Run/Run_Super4 was entered, e.g. 1 in a
+// Super7 shrub thread. Regions nested deeper than this are already
+// parallel within this MPCFlat, so BuildPost does not split again.
+	int m_OmpLevel = 0;
+
+// Posteriors are borrowed from another MPCFlat (InitPermWorker)
+	bool m_SharedPosts = false;
+
+// No progress steps for guide tree, progressive alignment and
+// refinement, set while TREEPERMs run concurrently (AlignPerms).
+	bool m_Quiet = false;
+
 	TREEPERM m_TreePerm = TP_None;
 	vector<string> m_Labels;
 	unordered_map<string, uint> m_LabelToIndex;
+
+// m_QueryProfs[SeqIndex] is m_MyInputSeqs[SeqIndex] under the
+// alphabet of all m_MyInputSeqs, built once by InitSeqs and used
+// by CalcPosterior (empty if Mega::m_Loaded).
+	QueryAlpha m_QueryAlpha;
+	vector<QueryProf> m_QueryProfs;
+
 	UPGMA5 m_Upgma5;
 	Tree m_GuideTree;
-	vector<MultiSequence *> m_ProgMSAs;
+	vector<ProgNode *> m_ProgNodes;
 	Derep m_D;
 
 	ClustalWeights m_CW;
 	vector<float> m_Weights;
 
-	vector<vector<float> > m_DistMx;
+	TriDistMx m_DistMx;
 	vector<pair<uint, uint> > m_Pairs;
-	map<pair<uint, uint>, uint> m_PairToIndex;
+	uint m_PairSeqCount = 0;
 	vector<uint> m_JoinIndexes1;
 	vector<uint> m_JoinIndexes2;
 
@@ -48,18 +147,43 @@ public:
 	vector<MySparseMx *> *m_ptrSparsePosts = &m_SparsePosts1;
 	vector<MySparseMx *> *m_ptrUpdatedSparsePosts = &m_SparsePosts2;
 
+// Consistency arena, CSR for all pairs. Offsets and columns are
+// shared by both generations, see PackSparsePosts.
+	uint *m_ArenaOffsets = 0;
+	uint *m_ArenaCols = 0;
+	float *m_ArenaProbs1 = 0;
+	float *m_ArenaProbs2 = 0;
+	vector<uint> m_ConsTileStarts;
+	vector<vector<uint> > m_ConsZs;
+	vector<ConsScratch *> m_ConsScratches;
+
 public:
-	~MPCFlat()
+	virtual ~MPCFlat()
 		{
 		Clear();
 		}
 
 	void Clear();
 	void Run(MultiSequence *InputSeqs);
+	void RunPerms(MultiSequence *InputSeqs, const vector<TREEPERM> &TPs,
+	  vector<MultiSequence *> &MSAs);
 	uint GetSeqCount() const;
+	void CopyParams(const MPCFlat &rhs);
+	void InitPermWorker(const MPCFlat &Owner);
+	uint GetPermThreadCount(uint TPCount) const;
+	void AlignPerm(
+	  const unordered_map<string, vector<string> > &RepSeqLabelToDupeLabels);
+	void AlignPerms(const vector<TREEPERM> &TPs,
+	  const unordered_map<string, vector<string> > &RepSeqLabelToDupeLabels,
+	  vector<MultiSequence *> &MSAs);
+	uint GetThreadCount() const
+		{
+		return m_ThreadCount == 0 ? GetRequestedThreadCount() : m_ThreadCount;
+		}
 	void Run_Super4(MultiSequence *InputSeqs);
 
 public:
+	virtual MPCFlat *NewMPC() const { return new MPCFlat; }
 	virtual void CalcFwdFlat_MPCFlat(uint GSIX, uint LX,
 	  uint GSIY, uint LY, float *Flat);
 	virtual void CalcBwdFlat_MPCFlat(uint GSIX, uint LX,
@@ -67,7 +191,7 @@ public:
 
 public:
 	void AllocPairCount(uint SeqCount);
-	void FreeProgMSAs();
+	void FreeProgNodes();
 	void FreeSparsePosts();
 	void InitSeqs(MultiSequence *InputSeqs);
 	void InitPairs();
@@ -76,23 +200,50 @@ public:
 	void CalcPosteriors();
 	void Consistency();
 	void ConsIter(uint Iter);
-	void ConsPair(uint PairIndex);
+	void ConsTile(uint TileIndex, ConsScratch &Scratch);
+	void PackSparsePosts();
+	void FreeArena();
+	void InitConsTiles();
+	void InitConsSample();
 	void CalcGuideTree();
 	void CalcGuideTree_RandomChain();
 	void CalcJoinOrder();
 	void ProgressiveAlign();
 	void Refine();
 	void RefineIter();
+	void RefineBatch();
+	MultiSequence *RefineCandidate(uint CandidateIndex, float &Gain);
 	void ProgAln(uint JoinIndex);
+	void ProgAlnSqueeze(const ProgNode &Node1, const ProgNode &Node2,
+	  ProgNode &Node12);
+	MultiSequence *MakeProgMSA(const ProgNode &Node) const;
+	void ProgNodeFromMSA(const MultiSequence &MSA, ProgNode &Node) const;
 	const pair<uint, uint> &GetPair(uint PairIndex) const;
 	const char *GetLabel(uint SeqIndex) const;
 	uint GetMyInputSeqIndex(const string &Label) const;
 	const byte *GetBytePtr(uint SeqIndex) const;
-	uint GetPairIndex(uint SMI1, uint SMI2) const;
+
+// Same order as InitPairs: (0,1), (0,2) ... (0,N-1), (1,2) ...
+	uint GetPairIndex(uint SMI1, uint SMI2) const
+		{
+		asserta(SMI1 < SMI2 && SMI2 < m_PairSeqCount);
+		uint64 N = m_PairSeqCount;
+		uint64 Row = SMI1;
+		return uint((Row*(2*N - Row - 1))/2 + (SMI2 - SMI1 - 1));
+		}
+
 	MySparseMx &GetSparsePost(uint PairIndex);
 	MySparseMx &GetUpdatedSparsePost(uint PairIndex);
 	void BuildPost(const MultiSequence &MSA1, const MultiSequence &MSA2,
 	  float *Post);
+	void BuildPost(const vector<uint> &SMIs1, const vector<uint> &SMIs2,
+	  const vector<vector<uint> > &PosToCols1,
+	  const vector<vector<uint> > &PosToCols2, uint ColCount1,
+	  uint ColCount2, float *Post);
+	void BuildPostRows(const vector<uint> &SMIs1, const vector<uint> &SMIs2,
+	  const vector<vector<uint> > &PosToCols1,
+	  const vector<vector<uint> > &PosToCols2, uint ColLo, uint ColHi,
+	  uint ColCount2, float *Post);
 	uint GetSeqLength(uint SeqIndex) const;
 	const Sequence *GetSequence(uint SeqIndex) const;
 	MultiSequence *AlignAlns(const MultiSequence *MSA1,
@@ -110,11 +261,32 @@ float *AllocDPRows(uint LX, uint LY);
 char *AllocTB(uint LX, uint LY);
 
 float CalcTotalProbFlat(const float *FlatFwd, const float *FlatBwd, uint LX, uint LY);
-void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat);
-void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat);
+void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX, const QueryProf *PY);
+void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX, const QueryProf *PY);
 float CalcAlnScoreFlat(const float *Post, uint LX, uint LY, float *DPRows);
+float CalcAlnScoreSparse(const MySparseMx &Mx);
+void CalcSparsePost_LinMem(const byte *X, uint LX, const byte *Y, uint LY,
+  MySparseMx &SparsePost, const QueryProf *PX = 0,
+  const QueryProf *PY = 0);
+bool CalcSparsePost_Banded(const byte *X, uint LX, const byte *Y, uint LY,
+  MySparseMx &SparsePost);
 float CalcAlnFlat(const float *Post, uint LX, uint LY,
   float *DPRows, char *TB, string &Path);
+MultiSequence *AlignAlnsFromPath(const MultiSequence *MSA1,
+  const MultiSequence *MSA2, const string &Path);
+
+// Deterministic mixing for seeded sampling, independent of thread count
+static inline uint32 HashMix32(uint32 a, uint32 b)
+	{
+	uint64 x = (uint64(a) << 32) | b;
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+	x ^= (x >> 31);
+	return uint32(x);
+	}
 
 void RelaxFlat_XZ_ZY(const MySparseMx &XZ, const MySparseMx &ZY,
   float WeightZ, float *Post);
@@ -110,8 +110,8 @@
 void MPCFlat_mega::CalcFwdFlat_MPCFlat(uint GSIX, uint LX,
   uint GSIY, uint LY, float *Flat)
 	{
-	const vector<vector<byte> > &ProfileX = *Mega::GetProfileByGSI(GSIX);
-	const vector<vector<byte> > &ProfileY = *Mega::GetProfileByGSI(GSIY);
+	const MegaProfile &ProfileX = *Mega::GetProfileByGSI(GSIX);
+	const MegaProfile &ProfileY = *Mega::GetProfileByGSI(GSIY);
 	asserta(SIZE(ProfileX) == LX);
 	asserta(SIZE(ProfileY) == LY);
     Mega::CalcFwdFlat_mega(ProfileX, ProfileY, Flat);
@@ -120,8 +120,8 @@ void MPCFlat_mega::CalcFwdFlat_MPCFlat(uint GSIX, uint LX,
 void MPCFlat_mega::CalcBwdFlat_MPCFlat(uint GSIX, uint LX,
   uint GSIY, uint LY, float *Flat)
 	{
-	const vector<vector<byte> > &ProfileX = *Mega::GetProfileByGSI(GSIX);
-	const vector<vector<byte> > &ProfileY = *Mega::GetProfileByGSI(GSIY);
+	const MegaProfile &ProfileX = *Mega::GetProfileByGSI(GSIX);
+	const MegaProfile &ProfileY = *Mega::GetProfileByGSI(GSIY);
 	asserta(SIZE(ProfileX) == LX);
 	asserta(SIZE(ProfileY) == LY);
     Mega::CalcBwdFlat_mega(ProfileX, ProfileY, Flat);
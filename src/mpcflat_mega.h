@@ -9,6 +9,7 @@
 class MPCFlat_mega : public MPCFlat
     {
 public:
+	virtual MPCFlat *NewMPC() const { return new MPCFlat_mega; }
 	virtual void CalcFwdFlat_MPCFlat(uint GSIX, uint LX,
 	  uint GSIY, uint LY, float *Flat);
 	virtual void CalcBwdFlat_MPCFlat(uint GSIX, uint LX,
@@ -114,8 +114,14 @@ void InitProbcons();
 void AlignMSAsByPath(const MultiSequence &MSA1, const MultiSequence &MSA2,
   const string &Path, MultiSequence &MSA12);
 
-void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat);
-void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat);
+void CalcFwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX = 0, const QueryProf *PY = 0);
+void CalcBwdFlat(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX = 0, const QueryProf *PY = 0);
+void CalcFwdFlat_Vec(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX = 0, const QueryProf *PY = 0);
+void CalcBwdFlat_Vec(const byte *X, uint LX, const byte *Y, uint LY, float *Flat,
+  const QueryProf *PX = 0, const QueryProf *PY = 0);
 
 void CalcPostFlat(const float *FlatFwd, const float *FlatBwd,
   uint LX, uint LY, float *Post);
@@ -155,6 +161,7 @@ void GetKimuraDistMx(const MultiSequence &MSA,
 void GetKimuraDistMx_Viterbi(const MultiSequence &MS,
   vector<vector<float> > &DistMx);
 class PathInfo;
+class QueryProf;
 void LogAln(const byte *X, uint LX, const byte *Y, uint LY, const PathInfo &PI);
 bool GetNextEnumGrid(const vector<uint> &Sizes, vector<uint> &Indexes);
 
@@ -178,6 +185,8 @@ const byte *GetByteSeqByGSI(uint GSI);
 void LoadInput(MultiSequence &InputSeqs);
 //float *CalcPost(uint GSIX, uint GSIY);
 float *CalcPost(const string &Label1, const string &Label2);
+float *CalcPost(const byte *X, uint LX, const byte *Y, uint LY,
+  const QueryProf *PX = 0, const QueryProf *PY = 0);
 
 void WriteLocalAln(FILE *f, const string &LabelA, const byte *A,
   const string &LabelB, const byte *B,
@@ -14,10 +14,11 @@ void Muscle3::Run(const M3AlnParams &AP, const MultiSequence &InputSeqs)
 	const uint SeqCount = InputSeqs.GetSeqCount();
 
 	const string &KD = m_AP->m_KmerDist;
+	TriDistMx KmerDistMx;
 	if (KD == "66")
-		m_K66.GetDistMx(InputSeqs, m_DistMx);
+		m_K66.GetDistMx(InputSeqs, KmerDistMx);
 	else if (KD == "33")
-		m_K33.GetDistMx(InputSeqs, m_DistMx);
+		m_K33.GetDistMx(InputSeqs, KmerDistMx);
 	else
 		Die("Muscle3::Run, m_AP->m_KmerDist=%s", KD.c_str());
 
@@ -28,10 +29,11 @@ void Muscle3::Run(const M3AlnParams &AP, const MultiSequence &InputSeqs)
 		m_Labels.push_back(Label);
 		}
 #if DOSC
+	KmerDistMx.ToVecVec(m_DistMx);
 	m_SC.Run(m_DistMx, m_Labels, m_AP->m_Linkage, false);
 	m_SC.GetTree(m_GuideTree);
 #else
-	m_U5.Init(m_Labels, m_DistMx);
+	m_U5.InitSwap(m_Labels, KmerDistMx);
 	m_U5.Run(AP.m_Linkage, m_GuideTree);
 #endif
 	m_CW.Run(InputSeqs, m_GuideTree, m_InputSeqWeights);
@@ -161,8 +161,6 @@ void LogAllocs()
 	  MultiSequence::m_NewCount, MultiSequence::m_DeleteCount);
 	Log("Profile3 new %u, delete %u\n",
 	  Profile3::m_NewCount, Profile3::m_DeleteCount);
-	Log("ProfPos3 new %u, delete %u\n",
-	  ProfPos3::m_NewCount, ProfPos3::m_DeleteCount);
 	ProgressLog("\n****** TOTAL LEAK %s *******\n\n", 
 	  MemBytesToStr(SumLeak));
 	ObjMgr::LogGlobalStats();
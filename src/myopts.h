@@ -86,7 +86,15 @@ UNS_OPT(blosumparamset)
 UNS_OPT(warmup_pct)
 UNS_OPT(treeiters)
 UNS_OPT(shrub_size)
+UNS_OPT(shrub_threads)
 UNS_OPT(mincol)
+UNS_OPT(bandpad)
+UNS_OPT(consz)
+UNS_OPT(refinebatch)
+UNS_OPT(refinestop)
+UNS_OPT(mbed_clustersize)
+UNS_OPT(uclustbatch)
+UNS_OPT(usorter_syncmer)
 
 FLT_OPT(min_cons_pct)
 FLT_OPT(max_gap_fract)
@@ -99,6 +107,7 @@ FLT_OPT(super4_minea2)
 FLT_OPT(pctid)
 FLT_OPT(perturb_var)
 FLT_OPT(minconf)
+FLT_OPT(minscore)
 FLT_OPT(maxpd)
 FLT_OPT(shrink)
 
@@ -142,7 +151,13 @@ FLAG_OPT(missingtestfileok)
 FLAG_OPT(bysequence)
 FLAG_OPT(reseek)
 FLAG_OPT(mega)
+FLAG_OPT(megacache)
 FLAG_OPT(squeeze)
+FLAG_OPT(vecfb)
+FLAG_OPT(linmem)
+FLAG_OPT(band)
+FLAG_OPT(half)
+FLAG_OPT(mbed)
 
 #undef FLAG_OPT
 #undef UNS_OPT
@@ -3,14 +3,21 @@
 
 void MySparseMx::AllocVec(uint Size)
 	{
+	asserta(!m_View);
 	if (Size <= m_MaxVecSize)
 		return;
+// Exact size on first allocation, most matrices are filled once
+	uint Slack = 0;
 	if (m_MaxVecSize > 0)
-		myfree(m_ValueVec);
+		{
+		myfree(m_Probs);
+		myfree(m_Cols);
+		Slack = 256;
+		}
 
-	m_MaxVecSize = Size + 256;
-	asserta(sizeof(float) == 4 && sizeof(uint) == 4);
-	m_ValueVec = myalloc(byte, m_MaxVecSize*8);
+	m_MaxVecSize = Size + Slack;
+	m_Probs = myalloc(float, m_MaxVecSize);
+	m_Cols = myalloc(uint, m_MaxVecSize);
 	}
 
 float MySparseMx::GetMaxProbRow(uint i) const
@@ -47,13 +54,9 @@ float MySparseMx::GetProb(uint i, uint j) const
 	uint Size = GetSize(i);
 	for (uint k = 0; k < Size; ++k)
 		{
-		const uint *ptr_j = (uint *) (m_ValueVec + 8*Offset + 4);
-		uint j2 = *ptr_j;
+		uint j2 = m_Cols[Offset];
 		if (j2 == j)
-			{
-			const float *ptr_P = (float *) (m_ValueVec + 8*Offset);
-			return *ptr_P;
-			}
+			return m_Probs[Offset];
 		else if (j2 > j)
 			return 0;
 		++Offset;
@@ -66,13 +69,28 @@ void MySparseMx::AllocLX(uint LX)
 #if 0//TRACE
 	Log("%p->AllocLX(%u) max %u\n", this, LX, m_MaxLX);
 #endif
+// Storage of a view belongs to the arena, start over
+	if (m_View)
+		{
+		m_Probs = 0;
+		m_Cols = 0;
+		m_Offsets = 0;
+		m_MaxVecSize = 0;
+		m_MaxLX = 0;
+		m_View = false;
+		}
+
 	if (LX <= m_MaxLX)
 		return;
 
+	uint Slack = 0;
 	if (m_MaxLX > 0)
+		{
 		myfree(m_Offsets);
+		Slack = 128;
+		}
 
-	m_MaxLX = LX + 128;
+	m_MaxLX = LX + Slack;
 	m_Offsets = myalloc(uint, m_MaxLX+1);
 #if 0//TRACE
 	Log("%p->AllocLX(%u) newmax %u m_Offsets=%p\n", this, LX, m_MaxLX, m_Offsets);
@@ -90,10 +108,29 @@ void MySparseMx::UpdateFromPost(const MySparseMx &OldMx,
 	uint VecSize = OldMx.m_VecSize;
 	uint LX = OldMx.GetLX();
 	uint LY = OldMx.GetLY();
+
+// Arena views of both generations share offsets and columns,
+// only the probabilities change.
+	if (m_View && m_Cols == OldMx.m_Cols)
+		{
+		asserta(m_Offsets == OldMx.m_Offsets);
+		asserta(m_LX == LX && m_LY == LY && m_VecSize == VecSize);
+		for (uint i = 0; i < LX; ++i)
+			{
+			const uint Lo = m_Offsets[i];
+			const uint Hi = m_Offsets[i+1];
+			const float *PostRow = Post + i*LY;
+			for (uint k = Lo; k < Hi; ++k)
+				m_Probs[k] = PostRow[m_Cols[k]]/SeqCount;
+			}
+		return;
+		}
+
 	AllocLX(LX);
 	AllocVec(VecSize);
 	m_LX = LX;
 	m_LY = LY;
+	m_VecSize = VecSize;
 	for (uint i = 0; i < LX; ++i)
 		m_Offsets[i] = OldMx.m_Offsets[i];
 	m_Offsets[LX] = OldMx.m_Offsets[LX];
@@ -112,9 +149,58 @@ void MySparseMx::UpdateFromPost(const MySparseMx &OldMx,
 		}
 	}
 
+void MySparseMx::SetView(uint LX, uint LY, uint VecSize, uint *Offsets,
+  uint *Cols, float *Probs)
+	{
+	Clear();
+	m_View = true;
+	m_LX = LX;
+	m_LY = LY;
+	m_VecSize = VecSize;
+	m_MaxVecSize = VecSize;
+	m_MaxLX = LX;
+	m_Offsets = Offsets;
+	m_Cols = Cols;
+	m_Probs = Probs;
+	}
+
+// T[j][i] = this[i][j]
+void MySparseMx::Transpose(MySparseMx &T) const
+	{
+	T.AllocLX(m_LY);
+	T.AllocVec(m_VecSize);
+	T.m_LX = m_LY;
+	T.m_LY = m_LX;
+	T.m_VecSize = m_VecSize;
+
+	uint *Offsets = T.m_Offsets;
+	for (uint j = 0; j <= m_LY; ++j)
+		Offsets[j] = 0;
+	for (uint k = 0; k < m_VecSize; ++k)
+		++Offsets[m_Cols[k] + 1];
+	for (uint j = 0; j < m_LY; ++j)
+		Offsets[j+1] += Offsets[j];
+
+// Offsets[j] is used as a fill pointer then restored
+	for (uint i = 0; i < m_LX; ++i)
+		{
+		const uint Lo = m_Offsets[i];
+		const uint Hi = m_Offsets[i+1];
+		for (uint k = Lo; k < Hi; ++k)
+			{
+			uint j = m_Cols[k];
+			uint Offset = Offsets[j]++;
+			T.m_Probs[Offset] = m_Probs[k];
+			T.m_Cols[Offset] = i;
+			}
+		}
+	for (uint j = m_LY; j > 0; --j)
+		Offsets[j] = Offsets[j-1];
+	Offsets[0] = 0;
+	}
+
 void MySparseMx::FromPost(const float *Post, uint LX, uint LY)
 	{
-	asserta(sizeof(float) == sizeof(uint));
 	m_LX = LX;
 	m_LY = LY;
 
@@ -140,10 +226,8 @@ void MySparseMx::FromPost(const float *Post, uint LX, uint LY)
 			float P = Post[i*LY + j];
 			if (P >= MIN_SPARSE_PROB)
 				{
-				float *ptr_P = (float *) (m_ValueVec + 8*Offset);
-				uint *ptr_j = (uint *) (m_ValueVec + 8*Offset + 4);
-				*ptr_P = P;
-				*ptr_j = j;
+				SetProb_Offset(Offset, P);
+				SetCol_Offset(Offset, j);
 				++Offset;
 				}
 			}
@@ -151,6 +235,39 @@ void MySparseMx::FromPost(const float *Post, uint LX, uint LY)
 	asserta(Offset == m_VecSize);
 	}
 
+// Row i has RowSizes[i] entries starting at Probs[RowStarts[i]],
+// Cols[RowStarts[i]]; rows need not be in order in Probs/Cols.
+void MySparseMx::FromRows(uint LX, uint LY, const vector<uint> &RowStarts,
+  const vector<uint> &RowSizes, const vector<float> &Probs,
+  const vector<uint> &Cols)
+	{
+	asserta(SIZE(RowStarts) == LX);
+	asserta(SIZE(RowSizes) == LX);
+	asserta(SIZE(Probs) == SIZE(Cols));
+	m_LX = LX;
+	m_LY = LY;
+
+	AllocLX(LX);
+	m_VecSize = SIZE(Probs);
+	AllocVec(m_VecSize);
+
+	uint Offset = 0;
+	for (uint i = 0; i < LX; ++i)
+		{
+		m_Offsets[i] = Offset;
+		const uint Start = RowStarts[i];
+		const uint Size = RowSizes[i];
+		for (uint k = 0; k < Size; ++k)
+			{
+			SetProb_Offset(Offset, Probs[Start + k]);
+			SetCol_Offset(Offset, Cols[Start + k]);
+			++Offset;
+			}
+		}
+	m_Offsets[LX] = Offset;
+	asserta(Offset == m_VecSize);
+	}
+
 void MySparseMx::LogStats(const char *Msg) const
 	{
 	Log("MySparseMx(%s) LX=%u, LY=%u VecSize=%u\n",
@@ -173,9 +290,7 @@ void MySparseMx::LogMe() const
 		Log("  [size %5u]", Size);
 		for (uint k = 0; k < Size; ++k)
 			{
-			const float *ptr_P = (float *) (m_ValueVec + 8*Offset);
-			const uint *ptr_j = (uint *) (m_ValueVec + 8*Offset + 4);
-			Log(" %u=%.3g", *ptr_j, *ptr_P);
+			Log(" %u=%.3g", GetCol_Offset(Offset), GetProb_Offset(Offset));
 			++Offset;
 			}
 		Log("\n");
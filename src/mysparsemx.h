@@ -3,6 +3,10 @@
 const float MIN_SPARSE_PROB = 0.01f;
 const float MIN_SPARSE_SCORE = logf(MIN_SPARSE_PROB); // -4.6
 
+// Row i has entries m_Offsets[i] .. m_Offsets[i+1]-1 in m_Probs
+// and m_Cols, columns in increasing order. If m_View is true the
+// storage belongs to an arena (see MPCFlat::PackSparsePosts) and
+// is not freed by Clear().
 class MySparseMx
 	{
 public:
@@ -11,11 +15,14 @@ public:
 	uint m_VecSize = 0;
 
 	uint m_MaxVecSize = 0;
-	byte *m_ValueVec = 0;
+	float *m_Probs = 0;
+	uint *m_Cols = 0;
 
 	uint m_MaxLX = 0;
 	uint *m_Offsets = 0;
 
+	bool m_View = false;
+
 	const byte *m_X = 0;
 	const byte *m_Y = 0;
 
@@ -27,11 +34,14 @@ public:
 		m_VecSize = 0;
 
 		m_MaxVecSize = 0;
-		m_ValueVec = 0;
+		m_Probs = 0;
+		m_Cols = 0;
 
 		m_MaxLX = 0;
 		m_Offsets = 0;
 
+		m_View = false;
+
 		m_X = 0;
 		m_Y = 0;
 		}
@@ -42,48 +52,54 @@ public:
 
 	void Clear()
 		{
-		myfree(m_ValueVec);
-		myfree(m_Offsets);
-		m_ValueVec = 0;
+		if (!m_View)
+			{
+			myfree(m_Probs);
+			myfree(m_Cols);
+			myfree(m_Offsets);
+			}
+		m_Probs = 0;
+		m_Cols = 0;
 		m_Offsets = 0;
 		m_MaxVecSize = 0;
 		m_MaxLX = 0;
 		m_VecSize = 0;
 		m_LX = 0;
 		m_LY = 0;
+		m_View = false;
 		}
 
 	float GetProb_Offset(uint Offset) const
 		{
-		const float *ptr_P = (float *) (m_ValueVec + 8*Offset);
-		float P = *ptr_P;
-		return P;
+		return m_Probs[Offset];
 		}
 
 	uint GetCol_Offset(uint Offset) const
 		{
-		const uint *ptr_j = (uint *) (m_ValueVec + 8*Offset + 4);
-		uint Col = *ptr_j;
-		return Col;
+		return m_Cols[Offset];
 		}
 
 	void SetProb_Offset(uint Offset, float P)
 		{
-		float *ptr_P = (float *) (m_ValueVec + 8*Offset);
-		*ptr_P = P;
+		m_Probs[Offset] = P;
 		}
 
 	void SetCol_Offset(uint Offset, uint Col) const
 		{
-		uint *ptr_j = (uint *) (m_ValueVec + 8*Offset + 4);
-		*ptr_j = Col;
+		m_Cols[Offset] = Col;
 		}
 
 	void AllocLX(uint LX);
 	void AllocVec(uint Size);
 	void FromPost(const float *Post, uint LX, uint LY);
+	void FromRows(uint LX, uint LY, const vector<uint> &RowStarts,
+	  const vector<uint> &RowSizes, const vector<float> &Probs,
+	  const vector<uint> &Cols);
 	void UpdateFromPost(const MySparseMx &OldMx,
 	  const float *Post, uint SeqCount);
+	void SetView(uint LX, uint LY, uint VecSize, uint *Offsets,
+	  uint *Cols, float *Probs);
+	void Transpose(MySparseMx &T) const;
 	void GetColToRowLoHi(vector<uint> &ColToRowLo, vector<uint> &ColToRowHi) const;
 	void ToPost(float *Post) const;
 	float GetProb(uint i, uint j) const;
@@ -408,11 +408,9 @@ void ReadStdioFile(FILE *f, uint32 Pos, void *Buffer, uint32 Bytes)
 void ReadStdioFile64(FILE *f, uint64 Pos, void *Buffer, uint64 Bytes)
 	{
 	asserta(f != 0);
-	uint32 Bytes32 = (uint32) Bytes;
-	asserta(Bytes32 == Bytes);
 	SetStdioFilePos64(f, Pos);
-	uint64 ElementsRead = (uint64) fread(Buffer, Bytes32, 1, f);
-	if (ElementsRead != Bytes)
+	size_t ElementsRead = fread(Buffer, Bytes, 1, f);
+	if (ElementsRead != 1)
 		{
 		LogStdioFileState(f);
 		Die("ReadStdioFile64 failed, attempted %lu bytes, errno=%d",
@@ -3,7 +3,7 @@
 #include "cachemem3.h"
 #include "m3alnparams.h"
 
-void BitTraceBack(char **TraceBack, uint uLengthA, uint uLengthB,
+void BitTraceBack(const char *TraceBack, uint uLengthA, uint uLengthB,
   char LastEdge, string &Path);
 
 //static float ScoreProfPos2_LE(const ProfPos3 &PPA, const ProfPos3 &PPB)
@@ -55,6 +55,67 @@ float ScoreProfPos2(const ProfPos3 &PPA, const ProfPos3 &PPB)
 	return Score;
 	}
 
+// Same as ScoreProfPos2 on columns of Profile3
+float ScoreProfCols3(const Profile3 &ProfA, uint ColA,
+  const Profile3 &ProfB, uint ColB)
+	{
+	const byte *SortOrderA = ProfA.GetSortOrder(ColA);
+	const float *FreqsA = ProfA.GetFreqs(ColA);
+	const float *AAScoresB = ProfB.m_AAScores + ColB;
+	const uint ColCountB = ProfB.GetColCount();
+	float Score = 0;
+	for (uint n = 0; n < g_AlphaSize; ++n)
+		{
+		const byte Letter = SortOrderA[n];
+		const float FreqA = FreqsA[Letter];
+		if (FreqA == 0)
+			break;
+		Score += FreqA*AAScoresB[Letter*ColCountB];
+		}
+	return Score;
+	}
+
+/***
+Row[j] = ScoreProfCols3(ProfA, ColA, ProfB, j) for all columns of B.
+Each Row[j] accumulates the same terms in the same order as
+ScoreProfCols3 so results are identical, but the inner loop runs
+over B's letter-major AA score rows and is vectorized.
+***/
+static void GetScoreRow3(const Profile3 &ProfA, uint ColA,
+  const Profile3 &ProfB, float *Row)
+	{
+	const byte *SortOrderA = ProfA.GetSortOrder(ColA);
+	const float *FreqsA = ProfA.GetFreqs(ColA);
+	const uint ColCountB = ProfB.GetColCount();
+	for (uint j = 0; j < ColCountB; ++j)
+		Row[j] = 0;
+	for (uint n = 0; n < g_AlphaSize; ++n)
+		{
+		const byte Letter = SortOrderA[n];
+		const float FreqA = FreqsA[Letter];
+		if (FreqA == 0)
+			break;
+		const float *AAScoresB = ProfB.GetAAScoreRow(Letter);
+		for (uint j = 0; j < ColCountB; ++j)
+			Row[j] += FreqA*AAScoresB[j];
+		}
+	}
+
+// D recurrence for row i, columns Lo..Hi. Depends only on the
+// previous row, so unlike I and M it vectorizes over j.
+static void UpdateDRow3(float *DRow, const float *MPrev, float GapOpen,
+  float e, char *TBRow, uint Lo, uint Hi)
+	{
+	for (uint j = Lo; j <= Hi; ++j)
+		{
+		float DD = DRow[j] + e;
+		float MD = MPrev[j] + GapOpen;
+		bool FromM = !(DD > MD);
+		DRow[j] = (FromM ? MD : DD);
+		TBRow[j] |= (FromM ? BIT_MD : 0);
+		}
+	}
+
 //static const float MINUS_INFINITY = -9e9f;
 
 #define ALLOC_TRACE()
@@ -65,33 +126,10 @@ float ScoreProfPos2(const ProfPos3 &PPA, const ProfPos3 &PPB)
 #define SetTBD(i, j, x)		/* empty  */
 #define SetTBI(i, j, x)		/* empty  */
 
-#define RECURSE_D(i, j)				\
-	{								\
-	float DD = DRow[j] + e;			\
-	float MD = MPrev[j] + PPAs[i-1]->m_GapOpenScore;\
-	if (DD > MD)					\
-		{							\
-		DRow[j] = DD;				\
-		SetTBD(i, j, 'D');			\
-		}							\
-	else							\
-		{							\
-		DRow[j] = MD;				\
-		/* SetBitTBD(TB, i, j, 'M'); */	\
-		TBRow[j] &= ~BIT_xD;		\
-		TBRow[j] |= BIT_MD;			\
-		SetTBD(i, j, 'M');			\
-		}							\
-	SetDPD(i, j, DRow[j]);			\
-	}
-
-#define RECURSE_D_ATerm(j)	RECURSE_D(uLengthA, j)
-#define RECURSE_D_BTerm(j)	RECURSE_D(i, uLengthB)
-
 #define RECURSE_I(i, j)				\
 	{								\
 	Iij += e;						\
-	float MI = MCurr[j-1] + PPBs[j-1]->m_GapOpenScore;\
+	float MI = MCurr[j-1] + GapOpenB[j-1];\
 	if (MI >= Iij)					\
 		{							\
 		Iij = MI;					\
@@ -110,17 +148,17 @@ float ScoreProfPos2(const ProfPos3 &PPA, const ProfPos3 &PPB)
 
 #define RECURSE_M(i, j)								\
 	{												\
-	float DM = DRow[j] + PPAs[i-1]->m_GapCloseScore;	\
-	float IM = Iij +     PPBs[j-1]->m_GapCloseScore;	\
+	float DM = DRow[j] + GapCloseA[i-1];	\
+	float IM = Iij +     GapCloseB[j-1];	\
 	float MM = MCurr[j];							\
-	TB[i+1][j+1] &= ~BIT_xM;						\
+	TBNext[j+1] &= ~BIT_xM;							\
 	if (MM >= DM && MM >= IM)						\
 		{											\
 		MNext[j+1] += MM;							\
 		SetDPM(i+1, j+1, MNext[j+1]);				\
 		SetTBM(i+1, j+1, 'M');						\
 		/* SetBitTBM(TB, i+1, j+1, 'M');	*/		\
-		TB[i+1][j+1] |= BIT_MM;						\
+		TBNext[j+1] |= BIT_MM;						\
 		}											\
 	else if (DM >= MM && DM >= IM)					\
 		{											\
@@ -128,7 +166,7 @@ float ScoreProfPos2(const ProfPos3 &PPA, const ProfPos3 &PPB)
 		SetDPM(i+1, j+1, MNext[j+1]);				\
 		SetTBM(i+1, j+1, 'D');						\
 		/* SetBitTBM(TB, i+1, j+1, 'D'); */			\
-		TB[i+1][j+1] |= BIT_DM;						\
+		TBNext[j+1] |= BIT_DM;						\
 		}											\
 	else											\
 		{											\
@@ -137,11 +175,11 @@ float ScoreProfPos2(const ProfPos3 &PPA, const ProfPos3 &PPB)
 		SetDPM(i+1, j+1, MNext[j+1]);				\
 		SetTBM(i+1, j+1, 'I');						\
 		/* SetBitTBM(TB, i+1, j+1, 'I'); */			\
-		TB[i+1][j+1] |= BIT_IM;						\
+		TBNext[j+1] |= BIT_IM;						\
 		}											\
 	}
 
-static inline void SetBitTBM(char **TB, uint i, uint j, char c)
+static inline void SetBitTBM(char *TBRow, uint j, char c)
 	{
 	char Bit;
 	switch (c)
@@ -158,11 +196,11 @@ static inline void SetBitTBM(char **TB, uint i, uint j, char c)
 	default:
 		asserta(false);
 		}
-	TB[i][j] &= ~BIT_xM;
-	TB[i][j] |= Bit;
+	TBRow[j] &= ~BIT_xM;
+	TBRow[j] |= Bit;
 	}
 
-static inline void SetBitTBD(char **TB, uint i, uint j, char c)
+static inline void SetBitTBD(char *TBRow, uint j, char c)
 	{
 	char Bit;
 	switch (c)
@@ -176,11 +214,11 @@ static inline void SetBitTBD(char **TB, uint i, uint j, char c)
 	default:
 		asserta(false);
 		}
-	TB[i][j] &= ~BIT_xD;
-	TB[i][j] |= Bit;
+	TBRow[j] &= ~BIT_xD;
+	TBRow[j] |= Bit;
 	}
 
-static inline void SetBitTBI(char **TB, uint i, uint j, char c)
+static inline void SetBitTBI(char *TBRow, uint j, char c)
 	{
 	char Bit;
 	switch (c)
@@ -194,8 +232,8 @@ static inline void SetBitTBI(char **TB, uint i, uint j, char c)
 	default:
 		asserta(false);
 		}
-	TB[i][j] &= ~BIT_xI;
-	TB[i][j] |= Bit;
+	TBRow[j] &= ~BIT_xI;
+	TBRow[j] |= Bit;
 	}
 
 float NWSmall3(CacheMem3 &CM, const Profile3 &ProfA,
@@ -205,8 +243,10 @@ float NWSmall3(CacheMem3 &CM, const Profile3 &ProfA,
 	const uint uLengthB = ProfB.GetColCount();
 	const uint uPrefixCountA = uLengthA + 1;
 	const uint uPrefixCountB = uLengthB + 1;
-	const vector<ProfPos3 *> &PPAs = ProfA.m_PPs;
-	const vector<ProfPos3 *> &PPBs = ProfB.m_PPs;
+	const float *GapOpenA = ProfA.m_GapOpenScores;
+	const float *GapCloseA = ProfA.m_GapCloseScores;
+	const float *GapOpenB = ProfB.m_GapOpenScores;
+	const float *GapCloseB = ProfB.m_GapCloseScores;
 
 	//const float e = g_GAP_EXT;
 	const float e = 0;
@@ -220,14 +260,14 @@ float NWSmall3(CacheMem3 &CM, const Profile3 &ProfA,
 	float *MPrev = CM.CacheMPrev;
 	float *DRow = CM.CacheDRow;
 
-	char **TB = CM.CacheTB;
-	for (uint i = 0; i < uPrefixCountA; ++i)
-		memset(TB[i], 0, uPrefixCountB);
+// Contiguous traceback, row i at TB + i*uPrefixCountB
+	char *TB = CM.CacheTB;
+	memset(TB, 0, size_t(uPrefixCountA)*uPrefixCountB);
 
 	float Iij = MINUS_INFINITY;
 	SetDPI(0, 0, Iij);
 
-	Iij = PPAs[0]->m_GapOpenScore;
+	Iij = GapOpenA[0];
 	SetDPI(0, 1, Iij);
 
 	for (uint j = 2; j <= uLengthB; ++j)
@@ -255,59 +295,60 @@ float NWSmall3(CacheMem3 &CM, const Profile3 &ProfA,
 	MCurr[0] = MINUS_INFINITY;
 	SetDPM(1, 0, MCurr[0]);
 
-	MCurr[1] = ScoreProfPos2(*PPAs[0], *PPBs[0]);
+	MCurr[1] = ScoreProfCols3(ProfA, 0, ProfB, 0);
 	SetDPM(1, 1, MCurr[1]);
-	SetBitTBM(TB, 1, 1, 'M');
+	SetBitTBM(TB + uPrefixCountB, 1, 'M');
 	SetTBM(1, 1, 'M');
 
+	GetScoreRow3(ProfA, 0, ProfB, MCurr + 1);
 	for (uint j = 2; j <= uLengthB; ++j)
 		{
-		MCurr[j] = ScoreProfPos2(*PPAs[0], *PPBs[j-1]) +
-		  PPBs[0]->m_GapOpenScore + (j - 2)*e + PPBs[j-2]->m_GapCloseScore;
+		MCurr[j] = MCurr[j] +
+		  GapOpenB[0] + (j - 2)*e + GapCloseB[j-2];
 		SetDPM(1, j, MCurr[j]);
-		SetBitTBM(TB, 1, j, 'I');
+		SetBitTBM(TB + uPrefixCountB, j, 'I');
 		SetTBM(1, j, 'I');
 		}
 
 // Main DP loop
 	for (uint i = 1; i < uLengthA; ++i)
 		{
-		char *TBRow = TB[i];
+		char *TBRow = TB + size_t(i)*uPrefixCountB;
+		char *TBNext = TBRow + uPrefixCountB;
 
 		Iij = MINUS_INFINITY;
 		SetDPI(i, 0, Iij);
 
-		DRow[0] = PPAs[0]->m_GapOpenScore + (i - 1)*e;
+		DRow[0] = GapOpenA[0] + (i - 1)*e;
 		SetDPD(i, 0, DRow[0]);
 
 		MCurr[0] = MINUS_INFINITY; 
 		if (i == 1)
 			{
-			MCurr[1] = ScoreProfPos2(*PPAs[0], *PPBs[0]);
-			SetBitTBM(TB, i, 1, 'M');
+			MCurr[1] = ScoreProfCols3(ProfA, 0, ProfB, 0);
+			SetBitTBM(TBRow, 1, 'M');
 			SetTBM(i, 1, 'M');
 			}
 		else
 			{
-			MCurr[1] = ScoreProfPos2(*PPAs[i-1], *PPBs[0]) +
-			  PPAs[0]->m_GapOpenScore + (i - 2)*e + PPAs[i-2]->m_GapCloseScore;
-			SetBitTBM(TB, i, 1, 'D');
+			MCurr[1] = ScoreProfCols3(ProfA, i-1, ProfB, 0) +
+			  GapOpenA[0] + (i - 2)*e + GapCloseA[i-2];
+			SetBitTBM(TBRow, 1, 'D');
 			SetTBM(i, 1, 'D');
 			}
 		SetDPM(i, 0, MCurr[0]);
 		SetDPM(i, 1, MCurr[1]);
 
-		for (uint j = 1; j < uLengthB; ++j)
-			MNext[j+1] = ScoreProfPos2(*PPAs[i], *PPBs[j]);
+	// MNext[j+1] = match score for (i, j), MNext[1] is not used
+		GetScoreRow3(ProfA, i, ProfB, MNext + 1);
 
+		UpdateDRow3(DRow, MPrev, GapOpenA[i-1], e, TBRow, 1, uLengthB);
 		for (uint j = 1; j < uLengthB; ++j)
 			{
-			RECURSE_D(i, j)
 			RECURSE_I(i, j)
 			RECURSE_M(i, j)
 			}
 	// Special case for j=uLengthB
-		RECURSE_D_BTerm(i)
 		RECURSE_I_BTerm(i)
 
 	// Prev := Curr, Curr := Next, Next := Prev
@@ -317,24 +358,23 @@ float NWSmall3(CacheMem3 &CM, const Profile3 &ProfA,
 		}
 
 // Special case for i=uLengthA
-	char *TBRow = TB[uLengthA];
+	char *TBRow = TB + size_t(uLengthA)*uPrefixCountB;
 	MCurr[0] = MINUS_INFINITY;
 	if (uLengthA > 1)
-		MCurr[1] = ScoreProfPos2(*PPAs[uLengthA-1], *PPBs[0])
+		MCurr[1] = ScoreProfCols3(ProfA, uLengthA-1, ProfB, 0)
 		  + (uLengthA - 2)*e +
-		  PPAs[0]->m_GapOpenScore + PPAs[uLengthA-2]->m_GapCloseScore;
+		  GapOpenA[0] + GapCloseA[uLengthA-2];
 	else
-		MCurr[1] = ScoreProfPos2(*PPAs[uLengthA-1], *PPBs[0]) +
-		  PPAs[0]->m_GapOpenScore + PPAs[0]->m_GapCloseScore;
-	SetBitTBM(TB, uLengthA, 1, 'D');
+		MCurr[1] = ScoreProfCols3(ProfA, uLengthA-1, ProfB, 0) +
+		  GapOpenA[0] + GapCloseA[0];
+	SetBitTBM(TBRow, 1, 'D');
 	SetTBM(uLengthA, 1, 'D');
 	SetDPM(uLengthA, 0, MCurr[0]);
 	SetDPM(uLengthA, 1, MCurr[1]);
 
 	DRow[0] = MINUS_INFINITY;
 	SetDPD(uLengthA, 0, DRow[0]);
-	for (uint j = 1; j <= uLengthB; ++j)
-		RECURSE_D_ATerm(j);
+	UpdateDRow3(DRow, MPrev, GapOpenA[uLengthA-1], e, TBRow, 1, uLengthB);
 
 	Iij = MINUS_INFINITY;
 	for (uint j = 1; j <= uLengthB; ++j)
@@ -58,7 +58,7 @@ float PathScorer::GetScore(char FromState, char ToState,
 	return Total;
 	}
 
-void PathScorer_MASM_Mega::Init(MASM &MA, const vector<vector<byte> > &PB)
+void PathScorer_MASM_Mega::Init(MASM &MA, const MegaProfile &PB)
 	{
 	m_MASM = &MA;
 	m_MegaProfile = &PB;
@@ -71,8 +71,7 @@ float PathScorer_MASM_Mega::GetMatchScore(uint PosA, uint PosB)
 	asserta(PosA < m_MASM->GetColCount());
 	asserta(PosB < SIZE(*m_MegaProfile));
 	const MASMCol &MCol = m_MASM->GetCol(PosA);
-	const vector<byte> &PPos = (*m_MegaProfile)[PosB];
-	float Score = MCol.GetMatchScore_MegaProfilePos(PPos);
+	float Score = MCol.GetMatchScore_MegaProfilePos(*m_MegaProfile, PosB);
 	return Score;
 	}
 
@@ -37,11 +37,11 @@ class PathScorer_MASM_Mega : public PathScorer
 	{
 public:
 	const MASM *m_MASM = 0;
-	const vector<vector<byte> > *m_MegaProfile = 0;
+	const MegaProfile *m_MegaProfile = 0;
 
 public:
 	virtual float GetMatchScore(uint PosA, uint PosB);
-	void Init(MASM &MA, const vector<vector<byte> > &PB);
+	void Init(MASM &MA, const MegaProfile &PB);
 
 public:
 	virtual float GetScoreMM(uint PosA, uint PosB);
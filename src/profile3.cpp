@@ -2,35 +2,93 @@
 #include "profile3.h"
 #include "m3alnparams.h"
 
+#if TRACE_ALLOC
 uint Profile3::m_NewCount;
 uint Profile3::m_DeleteCount;
+#endif
+
+static const uintptr_t PROFILE3_ALIGN = 32;
 
-void Profile3::Clear()
+static size_t RoundUpAlign(size_t Bytes)
 	{
-	if (m_PPs.empty())
-		return;
-	size_t N = m_PPs.size();
-	for (size_t i = 0; i < N; ++i)
-		delete m_PPs[i];
-	m_PPs.clear();
+	return (Bytes + PROFILE3_ALIGN - 1) & ~(PROFILE3_ALIGN - 1);
+	}
+
+void Profile3::Free()
+	{
+	myfree(m_Buffer);
+	m_Buffer = 0;
+	m_BufferBytes = 0;
+	m_ColCount = 0;
+	}
+
+// Buffer is re-used if large enough, contents are undefined.
+void Profile3::Alloc(uint ColCount)
+	{
+	const size_t MatrixBytes = RoundUpAlign(20*ColCount*sizeof(float));
+	const size_t SortBytes = RoundUpAlign(20*ColCount);
+	const size_t VecBytes = RoundUpAlign(ColCount*sizeof(float));
+	const size_t Bytes = 2*MatrixBytes + SortBytes + 7*VecBytes;
+	if (Bytes + PROFILE3_ALIGN > m_BufferBytes)
+		{
+		myfree(m_Buffer);
+		m_BufferBytes = Bytes + PROFILE3_ALIGN;
+		m_Buffer = myalloc(byte, m_BufferBytes);
+		}
+	m_ColCount = ColCount;
+
+	byte *p = (byte *) RoundUpAlign(uintptr_t(m_Buffer));
+	m_Freqs = (float *) p;			p += MatrixBytes;
+	m_AAScores = (float *) p;		p += MatrixBytes;
+	m_LL = (float *) p;				p += VecBytes;
+	m_LG = (float *) p;				p += VecBytes;
+	m_GL = (float *) p;				p += VecBytes;
+	m_GG = (float *) p;				p += VecBytes;
+	m_fOcc = (float *) p;			p += VecBytes;
+	m_GapOpenScores = (float *) p;	p += VecBytes;
+	m_GapCloseScores = (float *) p;	p += VecBytes;
+	m_SortOrders = p;				p += SortBytes;
+	assert(p <= m_Buffer + m_BufferBytes);
+	}
+
+void Profile3::GetPP(uint ColIndex, ProfPos3 &PP) const
+	{
+	assert(ColIndex < m_ColCount);
+	PP.m_AllGaps = (m_fOcc[ColIndex] == 0);
+	memcpy(PP.m_SortOrder, GetSortOrder(ColIndex), 20);
+	memcpy(PP.m_Freqs, GetFreqs(ColIndex), 20*sizeof(float));
+	PP.m_LL = m_LL[ColIndex];
+	PP.m_LG = m_LG[ColIndex];
+	PP.m_GL = m_GL[ColIndex];
+	PP.m_GG = m_GG[ColIndex];
+	PP.m_fOcc = m_fOcc[ColIndex];
+	for (uint Letter = 0; Letter < 20; ++Letter)
+		PP.m_AAScores[Letter] = GetAAScore(ColIndex, Letter);
+	PP.m_GapOpenScore = m_GapOpenScores[ColIndex];
+	PP.m_GapCloseScore = m_GapCloseScores[ColIndex];
 	}
 
-const ProfPos3 &Profile3::GetPP(uint ColIndex) const
+// Frequencies and dimers only, scores are set by SetScores
+void Profile3::SetPP(uint ColIndex, const ProfPos3 &PP)
 	{
-	assert(ColIndex < SIZE(m_PPs));
-	return *m_PPs[ColIndex];
+	assert(ColIndex < m_ColCount);
+	memcpy(GetFreqs(ColIndex), PP.m_Freqs, 20*sizeof(float));
+	m_LL[ColIndex] = PP.m_LL;
+	m_LG[ColIndex] = PP.m_LG;
+	m_GL[ColIndex] = PP.m_GL;
+	m_GG[ColIndex] = PP.m_GG;
+	m_fOcc[ColIndex] = PP.m_fOcc;
 	}
 
 void Profile3::SetGapOpenScore(float GapOpen, uint ColIndex)
 	{
-	assert(ColIndex < SIZE(m_PPs));
-	ProfPos3 *PP = m_PPs[ColIndex];
+	assert(ColIndex < m_ColCount);
 	if (ColIndex == 0)
-		PP->m_GapOpenScore = PP->m_fOcc*GapOpen/2;
+		m_GapOpenScores[ColIndex] = m_fOcc[ColIndex]*GapOpen/2;
 	else
 		{
-		float GapOpenFreq = PP->m_LG;
-		PP->m_GapOpenScore = GapOpen*(1.0f - GapOpenFreq)/2;
+		float GapOpenFreq = m_LG[ColIndex];
+		m_GapOpenScores[ColIndex] = GapOpen*(1.0f - GapOpenFreq)/2;
 		}
 	}
 
@@ -38,14 +96,12 @@ void Profile3::SetGapCloseScore(float GapOpen, uint ColIndex)
 	{
 	const uint ColCount = GetColCount();
 	assert(ColIndex < ColCount);
-	ProfPos3 *PP = m_PPs[ColIndex];
 	if (ColIndex + 1 == ColCount)
-		PP->m_GapCloseScore = GapOpen*PP->m_fOcc/2;
+		m_GapCloseScores[ColIndex] = GapOpen*m_fOcc[ColIndex]/2;
 	else
 		{
-		const ProfPos3 *NextPP = m_PPs[ColIndex+1];
-		float GapCloseFreq = NextPP->m_GL;
-		PP->m_GapCloseScore = GapOpen*(1.0f - GapCloseFreq)/2;
+		float GapCloseFreq = m_GL[ColIndex+1];
+		m_GapCloseScores[ColIndex] = GapOpen*(1.0f - GapCloseFreq)/2;
 		}
 	}
 
@@ -75,21 +131,14 @@ void Profile3::FromMSA(const MultiSequence &MSA,
 	asserta(SumWeights > 0.9 && SumWeights < 1.1);
 	}
 #endif
-	m_PPs.clear();
-	m_PPs.reserve(ColCount);
-	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
-		{
-		ProfPos3 *PP = new ProfPos3;
-		PP->SetFreqs(MSA, ColIndex, SeqWeights);
-		PP->SetAAScores(SubstMx_Letter);
-		m_PPs.push_back(PP);
-		}
+	Alloc(ColCount);
+	ProfPos3 PP;
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
-		ProfPos3 *PP = m_PPs[ColIndex];
-		SetGapOpenScore(GapOpen, ColIndex);
-		SetGapCloseScore(GapOpen, ColIndex);
+		PP.SetFreqs(MSA, ColIndex, SeqWeights);
+		SetPP(ColIndex, PP);
 		}
+	SetScores(SubstMx_Letter, GapOpen);
 	}
 
 static void LogF(float f)
@@ -107,7 +156,8 @@ void Profile3::LogMe(const MultiSequence *MSA) const
 	const uint ColCount = GetColCount();
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
-		const ProfPos3 &PP = *m_PPs[ColIndex];
+		ProfPos3 PP;
+		GetPP(ColIndex, PP);
 		Log("%5u", ColIndex);
 		LogF(PP.m_fOcc);
 		LogF(PP.m_LL);
@@ -138,7 +188,8 @@ void Profile3::LogMe(const MultiSequence *MSA) const
 
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
-		const ProfPos3 &PP = *m_PPs[ColIndex];
+		ProfPos3 PP;
+		GetPP(ColIndex, PP);
 		Log("%5u", ColIndex);
 
 		float SumFreqs = 0;
@@ -178,7 +229,8 @@ void Profile3::LogMe(const MultiSequence *MSA) const
 	Log("\n");
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
-		const ProfPos3 &PP = *m_PPs[ColIndex];
+		ProfPos3 PP;
+		GetPP(ColIndex, PP);
 		Log("%5u", ColIndex);
 
 		float SumFreqs = 0;
@@ -194,9 +246,19 @@ void Profile3::LogMe(const MultiSequence *MSA) const
 
 void Profile3::SetAAScores(const Mx2020 &SubstMx_Letter)
 	{
-	const uint ColCount = SIZE(m_PPs);
+	const uint ColCount = GetColCount();
 	for (uint Col = 0; Col < ColCount; ++Col)
-		m_PPs[Col]->SetAAScores(SubstMx_Letter);
+		{
+		const float *Freqs = GetFreqs(Col);
+		SortCounts(Freqs, m_SortOrders + 20*Col);
+		for (uint i = 0; i < g_AlphaSize; ++i)
+			{
+			float Sum = 0;
+			for (uint j = 0; j < g_AlphaSize; ++j)
+				Sum += Freqs[j]*SubstMx_Letter[i][j];
+			m_AAScores[i*ColCount + Col] = Sum;
+			}
+		}
 	}
 
 void Profile3::SetScores(const Mx2020 &SubstMx_Letter, float GapOpen)
@@ -220,26 +282,27 @@ void Profile3::Validate() const
 	const uint ColCount = GetColCount();
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
-		const ProfPos3 &PP = *m_PPs[ColIndex];
-		if (!feq(PP.m_fOcc, PP.m_LL + PP.m_GL))
+		const float LL = m_LL[ColIndex];
+		const float LG = m_LG[ColIndex];
+		const float GL = m_GL[ColIndex];
+		const float GG = m_GG[ColIndex];
+		if (!feq(m_fOcc[ColIndex], LL + GL))
 			Die("Col %u, fOcc != LL + GL", ColIndex);
 
-		float s1 = PP.m_LL + PP.m_LG + PP.m_GL + PP.m_GG;
+		float s1 = LL + LG + GL + GG;
 		asserta(feq(s1, 1.0));
 
 		if (ColIndex > 0)
 			{
-			const ProfPos3 &PPPrev = *m_PPs[ColIndex-1];
-			float s2 = PPPrev.m_LL + PPPrev.m_GL;
-			float s3 = PP.m_LL + PP.m_LG;
+			float s2 = m_LL[ColIndex-1] + m_GL[ColIndex-1];
+			float s3 = LL + LG;
 			if (!feq(s2, s3))
 				Die("Col %u, LL + LG != Prev.LL + Prev.GL", ColIndex);
 			}
 		if (ColIndex + 1 < ColCount)
 			{
-			const ProfPos3 &PPNext = *m_PPs[ColIndex+1];
-			float s4 = PP.m_LL + PP.m_GL;
-			float s5 = PPNext.m_LL + PPNext.m_LG;
+			float s4 = LL + GL;
+			float s5 = m_LL[ColIndex+1] + m_LG[ColIndex+1];
 			if (!feq(s4, s5))
 				Die("Col %u, LL + GL != Next.LL + Next.LG", ColIndex);
 			}
@@ -261,8 +324,10 @@ void Profile3::ToTsv(FILE *f) const
 	fprintf(f, "%u\n", ColCount);
 	for (uint i = 0; i < ColCount; ++i)
 		{
+		ProfPos3 PP;
+		GetPP(i, PP);
 		fprintf(f, "%u", i);
-		m_PPs[i]->ToTsv(f);
+		PP.ToTsv(f);
 		}
 	}
 
@@ -272,8 +337,7 @@ float Profile3::GetSelfScore() const
 	const uint ColCount = GetColCount();
 	for (uint Col = 0; Col < ColCount; ++Col)
 		{
-		const ProfPos3 &PP = GetPP(Col);
-		float Score = ScoreProfPos2(PP, PP);
+		float Score = ScoreProfCols3(*this, Col, *this, Col);
 		Sum += Score;
 		}
 	return Sum;
@@ -292,8 +356,10 @@ uint Profile3::LogDiffs(const Profile3 &Prof2) const
 	uint DiffCount = 0;
 	for (uint ColIndex = 0; ColIndex < ColCount; ++ColIndex)
 		{
-		const ProfPos3 &PP = GetPP(ColIndex);
-		const ProfPos3 &PP2 = Prof2.GetPP(ColIndex);
+		ProfPos3 PP;
+		ProfPos3 PP2;
+		GetPP(ColIndex, PP);
+		Prof2.GetPP(ColIndex, PP2);
 
 #define w(x)	if (!feq(PP.m_##x, PP2.m_##x)) \
 					{ \
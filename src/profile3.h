@@ -3,38 +3,72 @@
 #include "profpos3.h"
 #include "multisequence.h"
 
+/***
+Per-column data is a structure of arrays in one allocation
+(m_Buffer), no heap object per column. Each array starts on a
+32-byte boundary.
+	m_Freqs			ColCount x 20, column-major (Freqs of Col are contiguous)
+	m_SortOrders	ColCount x 20, column-major
+	m_AAScores		20 x ColCount, letter-major (GetAAScoreRow(Letter)
+					is contiguous over columns for DP rows)
+	m_LL ... m_GapCloseScores	ColCount
+ProfPos3 is the same data for one column as a standalone record,
+GetPP gathers it.
+***/
 class Profile3
 	{
 public:
-	vector<ProfPos3 *> m_PPs;
+	uint m_ColCount = 0;
+	size_t m_BufferBytes = 0;
+	byte *m_Buffer = 0;
 
+	float *m_Freqs = 0;
+	byte *m_SortOrders = 0;
+	float *m_AAScores = 0;
+	float *m_LL = 0;
+	float *m_LG = 0;
+	float *m_GL = 0;
+	float *m_GG = 0;
+	float *m_fOcc = 0;
+	float *m_GapOpenScores = 0;
+	float *m_GapCloseScores = 0;
+
+#if TRACE_ALLOC
 public:
 	static uint m_NewCount;
 	static uint m_DeleteCount;
+#endif
 
 public:
 	Profile3()
 		{
+#if TRACE_ALLOC
 #pragma omp critical
 		++m_NewCount;
+#endif
 		}
 
 	~Profile3()
 		{
+#if TRACE_ALLOC
 #pragma omp critical
 		++m_DeleteCount;
-		Clear();
+#endif
+		Free();
 		}
 
 public:
-	void Clear();
-	uint GetColCount() const { return SIZE(m_PPs); }
+	void Clear() { m_ColCount = 0; }
+	void Free();
+	void Alloc(uint ColCount);
+	uint GetColCount() const { return m_ColCount; }
 	void FromMSA(const MultiSequence &MSA,
 	  const Mx2020 &SubstMx_Letter, float GapOpen,
 	  const vector<float> &SeqWeights);
 	void FromSeq(const Sequence &Seq,
 	  const Mx2020 &SubstMx_Letter, float GapOpen);
-	const ProfPos3 &GetPP(uint ColIndex) const;
+	void GetPP(uint ColIndex, ProfPos3 &PP) const;
+	void SetPP(uint ColIndex, const ProfPos3 &PP);
 	void SetScores(const Mx2020 &SubstMx_Letter, float GapOpen);
 	void LogMe(const MultiSequence *MSA = 0) const;
 	void Validate() const;
@@ -46,4 +80,17 @@ public:
 	void SetGapCloseScore(float GapOpen, uint ColIndex);
 	uint LogDiffs(const Profile3 &Prof2) const;
 	float GetSelfScore() const;
+
+	float *GetFreqs(uint ColIndex) { return m_Freqs + 20*ColIndex; }
+	const float *GetFreqs(uint ColIndex) const { return m_Freqs + 20*ColIndex; }
+	const byte *GetSortOrder(uint ColIndex) const { return m_SortOrders + 20*ColIndex; }
+	const float *GetAAScoreRow(uint Letter) const { return m_AAScores + Letter*m_ColCount; }
+	float GetAAScore(uint ColIndex, uint Letter) const
+		{
+		assert(ColIndex < m_ColCount && Letter < 20);
+		return m_AAScores[Letter*m_ColCount + ColIndex];
+		}
 	};
+
+float ScoreProfCols3(const Profile3 &ProfA, uint ColA,
+  const Profile3 &ProfB, uint ColB);
@@ -3,9 +3,6 @@
 #include "alpha.h"
 #include "m3alnparams.h"
 
-uint ProfPos3::m_NewCount;
-uint ProfPos3::m_DeleteCount;
-
 void SortCounts(const float *Counts, byte *Order)
 	{
 	static byte InitialSortOrder[20] =
@@ -2,6 +2,8 @@
 
 class MultiSequence;
 
+void SortCounts(const float *Counts, byte *Order);
+
 class ProfPos3
 	{
 public:
@@ -24,22 +26,6 @@ public:
 	float m_GapCloseScore;
 
 public:
-	static uint m_NewCount;
-	static uint m_DeleteCount;
-
-public:
-	ProfPos3()
-		{
-#pragma omp critical
-		++m_NewCount;
-		}
-
-	~ProfPos3()
-		{
-#pragma omp critical
-		++m_DeleteCount;
-		}
-
 	void SetFreqs(const MultiSequence &MSA, uint ColIndex,
 	  const vector<float> &SeqWeights);
 	void SetFreqs2(uint SeqCount,
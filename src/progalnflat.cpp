@@ -1,21 +1,33 @@
 #include "muscle.h"
 #include "tree.h"
 #include "mpcflat.h"
+#include "locallock.h"
 
-void MPCFlat::FreeProgMSAs()
+float CalcAlnFlat(const float *Post, uint LX, uint LY,
+  float *DPRows, char *TB, string &Path);
+
+void MPCFlat::FreeProgNodes()
 	{
-	const uint n = SIZE(m_ProgMSAs);
+	const uint n = SIZE(m_ProgNodes);
 	for (uint i = 0; i < n; ++i)
 		{
-		MultiSequence *MSA = m_ProgMSAs[i];
-		if (MSA != 0)
-			delete MSA;
+		ProgNode *Node = m_ProgNodes[i];
+		if (Node != 0)
+			delete Node;
 		}
-	m_ProgMSAs.clear();
+	m_ProgNodes.clear();
 	}
 
 void MPCFlat::FreeSparsePosts()
 	{
+	if (m_SharedPosts)
+		{
+		m_SparsePosts1.clear();
+		m_SparsePosts2.clear();
+		m_SharedPosts = false;
+		return;
+		}
+
 	for (uint i = 0; i < SIZE(m_SparsePosts1); ++i)
 		{
 		if (m_SparsePosts1[i] != 0)
@@ -36,52 +48,179 @@ void MPCFlat::FreeSparsePosts()
 
 	m_SparsePosts1.clear();
 	m_SparsePosts2.clear();
+	FreeArena();
+	}
+
+// Same result as AlignAlnsFromPath followed by GetPosToCol on
+// each row. Members of Node1 and Node2 are moved into Node12.
+static void JoinProgNodes(const string &Path, ProgNode &Node1,
+  ProgNode &Node2, ProgNode &Node12)
+	{
+	const uint ColCount12 = SIZE(Path);
+	vector<uint> ColMap1;
+	vector<uint> ColMap2;
+	ColMap1.reserve(Node1.m_ColCount);
+	ColMap2.reserve(Node2.m_ColCount);
+	for (uint Col = 0; Col < ColCount12; ++Col)
+		{
+		char c = Path[Col];
+		if (c == 'M' || c == 'B' || c == 'X')
+			ColMap1.push_back(Col);
+		if (c == 'M' || c == 'B' || c == 'Y')
+			ColMap2.push_back(Col);
+		}
+	asserta(SIZE(ColMap1) == Node1.m_ColCount);
+	asserta(SIZE(ColMap2) == Node2.m_ColCount);
+
+	const uint SeqCount1 = SIZE(Node1.m_SMIs);
+	const uint SeqCount2 = SIZE(Node2.m_SMIs);
+	Node12.m_ColCount = ColCount12;
+	Node12.m_SMIs.reserve(SeqCount1 + SeqCount2);
+	Node12.m_PosToCols.reserve(SeqCount1 + SeqCount2);
+	for (uint k = 0; k < SeqCount1; ++k)
+		{
+		vector<uint> &PosToCol = Node1.m_PosToCols[k];
+		for (uint Pos = 0; Pos < SIZE(PosToCol); ++Pos)
+			PosToCol[Pos] = ColMap1[PosToCol[Pos]];
+		Node12.m_SMIs.push_back(Node1.m_SMIs[k]);
+		Node12.m_PosToCols.push_back(move(PosToCol));
+		}
+	for (uint k = 0; k < SeqCount2; ++k)
+		{
+		vector<uint> &PosToCol = Node2.m_PosToCols[k];
+		for (uint Pos = 0; Pos < SIZE(PosToCol); ++Pos)
+			PosToCol[Pos] = ColMap2[PosToCol[Pos]];
+		Node12.m_SMIs.push_back(Node2.m_SMIs[k]);
+		Node12.m_PosToCols.push_back(move(PosToCol));
+		}
+	}
+
+MultiSequence *MPCFlat::MakeProgMSA(const ProgNode &Node) const
+	{
+	MultiSequence *MSA = new MultiSequence;
+	const uint SeqCount = SIZE(Node.m_SMIs);
+	for (uint k = 0; k < SeqCount; ++k)
+		{
+		const Sequence *InputSeq = m_MyInputSeqs->GetSequence(Node.m_SMIs[k]);
+		const vector<uint> &PosToCol = Node.m_PosToCols[k];
+		Sequence *Row = NewSequence();
+		Row->m_Label = InputSeq->m_Label;
+		Row->m_CharVec.assign(Node.m_ColCount, '-');
+		const uint L = InputSeq->GetLength();
+		const char *Chars = InputSeq->GetCharPtr();
+		uint Pos = 0;
+		for (uint i = 0; i < L; ++i)
+			{
+			char c = Chars[i];
+			if (c != '-')
+				Row->m_CharVec[PosToCol[Pos++]] = c;
+			}
+		asserta(Pos == SIZE(PosToCol));
+		MSA->AddSequence(Row, true);
+		}
+	return MSA;
+	}
+
+void MPCFlat::ProgNodeFromMSA(const MultiSequence &MSA, ProgNode &Node) const
+	{
+	const uint SeqCount = MSA.GetSeqCount();
+	Node.m_ColCount = MSA.GetColCount();
+	Node.m_SMIs.resize(SeqCount);
+	Node.m_PosToCols.resize(SeqCount);
+	for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
+		{
+		const Sequence *Seq = MSA.GetSequence(SeqIndex);
+		Node.m_SMIs[SeqIndex] = GetMyInputSeqIndex(Seq->m_Label);
+		Seq->GetPosToCol(Node.m_PosToCols[SeqIndex]);
+		}
+	}
+
+// -squeeze works on gapped rows, so materialize both children
+void MPCFlat::ProgAlnSqueeze(const ProgNode &Node1, const ProgNode &Node2,
+  ProgNode &Node12)
+	{
+	MultiSequence *MSA1 = MakeProgMSA(Node1);
+	MultiSequence *MSA2 = MakeProgMSA(Node2);
+	MultiSequence *MSA12 = AlignAlns(MSA1, MSA2);
+	ProgNodeFromMSA(*MSA12, Node12);
+	delete MSA1;
+	delete MSA2;
+	delete MSA12;
 	}
 
 void MPCFlat::ProgAln(uint JoinIndex)
 	{
+	const uint SeqCount = GetSeqCount();
 	uint Index1 = m_JoinIndexes1[JoinIndex];
 	uint Index2 = m_JoinIndexes2[JoinIndex];
-	assert(Index1 < SIZE(m_ProgMSAs));
-	assert(Index2 < SIZE(m_ProgMSAs));
+	uint Index12 = SeqCount + JoinIndex;
+	assert(Index1 < SIZE(m_ProgNodes));
+	assert(Index2 < SIZE(m_ProgNodes));
+	assert(Index12 < SIZE(m_ProgNodes));
 
-	MultiSequence *MSA1 = m_ProgMSAs[Index1];
-	MultiSequence *MSA2 = m_ProgMSAs[Index2];
-	assert(MSA1 != 0);
-	assert(MSA2 != 0);
-	MultiSequence *MSA12 = AlignAlns(MSA1, MSA2);
+	ProgNode *Node1 = m_ProgNodes[Index1];
+	ProgNode *Node2 = m_ProgNodes[Index2];
+	assert(Node1 != 0);
+	assert(Node2 != 0);
+	ProgNode *Node12 = new ProgNode;
 
-#if 0//TRACE
-	uint SeqCount12 = MSA12->GetSeqCount();
-	uint Index12 = SIZE(m_ProgMSAs);
+	const uint MAX_COL_COUNT = optd(maxcols, 5000);
+	const uint ColCount1 = Node1->m_ColCount;
+	const uint ColCount2 = Node2->m_ColCount;
+	if (opt(squeeze) && (ColCount1 > MAX_COL_COUNT || ColCount2 > MAX_COL_COUNT))
+		ProgAlnSqueeze(*Node1, *Node2, *Node12);
+	else
+		{
+		if (double(ColCount1 + 1)*double(ColCount2 + 1) + 100 > double(UINT_MAX))
+			Die("Join Cols1=%u, Cols2=%u overflow 32-bit DP buffers", ColCount1, ColCount2);
 
-	uint SeqCount1 = MSA1->GetSeqCount();
-	uint SeqCount2 = MSA2->GetSeqCount();
-	Log("Flat Join %u(%u) + %u(%u) = %u(%u)\n",
-	  Index1, SeqCount1, Index2, SeqCount2, Index12, SeqCount12);
-#endif
+		float *Post = AllocPost(ColCount1, ColCount2);
+		BuildPost(Node1->m_SMIs, Node2->m_SMIs, Node1->m_PosToCols,
+		  Node2->m_PosToCols, ColCount1, ColCount2, Post);
 
-	m_ProgMSAs.push_back(MSA12);
-	const uint SeqCount = GetSeqCount();
-	delete MSA1;
-	delete MSA2;
+		float *DPRows = AllocDPRows(ColCount1, ColCount2);
+		char *TB = AllocTB(ColCount1, ColCount2);
+		string Path;
+		CalcAlnFlat(Post, ColCount1, ColCount2, DPRows, TB, Path);
+		myfree(Post);
+		myfree(DPRows);
+		myfree(TB);
+
+		JoinProgNodes(Path, *Node1, *Node2, *Node12);
+		}
 
-	m_ProgMSAs[Index1] = 0;
-	m_ProgMSAs[Index2] = 0;
+	m_ProgNodes[Index12] = Node12;
+	delete Node1;
+	delete Node2;
+
+	m_ProgNodes[Index1] = 0;
+	m_ProgNodes[Index2] = 0;
 	}
 
+/***
+Joins in disjoint subtrees are independent. A join is "big" if
+its subtree has more than SeqCount/ThreadCount sequences; big
+joins form the top of the tree. Each maximal subtree of small
+joins is aligned by one thread, largest first, then big joins
+are done in join order with BuildPost parallelized over rows.
+Output does not depend on thread count.
+***/
 void MPCFlat::ProgressiveAlign()
 	{
 	const uint SeqCount = m_MyInputSeqs->GetSeqCount();
 	const uint JoinCount = SeqCount - 1;
 	const uint NodeCount = SeqCount + JoinCount;
 
+	m_ProgNodes.resize(NodeCount, 0);
 	for (uint i = 0; i < SeqCount; ++i)
 		{
 		const Sequence *Seq = m_MyInputSeqs->GetSequence(i);
-		MultiSequence *MS = new MultiSequence;
-		MS->AddSequence(Seq, false);
-		m_ProgMSAs.push_back(MS);
+		ProgNode *Node = new ProgNode;
+		Node->m_ColCount = Seq->GetLength();
+		Node->m_SMIs.push_back(i);
+		Node->m_PosToCols.resize(1);
+		Seq->GetPosToCol(Node->m_PosToCols[0]);
+		m_ProgNodes[i] = Node;
 		}
 
 	asserta(SIZE(m_JoinIndexes1) == JoinCount);
@@ -89,12 +228,86 @@ void MPCFlat::ProgressiveAlign()
 
 	ValidateJoinOrder(m_JoinIndexes1, m_JoinIndexes2);
 
+	const uint ThreadCount = GetThreadCount();
+	vector<uint> NodeSizes(NodeCount, 1);
+	vector<uint> Parents(NodeCount, UINT_MAX);
 	for (uint JoinIndex = 0; JoinIndex < JoinCount; ++JoinIndex)
-		ProgAln(JoinIndex);
+		{
+		uint Index1 = m_JoinIndexes1[JoinIndex];
+		uint Index2 = m_JoinIndexes2[JoinIndex];
+		uint Index12 = SeqCount + JoinIndex;
+		NodeSizes[Index12] = NodeSizes[Index1] + NodeSizes[Index2];
+		Parents[Index1] = Index12;
+		Parents[Index2] = Index12;
+		}
+
+// Subtree root for each small join, root first so parent is known
+	vector<uint> SubtreeRoots(NodeCount, UINT_MAX);
+	vector<uint> BigJoins;
+	vector<uint> Subtrees;
+	for (int JoinIndex = int(JoinCount) - 1; JoinIndex >= 0; --JoinIndex)
+		{
+		uint Node = SeqCount + JoinIndex;
+		if (uint64(NodeSizes[Node])*ThreadCount > SeqCount)
+			{
+			BigJoins.push_back(JoinIndex);
+			continue;
+			}
+		uint Parent = Parents[Node];
+		if (Parent == UINT_MAX || SubtreeRoots[Parent] == UINT_MAX)
+			{
+			SubtreeRoots[Node] = Node;
+			Subtrees.push_back(Node);
+			}
+		else
+			SubtreeRoots[Node] = SubtreeRoots[Parent];
+		}
+
+	const uint SubtreeCount = SIZE(Subtrees);
+	vector<vector<uint> > SubtreeJoins(SubtreeCount);
+	vector<uint> NodeToSubtree(NodeCount, UINT_MAX);
+	for (uint i = 0; i < SubtreeCount; ++i)
+		NodeToSubtree[Subtrees[i]] = i;
+	for (uint JoinIndex = 0; JoinIndex < JoinCount; ++JoinIndex)
+		{
+		uint Root = SubtreeRoots[SeqCount + JoinIndex];
+		if (Root != UINT_MAX)
+			SubtreeJoins[NodeToSubtree[Root]].push_back(JoinIndex);
+		}
+
+	vector<uint> Order(SubtreeCount);
+	for (uint i = 0; i < SubtreeCount; ++i)
+		Order[i] = i;
+	sort(Order.begin(), Order.end(),
+	  [&](uint i, uint j) { return SIZE(SubtreeJoins[i]) > SIZE(SubtreeJoins[j]); });
+
+	uint JoinCounter = 0;
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1)
+	for (int i = 0; i < (int) SubtreeCount; ++i)
+		{
+		const vector<uint> &Joins = SubtreeJoins[Order[i]];
+		for (uint k = 0; k < SIZE(Joins); ++k)
+			{
+			Lock();
+			uint JoinIndex = JoinCounter++;
+			if (!m_Quiet)
+				ProgressStep(JoinIndex, JoinCount, "Progressive align");
+			Unlock();
+			ProgAln(Joins[k]);
+			}
+		}
+
+	reverse(BigJoins.begin(), BigJoins.end());
+	for (uint k = 0; k < SIZE(BigJoins); ++k)
+		{
+		uint JoinIndex = JoinCounter++;
+		if (!m_Quiet)
+			ProgressStep(JoinIndex, JoinCount, "Progressive align");
+		ProgAln(BigJoins[k]);
+		}
+	asserta(JoinCounter == JoinCount);
 
-	asserta(SIZE(m_ProgMSAs) == NodeCount);
-	m_MSA = m_ProgMSAs[NodeCount-1];
-	m_ProgMSAs[NodeCount-1] = 0;
-	FreeProgMSAs();
-	asserta(m_MSA != 0);
+	asserta(m_ProgNodes[NodeCount-1] != 0);
+	m_MSA = MakeProgMSA(*m_ProgNodes[NodeCount-1]);
+	FreeProgNodes();
 	}
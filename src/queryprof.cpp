@@ -0,0 +1,73 @@
+#include "muscle.h"
+#include "queryprof.h"
+
+void QueryAlpha::Clear()
+	{
+	memset(m_CharToLetter, 0xff, sizeof(m_CharToLetter));
+	m_LetterToChar.clear();
+	}
+
+void QueryAlpha::Add(const byte *S, uint L)
+	{
+	for (uint i = 0; i < L; ++i)
+		{
+		byte c = S[i];
+		if (m_CharToLetter[c] == 0xff)
+			{
+			asserta(m_LetterToChar.size() < 255);
+			m_CharToLetter[c] = byte(m_LetterToChar.size());
+			m_LetterToChar.push_back(c);
+			}
+		}
+	}
+
+void QueryProf::Init(const QueryAlpha &Alpha, const byte *S, uint L)
+	{
+	const uint LetterCount = Alpha.GetLetterCount();
+	m_L = L;
+	m_LetterCount = LetterCount;
+	m_Letters.resize(L);
+	m_InsY.resize(L + 1);
+	m_Match.resize(uint64(LetterCount)*L);
+
+	const float *InsScore = PairHMM::m_InsScore;
+	for (uint j = 0; j < L; ++j)
+		{
+		byte c = S[j];
+		byte Letter = Alpha.m_CharToLetter[c];
+		asserta(Letter != 0xff);
+		m_Letters[j] = Letter;
+		m_InsY[j] = InsScore[c];
+		}
+	m_InsY[L] = InsScore[0];
+
+	for (uint Letter = 0; Letter < LetterCount; ++Letter)
+		{
+		const float *MatchScore_x =
+		  PairHMM::m_MatchScore[Alpha.m_LetterToChar[Letter]];
+		float *Row = m_Match.data() + uint64(Letter)*L;
+		for (uint j = 0; j < L; ++j)
+			Row[j] = MatchScore_x[S[j]];
+		}
+	}
+
+void QueryPair::Init(const byte *X, uint LX, const byte *Y, uint LY,
+  const QueryProf *PX, const QueryProf *PY)
+	{
+	if (PX == 0 || PY == 0)
+		{
+	// Both are encoded, so the alphabet must cover X and Y
+		m_OwnAlpha.Clear();
+		m_OwnAlpha.Add(X, LX);
+		m_OwnAlpha.Add(Y, LY);
+		m_OwnX.Init(m_OwnAlpha, X, LX);
+		m_OwnY.Init(m_OwnAlpha, Y, LY);
+		PX = &m_OwnX;
+		PY = &m_OwnY;
+		}
+	asserta(PX->m_L == LX && PY->m_L == LY);
+	asserta(PX->m_LetterCount == PY->m_LetterCount);
+	m_X = PX;
+	m_Y = PY;
+	m_InsY = PY->m_InsY.data();
+	}
@@ -0,0 +1,77 @@
+#pragma once
+
+/***
+Pair-HMM emission scores laid out for the DP inner loop.
+
+QueryAlpha numbers the distinct characters of a set of sequences in
+order of first appearance (typically 20 amino acids or 4 nucleotides
+plus any wildcards). m_LetterToChar maps a letter back to the raw
+character, so wildcard and lowercase scores stay exactly as PairHMM
+defines them.
+
+QueryProf is one sequence S under an alphabet: S encoded as letters
+(used when S is X) and, for each letter a, a row of match scores
+MatchScore[a][S[j]] plus the insert scores of S (used when S is Y).
+MPCFlat builds one QueryProf per input sequence in InitSeqs, so a
+pair (X,Y) needs no per-pair setup: row i of the DP streams through
+Y's contiguous row for letter X[i] instead of indexing the 256x256
+MatchScore table with raw characters. Scores are copied from
+PairHMM unchanged, so results are identical.
+
+QueryPair is the view used by the kernels. Callers without cached
+profiles (tests, single pairs) get profiles built for X's alphabet.
+***/
+class QueryAlpha
+	{
+public:
+	byte m_CharToLetter[256];
+	vector<byte> m_LetterToChar;
+
+public:
+	QueryAlpha() { Clear(); }
+	void Clear();
+	void Add(const byte *S, uint L);
+	uint GetLetterCount() const { return SIZE(m_LetterToChar); }
+	};
+
+class QueryProf
+	{
+public:
+	uint m_L = 0;
+	uint m_LetterCount = 0;
+	vector<byte> m_Letters;		// m_L
+	vector<float> m_InsY;		// m_L+1, m_InsY[m_L] = InsScore[0]
+	vector<float> m_Match;		// m_LetterCount rows of m_L
+
+public:
+	void Init(const QueryAlpha &Alpha, const byte *S, uint L);
+
+	const float *GetMatchRow(uint Letter) const
+		{
+		assert(Letter < m_LetterCount);
+		return m_Match.data() + uint64(Letter)*m_L;
+		}
+	};
+
+class QueryPair
+	{
+public:
+	const QueryProf *m_X = 0;
+	const QueryProf *m_Y = 0;
+	const float *m_InsY = 0;
+
+// Used only if caller has no cached profiles
+	QueryAlpha m_OwnAlpha;
+	QueryProf m_OwnX;
+	QueryProf m_OwnY;
+
+public:
+	void Init(const byte *X, uint LX, const byte *Y, uint LY,
+	  const QueryProf *PX = 0, const QueryProf *PY = 0);
+
+	const float *GetMatchRow(uint i) const
+		{
+		assert(i < m_X->m_L);
+		return m_Y->GetMatchRow(m_X->m_Letters[i]);
+		}
+	};
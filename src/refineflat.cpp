@@ -10,11 +10,23 @@ void MPCFlat::RefineIter()
 	asserta(m_MSA->GetSeqCount() == SeqCount);
 
 	// create two separate groups
+	uint32 r = m_RefineIterState;
 	for (uint SeqIndex = 0; SeqIndex < SeqCount; SeqIndex++)
-		if (rand()%2 == 0)
+		{
+		bool In1;
+		if (m_RefineIterSeeded)
+			{
+			r = HashMix32(r, SeqIndex);
+			In1 = (r%2 == 0);
+			}
+		else
+			In1 = (rand()%2 == 0);
+		if (In1)
 			SeqIndexes1.insert(SeqIndex);
 		else
 			SeqIndexes2.insert(SeqIndex);
+		}
+	m_RefineIterState = HashMix32(r, SeqCount);
 
 	if (SeqIndexes1.empty() || SeqIndexes2.empty())
 		return;
@@ -29,3 +41,130 @@ void MPCFlat::RefineIter()
 	delete MSA1;
 	delete MSA2;
 	}
+
+/***
+Refinement candidate for batched refinement: split m_MSA into
+two groups by a bipartition seeded from m_RefineSeed, m_TreePerm
+and CandidateIndex, and realign the two projections. Sequences within
+a group keep their alignment, so only the cross-group score
+can change. Gain is the relative improvement of the optimal path
+over the path implied by m_MSA. It is never negative, up to float
+rounding, because the current path is one of the paths the DP
+considers. Returns 0 if one group is empty.
+***/
+MultiSequence *MPCFlat::RefineCandidate(uint CandidateIndex, float &Gain)
+	{
+	Gain = 0;
+	const uint SeqCount = GetSeqCount();
+	vector<uint> SeqIndexes1;
+	vector<uint> SeqIndexes2;
+	uint32 r = HashMix32(HashMix32(m_RefineSeed, uint32(m_TreePerm)),
+	  CandidateIndex);
+	for (uint SeqIndex = 0; SeqIndex < SeqCount; ++SeqIndex)
+		{
+		r = HashMix32(r, SeqIndex);
+		if (r%2 == 0)
+			SeqIndexes1.push_back(SeqIndex);
+		else
+			SeqIndexes2.push_back(SeqIndex);
+		}
+	if (SeqIndexes1.empty() || SeqIndexes2.empty())
+		return 0;
+
+	MultiSequence *MSA1 = m_MSA->Project(SeqIndexes1);
+	MultiSequence *MSA2 = m_MSA->Project(SeqIndexes2);
+	const uint ColCount1 = MSA1->GetColCount();
+	const uint ColCount2 = MSA2->GetColCount();
+	if (double(ColCount1 + 1)*double(ColCount2 + 1) + 100 > double(UINT_MAX))
+		Die("Refine Cols1=%u, Cols2=%u overflow 32-bit DP buffers", ColCount1, ColCount2);
+
+	float *Post = AllocPost(ColCount1, ColCount2);
+	BuildPost(*MSA1, *MSA2, Post);
+
+// Score of the current alignment of the two groups
+	const uint ColCount = m_MSA->GetColCount();
+	uint Col1 = 0;
+	uint Col2 = 0;
+	double CurrentScore = 0;
+	for (uint Col = 0; Col < ColCount; ++Col)
+		{
+		bool Has1 = false;
+		for (uint k = 0; k < SIZE(SeqIndexes1) && !Has1; ++k)
+			Has1 = (m_MSA->GetChar(SeqIndexes1[k], Col) != '-');
+		bool Has2 = false;
+		for (uint k = 0; k < SIZE(SeqIndexes2) && !Has2; ++k)
+			Has2 = (m_MSA->GetChar(SeqIndexes2[k], Col) != '-');
+		if (Has1 && Has2)
+			CurrentScore += Post[uint64(Col1)*ColCount2 + Col2];
+		Col1 += (Has1 ? 1 : 0);
+		Col2 += (Has2 ? 1 : 0);
+		}
+	asserta(Col1 == ColCount1 && Col2 == ColCount2);
+
+	float *DPRows = AllocDPRows(ColCount1, ColCount2);
+	char *TB = AllocTB(ColCount1, ColCount2);
+	string Path;
+	float Score = CalcAlnFlat(Post, ColCount1, ColCount2, DPRows, TB, Path);
+	myfree(Post);
+	myfree(DPRows);
+	myfree(TB);
+
+	Gain = float((Score - CurrentScore)/max(CurrentScore, 1.0));
+	MultiSequence *MSA12 = AlignAlnsFromPath(MSA1, MSA2, Path);
+	delete MSA1;
+	delete MSA2;
+	return MSA12;
+	}
+
+// Rounds of m_RefineBatchSize candidates evaluated in parallel,
+// best gain accepted. Candidates are seeded by index so the result
+// does not depend on thread count.
+void MPCFlat::RefineBatch()
+	{
+	const uint BatchSize = m_RefineBatchSize;
+	asserta(BatchSize > 0);
+	const uint RoundCount = (m_RefineIterCount + BatchSize - 1)/BatchSize;
+	const uint ThreadCount = GetThreadCount();
+
+	vector<MultiSequence *> MSAs(BatchSize, 0);
+	vector<float> Gains(BatchSize, 0);
+	uint StaleRoundCount = 0;
+	for (uint Round = 0; Round < RoundCount; ++Round)
+		{
+		if (!m_Quiet)
+			ProgressStep(Round, RoundCount, "Refining");
+	// Last round may be partial, m_RefineIterCount candidates in total
+		const uint n = min(BatchSize, m_RefineIterCount - Round*BatchSize);
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1)
+		for (int i = 0; i < (int) n; ++i)
+			MSAs[i] = RefineCandidate(Round*BatchSize + i, Gains[i]);
+
+		uint Best = UINT_MAX;
+		for (uint i = 0; i < n; ++i)
+			if (MSAs[i] != 0 && (Best == UINT_MAX || Gains[i] > Gains[Best]))
+				Best = i;
+
+		if (Best != UINT_MAX && Gains[Best] > REFINE_MIN_GAIN)
+			{
+			delete m_MSA;
+			m_MSA = MSAs[Best];
+			MSAs[Best] = 0;
+			StaleRoundCount = 0;
+			}
+		else
+			++StaleRoundCount;
+
+		for (uint i = 0; i < BatchSize; ++i)
+			{
+			delete MSAs[i];
+			MSAs[i] = 0;
+			}
+
+		if (m_RefineStopRounds > 0 && StaleRoundCount >= m_RefineStopRounds)
+			{
+			if (Round + 1 < RoundCount && !m_Quiet)
+				ProgressStep(RoundCount - 1, RoundCount, "Refining (converged)");
+			break;
+			}
+		}
+	}
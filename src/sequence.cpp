@@ -121,19 +121,18 @@ Sequence* Sequence::AddGapsPath(const string &Path, char id) const
 	//ret->m_SMI = m_SMI;
 
 	ret->m_Label = m_Label;
-	ret->m_CharVec.clear();
-
-	vector<char>::const_iterator dataIter = m_CharVec.begin();
-	for (string::const_iterator iter = Path.begin();
-	  iter != Path.end(); ++iter)
+	const uint ColCount = SIZE(Path);
+	ret->m_CharVec.resize(ColCount);
+	char *Row = ret->m_CharVec.data();
+	const char *Chars = m_CharVec.data();
+	uint Pos = 0;
+	for (uint Col = 0; Col < ColCount; ++Col)
 		{
-		if (*iter == 'M' || *iter == 'B' || *iter == id)
-			{
-			ret->m_CharVec.push_back(*dataIter);
-			++dataIter;
-			}
+		char c = Path[Col];
+		if (c == 'M' || c == 'B' || c == id)
+			Row[Col] = Chars[Pos++];
 		else
-			ret->m_CharVec.push_back('-');
+			Row[Col] = '-';
 		}
 
 	return ret;
@@ -6,6 +6,7 @@
 #include "upgma5.h"
 #include "pprog.h"
 #include "treeperm.h"
+#include "mbedtree.h"
 
 void LogDistMx(const string &Msg, const vector<vector<float> > &Mx);
 void GetConsensusSequence(const MultiSequence &MSA, string &Seq);
@@ -33,6 +34,23 @@ void Super4::MakeGuideTree()
 	U.Run(LINKAGE_Biased, m_GuideTree_None);
 	}
 
+// -mbed, no all-vs-all EA matrix on the consensus sequences
+void Super4::MakeGuideTree_MBed()
+	{
+	MBedTree MB;
+	MB.Run(m_ConsensusSeqs, m_ClusterLabels, m_GuideTree_None);
+	}
+
+// -mbed on input sequences, leaves labeled by sequence labels
+void MakeGuideTree_MBed(const MultiSequence &Seqs, Tree &GuideTree)
+	{
+	vector<string> Labels;
+	for (uint i = 0; i < Seqs.GetSeqCount(); ++i)
+		Labels.push_back(Seqs.GetLabelStr(i));
+	MBedTree MB;
+	MB.Run(Seqs, Labels, GuideTree);
+	}
+
 void Super4::SplitBigMFA_Random(MultiSequence &InputMFA, uint MaxSize,
   vector<MultiSequence *> &SplitMFAs)
 	{
@@ -265,8 +283,13 @@ void Super4::CoarseAlign()
 	ClusterInput();
 	AlignClusters();
 	GetConsensusSeqs();
-	CalcConsensusSeqsDistMx();
-	MakeGuideTree();
+	if (opt(mbed))
+		MakeGuideTree_MBed();
+	else
+		{
+		CalcConsensusSeqsDistMx();
+		MakeGuideTree();
+		}
 	InitPP();
 	}
 
@@ -65,5 +65,6 @@ public:
 	void GetConsensusSeqs();
 	void CalcConsensusSeqsDistMx();
 	void MakeGuideTree();
+	void MakeGuideTree_MBed();
 	void DeleteClusterMSAs();
 	};
@@ -19,6 +19,7 @@ void CharVecToStr(const vector<char> &Vec, string &Str)
 void Super5::SetOpts()
 	{
 	m_MinEAPass1 = (float) optd(super5_minea1, DEFAULT_MIN_EA_SUPER5_PASS1);
+	m_U.m_BatchSize = optd(uclustbatch, 0);
 	}
 
 void Super5::ClearTreesAndMSAs()
@@ -2,9 +2,11 @@
 #include "upgma5.h"
 #include "pprog.h"
 #include "super7.h"
+#include "locallock.h"
 
 void GetShrubs(const Tree &T, uint n, vector<uint> &ShrubLCAs);
 void CalcGuideTree_SW_BLOSUM62(const MultiSequence &Input, Tree &T);
+void MakeGuideTree_MBed(const MultiSequence &Seqs, Tree &GuideTree);
 
 void Super7::Run(MultiSequence &InputSeqs,
   const Tree &GuideTree, uint ShrubSize)
@@ -113,27 +115,102 @@ void Super7::MakeShrubInput(uint LCA, MultiSequence &ShrubInput)
 		}
 	}
 
-void Super7::IntraAlignShrub(uint ShrubIndex)
+void Super7::IntraAlignShrub(uint ShrubIndex, MPCFlat &MPC)
 	{
 	uint LCA = m_ShrubLCAs[ShrubIndex];
 	MultiSequence ShrubInput;
 	MakeShrubInput(LCA, ShrubInput);
-	m_MPC->m_TreePerm = TP_None;
-	m_MPC->Run(&ShrubInput);
+	MPC.m_TreePerm = TP_None;
+	MPC.Run(&ShrubInput);
 	MultiSequence *ShrubMSA = new MultiSequence;
-	ShrubMSA->Copy(*m_MPC->m_MSA);
-	m_ShrubMSAs.push_back(ShrubMSA);
+	ShrubMSA->Copy(*MPC.m_MSA);
+	m_ShrubMSAs[ShrubIndex] = ShrubMSA;
 	}
 
+/***
+Shrubs are independent, so they are aligned concurrently with one
+MPCFlat per shrub thread, largest first (dynamic schedule) so a big
+shrub does not start last and leave the other threads idle.
+Threads are split between shrubs and the pair-level loops inside
+each MPCFlat, ShrubThreads x PairThreads <= requested threads.
+Refinement bipartitions are seeded by shrub index, so the result
+does not depend on the thread count or the order shrubs finish.
+***/
 void Super7::IntraAlignShrubs()
 	{
 	asserta(m_ShrubMSAs.empty());
-	uint ShrubCount = GetShrubCount();
+	const uint ShrubCount = GetShrubCount();
+	m_ShrubMSAs.resize(ShrubCount, 0);
+
+	vector<uint> Sizes(ShrubCount);
+	vector<uint> Order(ShrubCount);
 	for (uint ShrubIndex = 0; ShrubIndex < ShrubCount; ++ShrubIndex)
 		{
-		ProgressLog("Aligning shrub %u / %u\n", ShrubIndex+1, ShrubCount);
-		IntraAlignShrub(ShrubIndex);
+		Sizes[ShrubIndex] =
+		  m_GuideTree->GetSubtreeLeafCount(m_ShrubLCAs[ShrubIndex]);
+		Order[ShrubIndex] = ShrubIndex;
 		}
+	stable_sort(Order.begin(), Order.end(),
+	  [&Sizes](uint i, uint j) { return Sizes[i] > Sizes[j]; });
+
+	const uint ThreadCount = GetRequestedThreadCount();
+	uint ShrubThreads = m_ShrubThreadCount;
+	if (ShrubThreads == 0 || ShrubThreads > ThreadCount)
+		ShrubThreads = ThreadCount;
+	if (ShrubThreads > ShrubCount)
+		ShrubThreads = ShrubCount;
+	const uint PairThreads = max(1u, ThreadCount/ShrubThreads);
+
+	asserta(m_MPC != 0);
+	m_MPCs.clear();
+	m_MPCs.push_back(m_MPC);
+	while (SIZE(m_MPCs) < ShrubThreads)
+		m_MPCs.push_back(NewMPC());
+	m_MPC->m_RefineIterSeeded = true;
+	m_MPC->m_ThreadCount = PairThreads;
+	for (uint i = 1; i < ShrubThreads; ++i)
+		m_MPCs[i]->CopyParams(*m_MPC);
+
+// Progress state is global, so shrub MPCFlats run quiet and only
+// the shrub headers are shown. opt_quiet is not touched in the loop.
+	const bool SavedQuiet = opt_quiet;
+	const int SavedLevels = omp_get_max_active_levels();
+	if (ShrubThreads > 1)
+		{
+		opt_quiet = true;
+		if (PairThreads > 1)
+			omp_set_max_active_levels(2);
+		}
+
+	uint Counter = 0;
+#pragma omp parallel for num_threads(ShrubThreads) schedule(dynamic, 1)
+	for (int k = 0; k < (int) ShrubCount; ++k)
+		{
+		const uint ShrubIndex = Order[k];
+		MPCFlat &MPC = *m_MPCs[GetThreadIndex()];
+		Lock();
+		++Counter;
+		if (ShrubThreads == 1)
+			ProgressLog("Aligning shrub %u / %u (%u seqs)\n",
+			  Counter, ShrubCount, Sizes[ShrubIndex]);
+		else
+			{
+			Log("Aligning shrub %u / %u (%u seqs)\n",
+			  Counter, ShrubCount, Sizes[ShrubIndex]);
+			if (!SavedQuiet)
+				fprintf(stderr, "Aligning shrub %u / %u (%u seqs)\n",
+				  Counter, ShrubCount, Sizes[ShrubIndex]);
+			}
+		Unlock();
+		MPC.m_RefineIterState = HashMix32(m_MPC->m_RefineSeed, ShrubIndex);
+		IntraAlignShrub(ShrubIndex, MPC);
+		}
+
+	opt_quiet = SavedQuiet;
+	omp_set_max_active_levels(SavedLevels);
+	for (uint i = 1; i < SIZE(m_MPCs); ++i)
+		delete m_MPCs[i];
+	m_MPCs.clear();
 	}
 
 void cmd_super7()
@@ -163,10 +240,12 @@ void cmd_super7()
 		U.ScaleDistMx();
 		U.Run(LINKAGE_Avg, GuideTree);
 		}
+	else if (opt(mbed))
+		MakeGuideTree_MBed(InputSeqs, GuideTree);
 	else
 		{
 		if (Mega::m_Loaded)
-			Die("Must specify -guidetreein or -distmxin with mega");
+			Die("Must specify -guidetreein, -distmxin or -mbed with mega");
 		CalcGuideTree_SW_BLOSUM62(InputSeqs, GuideTree);
 		}
 
@@ -175,6 +254,8 @@ void cmd_super7()
 
 	Super7 S7;
 	S7.m_MPC = new MPCFlat;
+	if (optset_shrub_threads)
+		S7.m_ShrubThreadCount = opt(shrub_threads);
 	S7.Run(InputSeqs, GuideTree, ShrubSize);
 	S7.m_FinalMSA.ToFasta(opt(output));
 
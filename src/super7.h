@@ -11,6 +11,13 @@ public:
 	Tree m_ShrubTree;
 
 	MPCFlat *m_MPC = 0;
+
+// Shrubs are aligned concurrently, one MPCFlat per shrub thread
+// (m_MPCs[0] is m_MPC). m_ShrubThreadCount=0 means one per
+// requested thread; the remaining threads go to pair-level loops
+// inside each MPCFlat.
+	uint m_ShrubThreadCount = 0;
+	vector<MPCFlat *> m_MPCs;
 	vector<const MultiSequence *> m_ShrubMSAs;
 	vector<string> m_ShrubLabels;
 
@@ -31,13 +38,14 @@ protected:
 	void SetShrubTree();
 	void IntraAlignShrubs();
 	void ProgAlign();
+	virtual MPCFlat *NewMPC() const { return new MPCFlat; }
 
 public:
 	virtual void Run(MultiSequence &InputSeqs,
 	  const Tree &GuideTree, uint ShrubSize);
 
 private:
-	virtual void IntraAlignShrub(uint ShrubIndex);
+	virtual void IntraAlignShrub(uint ShrubIndex, MPCFlat &MPC);
 	};
 
 class Super7_mega : public Super7
@@ -48,8 +56,9 @@ public:
 
 protected:
 	void GetShrubProfiles(uint LCA,
-	  vector<const vector<vector<byte> > *> &ProfilePtrVec);
+	  vector<const MegaProfile *> &ProfilePtrVec);
 
 protected:
-	virtual void IntraAlignShrub(uint ShrubIndex);
+	virtual MPCFlat *NewMPC() const;
+	virtual void IntraAlignShrub(uint ShrubIndex, MPCFlat &MPC);
 	};
@@ -5,26 +5,32 @@
 #include "mpcflat_mega.h"
 
 void CalcGuideTree_SW_BLOSUM62(const MultiSequence &Input, Tree &T);
+void MakeGuideTree_MBed(const MultiSequence &Seqs, Tree &GuideTree);
 
-void Super7_mega::IntraAlignShrub(uint ShrubIndex)
+MPCFlat *Super7_mega::NewMPC() const
 	{
-	MPCFlat_mega *MPCm = (MPCFlat_mega *) m_MPC;
+	return new MPCFlat_mega;
+	}
+
+void Super7_mega::IntraAlignShrub(uint ShrubIndex, MPCFlat &MPC)
+	{
+	MPCFlat_mega *MPCm = (MPCFlat_mega *) &MPC;
 	uint LCA = m_ShrubLCAs[ShrubIndex];
 	MultiSequence ShrubInput;
 	MakeShrubInput(LCA, ShrubInput);
 
-	vector<const vector<vector<byte> > *> ProfilePtrVec;
+	vector<const MegaProfile *> ProfilePtrVec;
 	GetShrubProfiles(LCA, ProfilePtrVec);
 
 	MPCm->m_TreePerm = TP_None;
 	MPCm->Run(&ShrubInput);
 	MultiSequence *ShrubMSA = new MultiSequence;
 	ShrubMSA->Copy(*MPCm->m_MSA);
-	m_ShrubMSAs.push_back(ShrubMSA);
+	m_ShrubMSAs[ShrubIndex] = ShrubMSA;
 	}
 
 void Super7_mega::GetShrubProfiles(uint LCA,
-  vector<const vector<vector<byte> > *> &ProfilePtrVec)
+  vector<const MegaProfile *> &ProfilePtrVec)
 	{
 	ProfilePtrVec.clear();
 	vector<uint> LeafNodes;
@@ -39,8 +45,7 @@ void Super7_mega::GetShrubProfiles(uint LCA,
 		uint SeqIndex = m_NodeToSeqIndex[Node];
 		string Label;
 		m_GuideTree->GetLabel(Node, Label);
-		const vector<vector<byte> > *ptrProfile =
-		  Mega::GetProfileByLabel(Label);
+		const MegaProfile *ptrProfile = Mega::GetProfileByLabel(Label);
 		ProfilePtrVec.push_back(ptrProfile);
 		}
 	}
@@ -59,11 +64,11 @@ void Super7_mega::Run(MultiSequence &InputSeqs,
 		{
 		MPCFlat_mega &M = (MPCFlat_mega &) *m_MPC;
 		const uint SeqCount = InputSeqs.GetSeqCount();
-		vector<const vector<vector<byte> > *> ProfilePtrVec;
+		vector<const MegaProfile *> ProfilePtrVec;
 		for (uint i = 0; i < SeqCount; ++i)
 			{
 			const uint L = InputSeqs.GetSeqLength(i);
-			vector<vector<byte> > *ptrProfile = &Mega::m_Profiles[i];
+			const MegaProfile *ptrProfile = &Mega::m_Profiles[i];
 			const uint PL = uint(ptrProfile->size());
 			asserta(PL == L);
 			ProfilePtrVec.push_back(ptrProfile);
@@ -103,6 +108,8 @@ void cmd_super7_mega()
 		U.ScaleDistMx();
 		U.Run(LINKAGE_Avg, GuideTree);
 		}
+	else if (opt(mbed))
+		MakeGuideTree_MBed(InputSeqs, GuideTree);
 	else
 		CalcGuideTree_SW_BLOSUM62(InputSeqs, GuideTree);
 
@@ -113,6 +120,8 @@ void cmd_super7_mega()
 	MPCFlat_mega *MPCm = new MPCFlat_mega;
 	//MPCm->m_MM = &MM;
 	S7.m_MPC = MPCm;
+	if (optset_shrub_threads)
+		S7.m_ShrubThreadCount = opt(shrub_threads);
 	S7.Run(InputSeqs, GuideTree, ShrubSize);
 	S7.m_FinalMSA.ToFasta(opt(output));
 
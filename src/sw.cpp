@@ -70,8 +70,9 @@ void TraceBackBitSW(XDPMem &Mem,
   uint LA, uint LB, uint Besti, uint Bestj,
   uint &Leni, uint &Lenj, string &Path)
 	{
-	asserta(Besti < LA);
-	asserta(Bestj < LB);
+// Besti, Bestj are 1-based (DP row/col of the last M)
+	asserta(Besti <= LA);
+	asserta(Bestj <= LB);
 	Path.clear();
 	byte **TB = Mem.GetTBBit();
 
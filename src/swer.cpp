@@ -92,21 +92,9 @@ static MASM *MakeMASM_Rows(const vector<string> &Rows,
 	return M;
 	}
 
-static void MakeMegaProfile(const string &Seq,
-  vector<vector<byte> > &Prof)
+static void MakeMegaProfile(const string &Seq, MegaProfile &Prof)
 	{
-	const uint L = SIZE(Seq);
-	Prof.clear();
-	for (uint Pos = 0; Pos < L; ++Pos)
-		{
-		vector<byte> Col;
-		char c = Seq[Pos];
-		byte Letter = g_CharToLetterAmino[c];
-		if (Letter >= 20)
-			Letter = 0;
-		Col.push_back(Letter);
-		Prof.push_back(Col);
-		}
+	Prof.FromAASeq(Seq);
 	}
 
 uint SWer::GetNA(const string &Path) const
@@ -238,14 +226,14 @@ float SWer_Simple_Seqs_AA_BLOSUM62::SW(uint &LoA, uint &LoB, string &Path)
 float SWer_MASM_Mega_Seqs::SW(uint &LoA, uint &LoB, string &Path)
 	{
 	float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
-	  const vector<vector<byte> > &PB, float Open, float Ext,
+	  const MegaProfile &PB, float Open, float Ext,
 	  uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path);
 
 	asserta(m_GapOpen != FLT_MAX && m_GapOpen < 0);
 	asserta(m_GapExt != FLT_MAX && m_GapExt < 0);
 
 	MASM *MA = MakeMASM_Seq(m_A, m_GapOpen, m_GapExt);
-	vector<vector<byte> > &PB = *new vector<vector<byte> >;
+	MegaProfile &PB = *new MegaProfile;
 	MakeMegaProfile(m_B, PB);
 
 	m_PS.m_LA = m_LA;
@@ -272,7 +260,7 @@ float SWer_Simple_MASM_Mega::SW(uint &LoA, uint &LoB, string &Path)
 	asserta(m_GapOpen != FLT_MAX && m_GapOpen < 0);
 	asserta(m_GapExt != FLT_MAX && m_GapExt < 0);
 
-	vector<vector<byte> > &PB = *new vector<vector<byte> >;
+	MegaProfile &PB = *new MegaProfile;
 	MakeMegaProfile(m_B, PB);
 	m_PS.m_MASM = MakeMASM_Rows(m_RowsA, m_GapOpen, m_GapExt);
 	m_PS.m_MegaProfile = &PB;
@@ -298,14 +286,14 @@ float SWer_Simple_MASM_Mega::SW(uint &LoA, uint &LoB, string &Path)
 float SWer_MASM_Mega::SW(uint &LoA, uint &LoB, string &Path)
 	{
 	float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
-	  const vector<vector<byte> > &PB, float Open, float Ext,
+	  const MegaProfile &PB, float Open, float Ext,
 	  uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path);
 
 	asserta(m_GapOpen != FLT_MAX && m_GapOpen < 0);
 	asserta(m_GapExt != FLT_MAX && m_GapExt < 0);
 
 	MASM *MA = MakeMASM_Rows(m_RowsA, m_GapOpen, m_GapExt);
-	vector<vector<byte> > PB;
+	MegaProfile PB;
 	MakeMegaProfile(m_B, PB);
 
 	XDPMem Mem;
@@ -340,7 +328,7 @@ float SWer_Enum_MASM_Mega::SW(uint &LoA, uint &LoB, string &Path)
 	vector<string> RowsA;
 	Split(m_A, RowsA, '|');
 	MASM *MA = MakeMASM_Rows(RowsA, m_GapOpen, m_GapExt);
-	vector<vector<byte> > &PB = *new vector<vector<byte> >;
+	MegaProfile &PB = *new MegaProfile;
 	MakeMegaProfile(m_B, PB);
 
 	m_PS.m_LA = m_LA;
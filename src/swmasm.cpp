@@ -4,61 +4,153 @@
 #include "xdpmem.h"
 #include "swtrace.h"
 #include "masm.h"
+#include "locallock.h"
 
 void WriteLocalAln_MASM(FILE *f, const string &LabelA, const MASM &MA,
-  const string &LabelQ, const vector<vector<byte> > &Q,
+  const string &LabelQ, const MegaProfile &Q,
   uint Loi, uint Loj, const char *Path);
 
-float SWFast_SMx(XDPMem &Mem, const Mx<float> &SMx,
-  float Open, float Ext, uint &Loi, uint &Loj, uint &Leni, uint &Lenj,
-  string &Path);
+float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
+  const MegaProfile &PB, float Open, float Ext,
+  uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path);
 
-float SWFast_MASM(XDPMem &Mem, const MASM &A, const vector<vector<byte> > &B,
-  uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path)
+struct MASMHit
 	{
-	float Open = A.m_GapOpen;
-	float Ext = A.m_GapExt;
-	Mx<float> SMx;
-	A.MakeSMx(B, SMx);
-	float Score = SWFast_SMx(Mem, SMx, -Open, -Ext, Loi, Loj, Leni, Lenj, Path);
-	return Score;
+	uint64 PairIndex;
+	float Score;
+	uint Loi;
+	uint Loj;
+	uint Leni;
+	uint Lenj;
+	};
+
+static bool HitLT(const MASMHit &Hit1, const MASMHit &Hit2)
+	{
+	return Hit1.PairIndex < Hit2.PairIndex;
 	}
 
+/***
+Search one or more MASMs (concatenated in g_Arg1) against every
+profile in the -query Mega file. Pairs are aligned in parallel by
+SWFast_MASM_MegaProf, which scores columns as the DP goes (no
+LA x LB matrix), each thread with its own XDPMem. Hits passing
+-minscore (default all) are kept per thread and written sorted by
+pair, i.e. in input order (MASM-major), one tab-separated line:
+	masm_label  query_label  score  masm_lo  masm_hi  query_lo  query_hi
+Positions are 1-based, 0 if there is no local alignment. Sort by
+score with e.g. sort -t$'\t' -k3,3gr.
+***/
 void cmd_swmasm()
 	{
 	const string &MasmFN = g_Arg1;
 	const string &MegaFN = opt(query);
-
-	FILE *fOut = CreateStdioFile(opt(output));
+	const bool HasMinScore = optset_minscore;
+	const float MinScore = (float) opt(minscore);
 
 	Mega::FromFile(MegaFN);
 
-	MASM M;
-	M.FromFile(MasmFN);
-	const string &LabelM = M.m_Label;
+	vector<MASM *> MASMs;
+	FILE *fMasm = OpenStdioFile(MasmFN);
+	for (;;)
+		{
+		MASM *M = new MASM;
+		if (!M->FromFile(fMasm))
+			{
+			delete M;
+			break;
+			}
+		MASMs.push_back(M);
+		}
+	CloseStdioFile(fMasm);
+	if (MASMs.empty())
+		Die("Empty MASM file %s", MasmFN.c_str());
 
-	XDPMem Mem;
+	const uint MASMCount = SIZE(MASMs);
 	const uint QueryProfileCount = Mega::GetProfileCount();
-	for (uint i = 0; i < QueryProfileCount; ++i)
+	const uint64 PairCount = uint64(MASMCount)*QueryProfileCount;
+
+	const uint ThreadCount = GetRequestedThreadCount();
+	vector<XDPMem *> Mems;
+	for (uint i = 0; i < ThreadCount; ++i)
+		Mems.push_back(new XDPMem);
+	vector<vector<MASMHit> > ThreadHits(ThreadCount);
+
+	uint64 Counter = 0;
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 8)
+	for (int64 PairIndex = 0; PairIndex < (int64) PairCount; ++PairIndex)
 		{
-		ProgressStep(i, QueryProfileCount, "Aligning");
-		const vector<vector<byte> > &Q = Mega::GetProfile(i);
-		const string &LabelQ = Mega::GetLabel(i);
-		uint Loi, Loj, Leni, Lenj;
+		const uint MASMIndex = uint(uint64(PairIndex)/QueryProfileCount);
+		const uint QueryIndex = uint(uint64(PairIndex)%QueryProfileCount);
+		const uint ThreadIndex = GetThreadIndex();
+		const MASM &M = *MASMs[MASMIndex];
+		const MegaProfile &Q = Mega::GetProfile(QueryIndex);
+
+		Lock();
+		ProgressStep64(Counter++, PairCount, "Aligning");
+		Unlock();
+
+		MASMHit Hit;
+		Hit.PairIndex = uint64(PairIndex);
+		Hit.Loi = 0;
+		Hit.Loj = 0;
 		string Path;
-		float Score = SWFast_MASM(Mem, M, Q, Loi, Loj, Leni, Lenj, Path);
-		WriteLocalAln_MASM(g_fLog, LabelM, M, LabelQ, Q, Loi, Loj, Path.c_str());
-		Log("Score = %.3g\n", Score);
-		Log("\n");
+		Hit.Score = SWFast_MASM_MegaProf(*Mems[ThreadIndex], M, Q,
+		  -M.m_GapOpen, -M.m_GapExt, Hit.Loi, Hit.Loj, Hit.Leni, Hit.Lenj,
+		  Path);
+		if (HasMinScore && Hit.Score < MinScore)
+			continue;
+		ThreadHits[ThreadIndex].push_back(Hit);
 
-		if (fOut != 0)
+		if (g_fLog != 0)
 			{
-			fprintf(fOut, "%s", LabelM.c_str());
-			fprintf(fOut, "\t%s", LabelQ.c_str());
-			fprintf(fOut, "\t%.3g", Score);
-			fprintf(fOut, "\n");
+			Lock();
+			WriteLocalAln_MASM(g_fLog, M.m_Label, M, Mega::GetLabel(QueryIndex),
+			  Q, Hit.Loi, Hit.Loj, Path.c_str());
+			Log("Score = %.3g\n", Hit.Score);
+			Log("\n");
+			Unlock();
 			}
 		}
 
+	vector<MASMHit> Hits;
+	for (uint i = 0; i < ThreadCount; ++i)
+		{
+		Hits.insert(Hits.end(), ThreadHits[i].begin(), ThreadHits[i].end());
+		vector<MASMHit>().swap(ThreadHits[i]);
+		}
+	sort(Hits.begin(), Hits.end(), HitLT);
+	const uint64 HitCount = Hits.size();
+
+	FILE *fOut = CreateStdioFile(opt(output));
+	for (uint64 k = 0; fOut != 0 && k < HitCount; ++k)
+		{
+		const MASMHit &Hit = Hits[k];
+		const uint MASMIndex = uint(Hit.PairIndex/QueryProfileCount);
+		const uint QueryIndex = uint(Hit.PairIndex%QueryProfileCount);
+		uint LoA = 0, HiA = 0, LoQ = 0, HiQ = 0;
+		if (Hit.Leni > 0)
+			{
+			LoA = Hit.Loi + 1;
+			HiA = Hit.Loi + Hit.Leni;
+			LoQ = Hit.Loj + 1;
+			HiQ = Hit.Loj + Hit.Lenj;
+			}
+		fprintf(fOut, "%s", MASMs[MASMIndex]->m_Label.c_str());
+		fprintf(fOut, "\t%s", Mega::GetLabel(QueryIndex).c_str());
+		fprintf(fOut, "\t%.4g", Hit.Score);
+		fprintf(fOut, "\t%u\t%u", LoA, HiA);
+		fprintf(fOut, "\t%u\t%u", LoQ, HiQ);
+		fprintf(fOut, "\n");
+		}
 	CloseStdioFile(fOut);
+	ProgressLog("%u MASMs x %u queries, %llu hits\n",
+	  MASMCount, QueryProfileCount, (unsigned long long) HitCount);
+
+	for (uint i = 0; i < ThreadCount; ++i)
+		delete Mems[i];
+	for (uint i = 0; i < MASMCount; ++i)
+		{
+		MASMs[i]->Clear();
+		delete MASMs[i];
+		}
 	}
@@ -10,7 +10,7 @@ void TraceBackBitSW(XDPMem &Mem,
   uint &Leni, uint &Lenj, string &Path);
 
 float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
-  const vector<vector<byte> > &PB, float Open, float Ext,
+  const MegaProfile &PB, float Open, float Ext,
   uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path)
 	{
 #if TRACE && !DOTONLY
@@ -57,7 +57,6 @@ float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
 		byte *TBrow = TB[i];
 		for (uint j = 0; j < LB; ++j)
 			{
-			const vector<byte> &ColB = PB[j];
 			byte TraceBits = 0;
 			float SavedM0 = M0;
 
@@ -84,7 +83,7 @@ float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
 				}
 
 			M0 = Mrow[j];
-			float MatchScore = ColA.GetMatchScore_MegaProfilePos(ColB);
+			float MatchScore = ColA.GetMatchScore_MegaProfilePos(PB, j);
 			//xM += SMxRow[j];
 			xM += MatchScore;
 			if (xM > BestScore)
@@ -7,7 +7,7 @@ float SWFast_Strings_BLOSUM62(XDPMem &Mem,
   const string &A, const string &B, float Open, float Ext,
   uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path);
 float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
-  const vector<vector<byte> > &PB, float Open, float Ext,
+  const MegaProfile &PB, float Open, float Ext,
   uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path);
 
 static uint g_LA;
@@ -55,27 +55,15 @@ static MASM *MakeMASM_AA(const string &Seq)
 	return M;
 	}
 
-void MakeMegaProfile_AA(const string &Seq,
-  vector<vector<byte> > &Prof)
+void MakeMegaProfile_AA(const string &Seq, MegaProfile &Prof)
 	{
-	const uint L = SIZE(Seq);
-	Prof.clear();
-	for (uint Pos = 0; Pos < L; ++Pos)
-		{
-		vector<byte> Col;
-		char c = Seq[Pos];
-		byte Letter = g_CharToLetterAmino[c];
-		if (Letter >= 20)
-			Letter = 0;
-		Col.push_back(Letter);
-		Prof.push_back(Col);
-		}
+	Prof.FromAASeq(Seq);
 	}
 
 static void Test_MASM_Mega(const string &A, const string &B)
 	{
 	MASM &MA = *MakeMASM_AA(A);
-	vector<vector<byte> > PB;
+	MegaProfile PB;
 	MakeMegaProfile_AA(B, PB);
 	XDPMem Mem;
 	uint Loi, Loj, Leni, Lenj;
@@ -103,7 +91,7 @@ static void Test(const string &A, const string &B)
 	  g_GapExt, SWLoi, SWLoj, SWLeni, SWLenj, SWPath);
 
 	MASM &MA = *MakeMASM_AA(A);
-	vector<vector<byte> > PB;
+	MegaProfile PB;
 	MakeMegaProfile_AA(B, PB);
 	uint MMLoi, MMLoj, MMLeni, MMLenj;
 	string MMPath;
@@ -162,7 +150,7 @@ static void TestRandom()
 	  g_GapExt, SWLoi, SWLoj, SWLeni, SWLenj, SWPath);
 
 	MASM &MA = *MakeMASM_AA(A);
-	vector<vector<byte> > PB;
+	MegaProfile PB;
 	MakeMegaProfile_AA(B, PB);
 	uint MMLoi, MMLoj, MMLeni, MMLenj;
 	string MMPath;
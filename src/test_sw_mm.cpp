@@ -4,11 +4,10 @@
 #include "xdpmem.h"
 
 float SWFast_MASM_MegaProf(XDPMem &Mem, const MASM &MA,
-  const vector<vector<byte> > &PB, float Open, float Ext,
+  const MegaProfile &PB, float Open, float Ext,
   uint &Loi, uint &Loj, uint &Leni, uint &Lenj, string &Path);
 
-void MakeMegaProfile_AA(const string &Seq,
-  vector<vector<byte> > &Prof);
+void MakeMegaProfile_AA(const string &Seq, MegaProfile &Prof);
 
 static uint g_MinRandL = 3;
 static uint g_MaxRandL = 7;
@@ -82,7 +81,7 @@ static MASM *MakeMASM_AAs(const vector<string> &Rows)
 //static void Test_MASM_Mega(const vector<string> &RowsA, const string &B)
 //	{
 //	MASM &MA = *MakeMASM_AAs(RowsA);
-//	vector<vector<byte> > PB;
+//	MegaProfile PB;
 //	MakeMegaProfile_AA(B, PB);
 //	XDPMem Mem;
 //	uint Loi, Loj, Leni, Lenj;
@@ -108,7 +107,7 @@ static void Test(const vector<string> &RowsA, const string &B,
 	XDPMem Mem;
 	MASM &MA = *MakeMASM_AAs(RowsA);
 
-	vector<vector<byte> > PB;
+	MegaProfile PB;
 	MakeMegaProfile_AA(B, PB);
 
 	uint MMLoi, MMLoj, MMLeni, MMLenj;
@@ -186,7 +185,7 @@ static void LogPath(const string &sA, const string &B,
 	MASM &MA = *MakeMASM_AAs(RowsA);
 	MA.LogMe();
 
-	vector<vector<byte> > PB;
+	MegaProfile PB;
 	MakeMegaProfile_AA(B, PB);
 	g_LB = SIZE(B);
 
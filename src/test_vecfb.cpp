@@ -0,0 +1,143 @@
+#include "muscle.h"
+#include "hmmparams.h"
+#include <time.h>
+
+uint64 GetFBSize(uint LX, uint LY);
+
+// Max relative difference between two Flat matrices, ignoring
+// cells where both are LOG_ZERO-ish (probability zero).
+static float GetMaxDiff(const float *Flat1, const float *Flat2, uint64 n)
+	{
+	float MaxDiff = 0;
+	for (uint64 k = 0; k < n; ++k)
+		{
+		float a = Flat1[k];
+		float b = Flat2[k];
+		if (a < LOG_ZERO/2 && b < LOG_ZERO/2)
+			continue;
+		float d = fabsf(a - b)/max(1.0f, fabsf(a));
+		if (d > MaxDiff)
+			MaxDiff = d;
+		}
+	return MaxDiff;
+	}
+
+// Max abs difference between two posterior matrices. A probability
+// close to MIN_SPARSE_PROB may be zeroed by one kernel and not the
+// other, this is not counted as a difference.
+static float GetMaxPostDiff(const float *Post1, const float *Post2,
+  uint LX, uint LY, float Tol)
+	{
+	float MaxDiff = 0;
+	for (uint k = 0; k < LX*LY; ++k)
+		{
+		float a = Post1[k];
+		float b = Post2[k];
+		if ((a == 0) != (b == 0) && max(a, b) < MIN_SPARSE_PROB + Tol)
+			continue;
+		MaxDiff = max(MaxDiff, fabsf(a - b));
+		}
+	return MaxDiff;
+	}
+
+// Compare CalcFwdFlat/CalcBwdFlat with the -vecfb kernels
+// and -linmem posteriors on all pairs of input sequences.
+void cmd_test_vecfb()
+	{
+	MultiSequence InputSeqs;
+	LoadInput(InputSeqs);
+
+	bool Nucleo = InputSeqs.GuessIsNucleo();
+	SetAlpha(Nucleo ? ALPHA_Nucleo : ALPHA_Amino);
+	HMMParams HP;
+	HP.FromDefaults(Nucleo);
+	HP.ToPairHMM();
+
+	const uint SeqCount = InputSeqs.GetSeqCount();
+	const uint PairCount = (SeqCount*(SeqCount - 1))/2;
+	const float MaxDiffOk = 1e-5f;
+	const float MaxPostDiffOk = 0.02f;
+	const float MaxLinMemDiffOk = 1e-3f;
+
+	clock_t ScalarTicks = 0;
+	clock_t VecTicks = 0;
+	float MaxFwdDiff = 0;
+	float MaxBwdDiff = 0;
+	float MaxPostDiff = 0;
+	float MaxLinMemDiff = 0;
+	uint BadCount = 0;
+	uint PairIndex = 0;
+	for (uint i = 0; i < SeqCount; ++i)
+		{
+		const byte *X = InputSeqs.GetBytePtr(i);
+		const uint LX = InputSeqs.GetSeqLength(i);
+		for (uint j = i + 1; j < SeqCount; ++j)
+			{
+			ProgressStep(PairIndex++, PairCount, "Testing");
+			const byte *Y = InputSeqs.GetBytePtr(j);
+			const uint LY = InputSeqs.GetSeqLength(j);
+			const uint64 n = GetFBSize(LX, LY);
+
+			float *Fwd1 = AllocFB(LX, LY);
+			float *Bwd1 = AllocFB(LX, LY);
+			float *Fwd2 = AllocFB(LX, LY);
+			float *Bwd2 = AllocFB(LX, LY);
+			float *Post1 = AllocPost(LX, LY);
+			float *Post2 = AllocPost(LX, LY);
+
+			clock_t t1 = clock();
+			CalcFwdFlat(X, LX, Y, LY, Fwd1);
+			CalcBwdFlat(X, LX, Y, LY, Bwd1);
+			clock_t t2 = clock();
+			CalcFwdFlat_Vec(X, LX, Y, LY, Fwd2);
+			CalcBwdFlat_Vec(X, LX, Y, LY, Bwd2);
+			clock_t t3 = clock();
+			ScalarTicks += t2 - t1;
+			VecTicks += t3 - t2;
+
+			CalcPostFlat(Fwd1, Bwd1, LX, LY, Post1);
+			CalcPostFlat(Fwd2, Bwd2, LX, LY, Post2);
+
+			float FwdDiff = GetMaxDiff(Fwd1, Fwd2, n);
+			float BwdDiff = GetMaxDiff(Bwd1, Bwd2, n);
+			float PostDiff = GetMaxPostDiff(Post1, Post2, LX, LY, MaxPostDiffOk);
+
+		// -linmem uses the same rows as the -vecfb kernels, posteriors
+		// should agree with Post2 up to float rounding
+			MySparseMx LinMemPost;
+			CalcSparsePost_LinMem(X, LX, Y, LY, LinMemPost);
+			float *Post3 = AllocPost(LX, LY);
+			LinMemPost.ToPost(Post3);
+			float LinMemDiff = GetMaxPostDiff(Post2, Post3, LX, LY, MaxLinMemDiffOk);
+			myfree(Post3);
+
+			MaxFwdDiff = max(MaxFwdDiff, FwdDiff);
+			MaxBwdDiff = max(MaxBwdDiff, BwdDiff);
+			MaxPostDiff = max(MaxPostDiff, PostDiff);
+			MaxLinMemDiff = max(MaxLinMemDiff, LinMemDiff);
+			if (FwdDiff > MaxDiffOk || BwdDiff > MaxDiffOk ||
+			  PostDiff > MaxPostDiffOk || LinMemDiff > MaxLinMemDiffOk)
+				{
+				++BadCount;
+				Log("BAD >%s >%s fwd %.3g bwd %.3g post %.3g linmem %.3g\n",
+				  InputSeqs.GetLabel(i), InputSeqs.GetLabel(j),
+				  FwdDiff, BwdDiff, PostDiff, LinMemDiff);
+				}
+
+			myfree(Fwd1);
+			myfree(Bwd1);
+			myfree(Fwd2);
+			myfree(Bwd2);
+			myfree(Post1);
+			myfree(Post2);
+			}
+		}
+
+	ProgressLog("%u pairs, max rel diff fwd %.3g, bwd %.3g, max post diff %.3g, %u bad\n",
+	  PairCount, MaxFwdDiff, MaxBwdDiff, MaxPostDiff, BadCount);
+	ProgressLog("Max linmem post diff %.3g\n", MaxLinMemDiff);
+	ProgressLog("Scalar %.2f secs, vec %.2f secs\n",
+	  double(ScalarTicks)/CLOCKS_PER_SEC, double(VecTicks)/CLOCKS_PER_SEC);
+	if (BadCount > 0)
+		Die("%u pairs differ", BadCount);
+	}
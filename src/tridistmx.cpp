@@ -0,0 +1,299 @@
+#include "muscle.h"
+#include "tridistmx.h"
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#endif
+
+static const uintptr_t TRIDISTMX_ALIGN = 64;
+static const uint64 DISTMXBIN_CHUNK = 1024*1024;
+
+void TriDistMx::Free()
+	{
+	if (m_MapBase != 0)
+		{
+#ifndef _MSC_VER
+		munmap(m_MapBase, m_MapBytes);
+#endif
+		m_MapBase = 0;
+		m_MapBytes = 0;
+		}
+	myfree(m_Buffer);
+	m_Buffer = 0;
+	m_Data = 0;
+	m_N = 0;
+	m_Diag = 0;
+	}
+
+void TriDistMx::Alloc(uint N, float Value, float Diag)
+	{
+	Free();
+	m_N = N;
+	m_Diag = Diag;
+	const uint64 Size = GetTriangleSize(N);
+	m_Buffer = myalloc(byte, Size*sizeof(float) + TRIDISTMX_ALIGN);
+	uintptr_t p = uintptr_t(m_Buffer);
+	p = (p + TRIDISTMX_ALIGN - 1) & ~(TRIDISTMX_ALIGN - 1);
+	m_Data = (float *) p;
+	for (uint64 k = 0; k < Size; ++k)
+		m_Data[k] = Value;
+	}
+
+void TriDistMx::SetView(uint N, float *Data, float Diag)
+	{
+	Free();
+	m_N = N;
+	m_Diag = Diag;
+	m_Data = Data;
+	}
+
+void TriDistMx::Copy(const TriDistMx &rhs)
+	{
+	if (&rhs == this)
+		return;
+	Alloc(rhs.m_N, 0, rhs.m_Diag);
+	const uint64 Size = GetSize();
+	if (Size > 0)
+		memcpy(m_Data, rhs.m_Data, Size*sizeof(float));
+	}
+
+void TriDistMx::Swap(TriDistMx &rhs)
+	{
+	swap(m_N, rhs.m_N);
+	swap(m_Diag, rhs.m_Diag);
+	swap(m_Data, rhs.m_Data);
+	swap(m_Buffer, rhs.m_Buffer);
+	swap(m_MapBase, rhs.m_MapBase);
+	swap(m_MapBytes, rhs.m_MapBytes);
+	}
+
+// Lower triangle of Mx, upper triangle is assumed symmetric
+void TriDistMx::FromVecVec(const vector<vector<float> > &Mx)
+	{
+	const uint N = SIZE(Mx);
+	Alloc(N, 0, N == 0 ? 0 : Mx[0][0]);
+	for (uint i = 0; i < N; ++i)
+		{
+		asserta(SIZE(Mx[i]) == N);
+		if (i == 0)
+			continue;
+		float *Row = GetRow(i);
+		const vector<float> &MxRow = Mx[i];
+		for (uint j = 0; j < i; ++j)
+			Row[j] = MxRow[j];
+		}
+	}
+
+void TriDistMx::ToVecVec(vector<vector<float> > &Mx) const
+	{
+	Mx.clear();
+	Mx.resize(m_N);
+	for (uint i = 0; i < m_N; ++i)
+		{
+		Mx[i].resize(m_N);
+		for (uint j = 0; j < m_N; ++j)
+			Mx[i][j] = Get(i, j);
+		}
+	}
+
+// Round to nearest even. Too large for float16 (including FLT_MAX
+// for missing pairs) becomes infinity, which HalfToFloat maps back
+// to FLT_MAX.
+static uint16 FloatToHalf(float x)
+	{
+	uint32 u;
+	memcpy(&u, &x, 4);
+	const uint32 Sign = (u >> 16) & 0x8000;
+	const uint32 FloatExp = (u >> 23) & 0xff;
+	uint32 Mant = u & 0x7fffff;
+	if (FloatExp == 0xff)
+		return uint16(Sign | 0x7c00 | (Mant == 0 ? 0 : 0x200));
+
+	const int Exp = int(FloatExp) - 127 + 15;
+	if (Exp >= 31)
+		return uint16(Sign | 0x7c00);
+	if (Exp <= 0)
+		{
+	// Subnormal or zero
+		if (Exp < -10)
+			return uint16(Sign);
+		Mant |= 0x800000;
+		const uint32 Shift = uint32(14 - Exp);
+		uint32 h = Mant >> Shift;
+		const uint32 Rem = Mant & ((1u << Shift) - 1);
+		const uint32 Mid = 1u << (Shift - 1);
+		if (Rem > Mid || (Rem == Mid && (h & 1) != 0))
+			++h;
+		return uint16(Sign | h);
+		}
+
+// Carry from rounding may propagate into the exponent, which is correct
+	uint32 h = (uint32(Exp) << 10) | (Mant >> 13);
+	const uint32 Rem = Mant & 0x1fff;
+	if (Rem > 0x1000 || (Rem == 0x1000 && (h & 1) != 0))
+		++h;
+	return uint16(Sign | h);
+	}
+
+static float HalfToFloat(uint16 h)
+	{
+	const uint32 Sign = uint32(h & 0x8000) << 16;
+	const uint32 Exp = (h >> 10) & 0x1f;
+	const uint32 Mant = h & 0x3ff;
+	uint32 u = 0;
+	if (Exp == 0)
+		{
+		float f = Mant*(1.0f/16777216.0f);
+		return Sign ? -f : f;
+		}
+	else if (Exp == 31)
+		{
+		if (Mant == 0)
+			return Sign ? -FLT_MAX : FLT_MAX;
+		u = Sign | 0x7fc00000;
+		}
+	else
+		u = Sign | ((Exp + 112) << 23) | (Mant << 13);
+	float f;
+	memcpy(&f, &u, 4);
+	return f;
+	}
+
+void TriDistMx::ToBinFile(const string &FileName, const vector<string> &Labels,
+  bool Half) const
+	{
+	asserta(SIZE(Labels) == m_N);
+	string LabelData;
+	for (uint i = 0; i < m_N; ++i)
+		{
+		LabelData += Labels[i];
+		LabelData.push_back(0);
+		}
+
+	const uint64 Size = GetSize();
+	DistMxBinHdr Hdr;
+	memset(&Hdr, 0, sizeof(Hdr));
+	Hdr.Magic = DISTMXBIN_MAGIC;
+	Hdr.Version = DISTMXBIN_VERSION;
+	Hdr.N = m_N;
+	Hdr.ElemBytes = (Half ? 2 : 4);
+	Hdr.Diag = m_Diag;
+	Hdr.LabelBytes = LabelData.size();
+	Hdr.DataPos = ((sizeof(Hdr) + Hdr.LabelBytes + 63)/64)*64;
+	Hdr.DataBytes = Size*Hdr.ElemBytes;
+
+	byte Pad[64];
+	memset(Pad, 0, sizeof(Pad));
+	FILE *f = CreateStdioFile(FileName);
+	WriteStdioFile64(f, &Hdr, sizeof(Hdr));
+	WriteStdioFile64(f, LabelData.c_str(), Hdr.LabelBytes);
+	WriteStdioFile64(f, Pad, Hdr.DataPos - sizeof(Hdr) - Hdr.LabelBytes);
+	if (!Half)
+		WriteStdioFile64(f, m_Data, Hdr.DataBytes);
+	else
+		{
+		vector<uint16> Halfs(DISTMXBIN_CHUNK);
+		for (uint64 Lo = 0; Lo < Size; Lo += DISTMXBIN_CHUNK)
+			{
+			const uint64 n = min(DISTMXBIN_CHUNK, Size - Lo);
+			for (uint64 k = 0; k < n; ++k)
+				Halfs[k] = FloatToHalf(m_Data[Lo + k]);
+			WriteStdioFile64(f, Halfs.data(), n*sizeof(uint16));
+			}
+		}
+	CloseStdioFile(f);
+	}
+
+bool TriDistMx::IsBinFile(const string &FileName)
+	{
+	FILE *f = OpenStdioFile(FileName);
+	uint32 Magic = 0;
+	bool IsBin = false;
+	if (GetStdioFileSize64(f) >= sizeof(DistMxBinHdr))
+		{
+		ReadStdioFile64(f, 0, &Magic, sizeof(Magic));
+		IsBin = (Magic == DISTMXBIN_MAGIC);
+		}
+	CloseStdioFile(f);
+	return IsBin;
+	}
+
+void TriDistMx::FromBinFile(const string &FileName, vector<string> &Labels)
+	{
+	Free();
+	Labels.clear();
+
+	FILE *f = OpenStdioFile(FileName);
+	const uint64 FileSize = GetStdioFileSize64(f);
+	DistMxBinHdr Hdr;
+	if (FileSize < sizeof(Hdr))
+		Die("%s: not a binary distance matrix", FileName.c_str());
+	ReadStdioFile64(f, 0, &Hdr, sizeof(Hdr));
+	if (Hdr.Magic != DISTMXBIN_MAGIC)
+		Die("%s: not a binary distance matrix", FileName.c_str());
+	if (Hdr.Version != DISTMXBIN_VERSION)
+		Die("%s: binary distance matrix version %u, expected %u",
+		  FileName.c_str(), Hdr.Version, DISTMXBIN_VERSION);
+
+	const uint N = Hdr.N;
+	const uint64 Size = GetTriangleSize(N);
+// Sums and products are checked against FileSize first so that
+// a corrupt header cannot overflow them.
+	if ((Hdr.ElemBytes != 2 && Hdr.ElemBytes != 4) ||
+	  Size > FileSize/Hdr.ElemBytes ||
+	  Hdr.DataBytes != Size*Hdr.ElemBytes ||
+	  Hdr.LabelBytes > FileSize - sizeof(Hdr) ||
+	  Hdr.DataPos%64 != 0 ||
+	  Hdr.DataPos < sizeof(Hdr) + Hdr.LabelBytes ||
+	  Hdr.DataPos > FileSize ||
+	  Hdr.DataBytes > FileSize - Hdr.DataPos)
+		Die("%s: invalid binary distance matrix header", FileName.c_str());
+
+	string LabelData;
+	LabelData.resize(Hdr.LabelBytes);
+	if (Hdr.LabelBytes > 0)
+		ReadStdioFile64(f, sizeof(Hdr), &LabelData[0], Hdr.LabelBytes);
+	uint64 Pos = 0;
+	for (uint i = 0; i < N; ++i)
+		{
+		const uint64 End = LabelData.find('\0', Pos);
+		if (End == string::npos)
+			Die("%s: truncated label table", FileName.c_str());
+		Labels.push_back(LabelData.substr(Pos, End - Pos));
+		Pos = End + 1;
+		}
+
+	if (Hdr.ElemBytes == 4)
+		{
+#ifdef _MSC_VER
+		Alloc(N, 0, Hdr.Diag);
+		if (Hdr.DataBytes > 0)
+			ReadStdioFile64(f, Hdr.DataPos, m_Data, Hdr.DataBytes);
+#else
+		const uint64 MapBytes = Hdr.DataPos + Hdr.DataBytes;
+		void *p = mmap(0, MapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		  fileno(f), 0);
+		if (p == MAP_FAILED)
+			Die("mmap(%s) failed, errno=%d", FileName.c_str(), errno);
+		m_N = N;
+		m_Diag = Hdr.Diag;
+		m_MapBase = p;
+		m_MapBytes = MapBytes;
+		m_Data = (float *) ((byte *) p + Hdr.DataPos);
+#endif
+		}
+	else
+		{
+		Alloc(N, 0, Hdr.Diag);
+		vector<uint16> Halfs(DISTMXBIN_CHUNK);
+		for (uint64 Lo = 0; Lo < Size; Lo += DISTMXBIN_CHUNK)
+			{
+			const uint64 n = min(DISTMXBIN_CHUNK, Size - Lo);
+			ReadStdioFile64(f, Hdr.DataPos + Lo*sizeof(uint16), Halfs.data(),
+			  n*sizeof(uint16));
+			for (uint64 k = 0; k < n; ++k)
+				m_Data[Lo + k] = HalfToFloat(Halfs[k]);
+			}
+		}
+	CloseStdioFile(f);
+	}
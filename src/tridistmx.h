@@ -0,0 +1,103 @@
+#pragma once
+
+/***
+Symmetric NxN distance (or similarity) matrix stored as the packed
+strict lower triangle, row by row: (i,j) with i > j is at
+j + i*(i-1)/2, the same layout as UPGMA5::TriangleSubscript, so
+UPGMA5::Run works in this buffer directly instead of copying it.
+N(N-1)/2 floats rather than N^2, 64-byte aligned, 64-bit indexes
+so N may exceed 65535. The diagonal is not stored, Get(i,i)
+returns m_Diag.
+
+SetView wraps memory owned by someone else, in which case Free does
+not release it.
+
+Binary file (ToBinFile, FromBinFile), native byte order:
+	DistMxBinHdr
+	N labels, each nul-terminated
+	zero padding to a multiple of 64 bytes (DataPos)
+	packed triangle, float32 or float16
+A float32 file is memory-mapped copy-on-write (UPGMA5 updates the
+triangle in place) so loading costs no parsing or copying; float16
+halves the file size and is expanded to float32 on load.
+***/
+static const uint32 DISTMXBIN_MAGIC = 0x584d4444;	// "DDMX"
+static const uint32 DISTMXBIN_VERSION = 1;
+
+struct DistMxBinHdr
+	{
+	uint32 Magic;
+	uint32 Version;
+	uint32 N;
+	uint32 ElemBytes;		// 4=float32, 2=float16
+	float Diag;
+	uint32 Reserved;
+	uint64 LabelBytes;
+	uint64 DataPos;
+	uint64 DataBytes;
+	};
+
+class TriDistMx
+	{
+public:
+	uint m_N = 0;
+	float m_Diag = 0;
+	float *m_Data = 0;
+	byte *m_Buffer = 0;		// myalloc'd, m_Data is aligned within it, 0 if view
+	void *m_MapBase = 0;	// mapped file, m_Data points into it
+	uint64 m_MapBytes = 0;
+
+public:
+	TriDistMx() {}
+	TriDistMx(const TriDistMx &rhs) { Copy(rhs); }
+	TriDistMx &operator=(const TriDistMx &rhs) { Copy(rhs); return *this; }
+	~TriDistMx() { Free(); }
+
+	void Free();
+	void Alloc(uint N, float Value, float Diag = 0);
+	void SetView(uint N, float *Data, float Diag = 0);
+	void Copy(const TriDistMx &rhs);
+	void Swap(TriDistMx &rhs);
+	void FromVecVec(const vector<vector<float> > &Mx);
+	void ToVecVec(vector<vector<float> > &Mx) const;
+	void ToBinFile(const string &FileName, const vector<string> &Labels,
+	  bool Half) const;
+	void FromBinFile(const string &FileName, vector<string> &Labels);
+	static bool IsBinFile(const string &FileName);
+
+	uint GetN() const { return m_N; }
+	bool IsView() const { return m_Data != 0 && m_Buffer == 0; }
+
+	static uint64 GetTriangleSize(uint N)
+		{
+		return N < 2 ? 0 : (uint64(N)*(N - 1))/2;
+		}
+
+	static uint64 GetIndex(uint i, uint j)
+		{
+		assert(i != j);
+		if (i < j)
+			swap(i, j);
+		return j + (uint64(i)*(i - 1))/2;
+		}
+
+	uint64 GetSize() const { return GetTriangleSize(m_N); }
+
+	float Get(uint i, uint j) const
+		{
+		assert(i < m_N && j < m_N);
+		if (i == j)
+			return m_Diag;
+		return m_Data[GetIndex(i, j)];
+		}
+
+	void Set(uint i, uint j, float d)
+		{
+		assert(i < m_N && j < m_N && i != j);
+		m_Data[GetIndex(i, j)] = d;
+		}
+
+// Row i, columns 0..i-1
+	float *GetRow(uint i) { return m_Data + (uint64(i)*(i - 1))/2; }
+	const float *GetRow(uint i) const { return m_Data + (uint64(i)*(i - 1))/2; }
+	};
@@ -25,33 +25,128 @@ void UClust::AddSeqToIndex(uint SeqIndex)
 
 uint UClust::Search(uint SeqIndex, string &Path)
 	{
+	uint RejectCount = 0;
+	return Search(m_US, SeqIndex, Path, MAX_REJECTS, RejectCount);
+	}
+
+// Candidates are aligned in chunks of ThreadCount and the first
+// hit in candidate order wins, so the result does not depend on
+// the number of threads.
+uint UClust::Search(USorter &US, uint SeqIndex, string &Path,
+  uint MaxRejects, uint &RejectCount)
+	{
+	RejectCount = 0;
 	const Sequence *Seq = m_InputSeqs->GetSequence(SeqIndex);
 	const byte *ByteSeq = Seq->GetBytePtr();
 	const uint L = Seq->GetLength();
 
 	vector<uint> TopSeqIndexes;
 	vector<uint> TopWordCounts;
-	m_US.SearchSeq(ByteSeq, L, TopSeqIndexes, TopWordCounts);
+	US.SearchSeq(ByteSeq, L, TopSeqIndexes, TopWordCounts);
 	uint TopCount = SIZE(TopSeqIndexes);
 	asserta(SIZE(TopWordCounts) == TopCount);
+	if (TopCount > MaxRejects)
+		TopCount = MaxRejects;
 	if (TopCount == 0)
 		return UINT_MAX;
-	if (TopCount > MAX_REJECTS)
-		TopCount = MAX_REJECTS;
-	uint ThreadCount = GetRequestedThreadCount();
+	const uint ThreadCount =
+	  (omp_in_parallel() ? 1 : min(TopCount, GetRequestedThreadCount()));
 
-	uint CentroidSeqIndex = UINT_MAX;
-	for (int TopIndex = 0; TopIndex < (int) TopCount; ++TopIndex)
+	vector<float> EAs(TopCount);
+	vector<string> Paths(TopCount);
+	for (uint Lo = 0; Lo < TopCount; Lo += ThreadCount)
 		{
-		uint TopSeqIndex = TopSeqIndexes[TopIndex];
-		float EA = AlignSeqPair(SeqIndex, TopSeqIndex, Path);
-		if (EA >= m_MinEA)
+		const uint Hi = min(TopCount, Lo + ThreadCount);
+#pragma omp parallel for num_threads(ThreadCount)
+		for (int TopIndex = (int) Lo; TopIndex < (int) Hi; ++TopIndex)
+			EAs[TopIndex] = AlignSeqPair(SeqIndex, TopSeqIndexes[TopIndex],
+			  Paths[TopIndex]);
+
+		for (uint TopIndex = Lo; TopIndex < Hi; ++TopIndex)
 			{
-			CentroidSeqIndex = TopSeqIndex;
-			break;
+			if (EAs[TopIndex] >= m_MinEA)
+				{
+				Path.swap(Paths[TopIndex]);
+				return TopSeqIndexes[TopIndex];
+				}
+			++RejectCount;
 			}
 		}
-	return CentroidSeqIndex;
+	return UINT_MAX;
+	}
+
+/***
+Batched search (-uclustbatch B). Each window of B queries in length
+order is searched in parallel against the centroids that existed
+before the window. Queries with no hit are then resolved serially
+in length order against the centroids created earlier in the same
+window, with the MAX_REJECTS budget shared between the two searches;
+if there is still no hit the query becomes a centroid.
+Results depend on B but not on the number of threads.
+***/
+void UClust::RunBatches(const vector<uint> &Order)
+	{
+	const uint InputSeqCount = SIZE(Order);
+	const uint ThreadCount = GetRequestedThreadCount();
+	const float MinEE = (1 - m_MinEA);
+	uint CentroidCount = 0;
+	uint MemberCount = 0;
+	vector<uint> Reps;
+	vector<uint> RejectCounts;
+	USorter WindowUS;
+	for (uint Lo = 0; Lo < InputSeqCount; Lo += m_BatchSize)
+		{
+		const uint Hi = min(InputSeqCount, Lo + m_BatchSize);
+		Reps.clear();
+		Reps.resize(Hi - Lo, UINT_MAX);
+		RejectCounts.clear();
+		RejectCounts.resize(Hi - Lo, 0);
+
+#pragma omp parallel for num_threads(ThreadCount) schedule(dynamic, 1)
+		for (int k = (int) Lo; k < (int) Hi; ++k)
+			{
+			uint SeqIndex = Order[k];
+			Reps[k - Lo] = Search(m_US, SeqIndex, m_SeqIndexToPath[SeqIndex],
+			  MAX_REJECTS, RejectCounts[k - Lo]);
+			}
+
+		uint WindowCentroidCount = 0;
+		for (uint k = Lo; k < Hi; ++k)
+			{
+			uint SeqIndex = Order[k];
+			string &Path = m_SeqIndexToPath[SeqIndex];
+			uint RepSeqIndex = Reps[k - Lo];
+			const uint RejectCount = RejectCounts[k - Lo];
+			if (RepSeqIndex == UINT_MAX && WindowCentroidCount > 0 &&
+			  RejectCount < MAX_REJECTS)
+				{
+				uint WindowRejectCount = 0;
+				RepSeqIndex = Search(WindowUS, SeqIndex, Path,
+				  MAX_REJECTS - RejectCount, WindowRejectCount);
+				}
+			if (RepSeqIndex == UINT_MAX)
+				{
+				if (WindowCentroidCount == 0)
+					WindowUS.Init();
+				const Sequence *Seq = m_InputSeqs->GetSequence(SeqIndex);
+				WindowUS.AddSeq(Seq->GetBytePtr(), Seq->GetLength(), SeqIndex);
+				++WindowCentroidCount;
+
+				m_CentroidSeqIndexes.push_back(SeqIndex);
+				AddSeqToIndex(SeqIndex);
+				++CentroidCount;
+				RepSeqIndex = SeqIndex;
+				Path.clear();
+				}
+			else
+				++MemberCount;
+			m_SeqIndexToCentroidSeqIndex[SeqIndex] = RepSeqIndex;
+			}
+
+		ProgressStep(Hi - 1, InputSeqCount,
+		  "UCLUST %u seqs EE<%.2f, %u centroids, %u members",
+		  InputSeqCount, MinEE, CentroidCount, MemberCount);
+		}
 	}
 
 void UClust::Run(MultiSequence &InputSeqs, float MinEA)
@@ -86,6 +181,12 @@ void UClust::Run(MultiSequence &InputSeqs, float MinEA)
 #endif
 	vector<uint> Order;
 	InputSeqs.GetLengthOrder(Order);
+	if (m_BatchSize > 0)
+		{
+		RunBatches(Order);
+		return;
+		}
+
 	uint LastLength = UINT_MAX;
 	const float MinEE = (1 - m_MinEA);
 	for (uint k = 0; k < InputSeqCount; ++k)
@@ -198,6 +299,7 @@ void cmd_uclust()
 		SetAlpha(ALPHA_Amino);
 
 	UClust U;
+	U.m_BatchSize = optd(uclustbatch, 0);
 	U.Run(InputSeqs, MinEA);
 
 	MultiSequence *CentroidSeqs = new MultiSequence;
@@ -10,6 +10,9 @@ public:
 	MultiSequence *m_InputSeqs = 0;
 	float m_MinEA = 0.99f;
 	USorter m_US;
+
+// >0 for batched parallel search (-uclustbatch), see RunBatches
+	uint m_BatchSize = 0;
 	
 	vector<uint> m_CentroidSeqIndexes;
 	vector<uint> m_SeqIndexToCentroidSeqIndex;
@@ -18,6 +21,9 @@ public:
 public:
 	void Run(MultiSequence &InputSeqs, float MinEA);
 	uint Search(uint SeqIndex, string &Path);
+	uint Search(USorter &US, uint SeqIndex, string &Path,
+	  uint MaxRejects, uint &RejectCount);
+	void RunBatches(const vector<uint> &Order);
 	void AddSeqToIndex(uint SeqIndex);
 	float AlignSeqPair(uint SeqIndex1, uint SeqIndex2, string &Path);
 	void GetCentroidSeqs(MultiSequence &CentroidSeqs) const;
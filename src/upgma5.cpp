@@ -37,7 +37,7 @@ void UPGMA5::LogMe() const
 				Log("       ");
 			else
 				{
-				uint v = TriangleSubscript(i, j);
+				uint64 v = TriangleSubscript(i, j);
 				Log("%5.2g  ", m_Dist[v]);
 				}
 			}
@@ -87,14 +87,12 @@ void UPGMA5::Run(const string &sLinkage, Tree &tree)
 void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 	{
 	m_LeafCount = SIZE(m_Labels);
-	asserta(SIZE(m_DistMx) == m_LeafCount);
-	for (uint i = 0; i < m_LeafCount; ++i)
-		asserta(SIZE(m_DistMx[i]) == m_LeafCount);
+	asserta(m_DistMx.GetN() == m_LeafCount);
 
-	m_TriangleSize = (m_LeafCount*(m_LeafCount - 1))/2;
+// Joins overwrite m_DistMx, no copy
+	m_TriangleSize = m_DistMx.GetSize();
 	m_InternalNodeCount = m_LeafCount - 1;
-
-	m_Dist = myalloc(float, m_TriangleSize);
+	m_Dist = m_DistMx.m_Data;
 
 	m_NodeIndex = myalloc(uint, m_LeafCount);
 	m_NearestNeighbor = myalloc(uint, m_LeafCount);
@@ -126,23 +124,19 @@ void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 		m_Height[i] = FLT_MAX;
 		}
 
-// Compute initial NxN triangular distance matrix.
+// Initial NxN triangular distance matrix is m_DistMx.
 // Store minimum distance for each full (not triangular) row.
 // Loop from 1, not 0, because "row" is 0, 1 ... i-1,
 // so nothing to do when i=0.
 	for (uint i = 1; i < m_LeafCount; ++i)
 		{
-		uint Base = TriangleSubscript(i, 0);
+		uint64 Base = TriangleSubscript(i, 0);
 		//float *Row = m_Dist + Base;
 		for (uint j = 0; j < i; ++j)
 			{
-			float d = m_DistMx[i][j];
+			float d = m_Dist[Base];
 			if (d < 0)
-				{
 				d = 0;
-				m_DistMx[i][j] = 0;
-				m_DistMx[j][i] = 0;
-				}
 			m_Dist[Base++] = d;
 			if (d < m_MinDist[i])
 				{
@@ -167,7 +161,8 @@ void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 	for (m_InternalNodeIndex = 0; m_InternalNodeIndex < JoinCount;
 	  ++m_InternalNodeIndex)
 		{
-		ProgressStep(m_InternalNodeIndex, JoinCount, "UPGMA5");
+		if (!m_Quiet)
+			ProgressStep(m_InternalNodeIndex, JoinCount, "UPGMA5");
 #if	TRACE
 		Log("\n");
 		Log("Internal node index %5u\n", m_InternalNodeIndex);
@@ -218,8 +213,8 @@ void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 			if (UINT_MAX == m_NodeIndex[j])
 				continue;
 
-			const uint vL = TriangleSubscript(Lmin, j);
-			const uint vR = TriangleSubscript(Rmin, j);
+			const uint64 vL = TriangleSubscript(Lmin, j);
+			const uint64 vR = TriangleSubscript(Rmin, j);
 			const float dL = m_Dist[vL];
 			const float dR = m_Dist[vR];
 			float dtNewDist = 0;
@@ -273,7 +268,7 @@ void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 		assert(m_InternalNodeIndex < m_LeafCount - 1 || FLT_MAX != dtNewMinDist);
 		assert(m_InternalNodeIndex < m_LeafCount - 1 || UINT_MAX != uNewNearestNeighbor);
 
-		const uint v = TriangleSubscript(Lmin, Rmin);
+		const uint64 v = TriangleSubscript(Lmin, Rmin);
 		const float dLR = m_Dist[v];
 		const float dHeightNew = dLR/2;
 		const uint uLeft = m_NodeIndex[Lmin];
@@ -312,7 +307,7 @@ void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 	tree.LogMe();
 #endif
 
-	myfree(m_Dist);
+	m_DistMx.Free();
 
 	myfree(m_NodeIndex);
 	myfree(m_NearestNeighbor);
@@ -344,7 +339,7 @@ void UPGMA5::Run(LINKAGE Linkage, Tree &tree)
 void UPGMA5::Clear()
 	{
 	m_Labels.clear();
-	m_DistMx.clear();
+	m_DistMx.Free();
 	m_LabelToIndex.clear();
 	}
 
@@ -352,9 +347,29 @@ void UPGMA5::Init(const vector<string> &Labels,
   const vector<vector<float> > &DistMx)
 	{
 	Clear();
+	m_DistMx.FromVecVec(DistMx);
+	SetLabels(Labels);
+	}
+
+void UPGMA5::Init(const vector<string> &Labels, const TriDistMx &DistMx)
+	{
+	Clear();
+	m_DistMx.Copy(DistMx);
+	SetLabels(Labels);
+	}
+
+// Takes DistMx, which is left empty
+void UPGMA5::InitSwap(const vector<string> &Labels, TriDistMx &DistMx)
+	{
+	Clear();
+	m_DistMx.Swap(DistMx);
+	SetLabels(Labels);
+	}
 
-	m_DistMx = DistMx;
+void UPGMA5::SetLabels(const vector<string> &Labels)
+	{
 	m_Labels = Labels;
+	m_LabelToIndex.clear();
 	for (uint i = 0; i < SIZE(Labels); ++i)
 		{
 		const string &Label = Labels[i];
@@ -383,8 +398,24 @@ uint UPGMA5::GetLabelIndex(const string &Label) const
 	return Index;
 	}
 
+// Binary format, see tridistmx.h. Either text reader
+// accepts it so that -distmxin works with both.
+void UPGMA5::ReadDistMxBin(const string &FileName)
+	{
+	Progress("Reading dist mx (binary)...");
+	vector<string> Labels;
+	m_DistMx.FromBinFile(FileName, Labels);
+	SetLabels(Labels);
+	Progress(" done.\n");
+	}
+
 void UPGMA5::ReadDistMx(const string &FileName)
 	{
+	if (TriDistMx::IsBinFile(FileName))
+		{
+		ReadDistMxBin(FileName);
+		return;
+		}
 	Progress("Reading dist mx...");
 // Pass 1, labels
 	FILE *f = OpenStdioFile(FileName);
@@ -404,10 +435,7 @@ void UPGMA5::ReadDistMx(const string &FileName)
 		}
 
 	m_LeafCount = SIZE(m_Labels);
-	m_DistMx.clear();
-	m_DistMx.resize(m_LeafCount);
-	for (uint i = 0; i < m_LeafCount; ++i)
-		m_DistMx[i].resize(m_LeafCount, FLT_MAX);
+	m_DistMx.Alloc(m_LeafCount, FLT_MAX);
 
 // Pass 2, distances
 	SetStdioFilePos(f, 0);
@@ -425,8 +453,7 @@ void UPGMA5::ReadDistMx(const string &FileName)
 		if (Index1 == Index2)
 			Die("Line %u Index1=%u Index2=%u Label1='%s' Label2='%s'",
 			  LineNr, Index1, Index2, Label1.c_str(), Label2.c_str());
-		m_DistMx[Index1][Index2] = Dist;
-		m_DistMx[Index2][Index1] = Dist;
+		m_DistMx.Set(Index1, Index2, Dist);
 		}
 
 	CloseStdioFile(f);
@@ -439,6 +466,11 @@ void UPGMA5::ReadDistMx(const string &FileName)
 // then distances are idx1\tidx2\tTS
 void UPGMA5::ReadDistMx2(const string &FileName)
 	{
+	if (TriDistMx::IsBinFile(FileName))
+		{
+		ReadDistMxBin(FileName);
+		return;
+		}
 	Progress("Reading dist mx (reseek format)...");
 // Pass 1, labels
 	FILE *f = OpenStdioFile(FileName);
@@ -471,10 +503,7 @@ void UPGMA5::ReadDistMx2(const string &FileName)
 		}
 	asserta(SIZE(m_Labels) == m_LeafCount);
 
-	m_DistMx.clear();
-	m_DistMx.resize(m_LeafCount);
-	for (uint i = 0; i < m_LeafCount; ++i)
-		m_DistMx[i].resize(m_LeafCount, 0);
+	m_DistMx.Alloc(m_LeafCount, 0);
 
 // Pass 2, distances
 	uint DistCount = 0;
@@ -489,8 +518,7 @@ void UPGMA5::ReadDistMx2(const string &FileName)
 		if (Index1 == Index2)
 			continue;
 		float Dist = (float) StrToFloat(Fields[2]);
-		m_DistMx[Index1][Index2] = Dist;
-		m_DistMx[Index2][Index1] = Dist;
+		m_DistMx.Set(Index1, Index2, Dist);
 		++DistCount;
 		}
 	ProgressLog("%u pair-wise distances\n", DistCount);
@@ -503,17 +531,15 @@ void UPGMA5::ReadDistMx2(const string &FileName)
 
 void UPGMA5::FixEADistMx()
 	{
-	for (uint i = 0; i < m_LeafCount; ++i)
+	m_DistMx.m_Diag = 0;
+	for (uint i = 1; i < m_LeafCount; ++i)
 		{
-		m_DistMx[i][i] = 0;
+		float *Row = m_DistMx.GetRow(i);
 		for (uint j = 0; j < i; ++j)
 			{
-			float d = m_DistMx[i][j];
+			float d = Row[j];
 			asserta(d >= 0 && d <= 1);
-			float NewDist = 1 - d;
-
-			m_DistMx[i][j] = NewDist;
-			m_DistMx[j][i] = NewDist;
+			Row[j] = 1 - d;
 			}
 		}
 	}
@@ -521,14 +547,13 @@ void UPGMA5::FixEADistMx()
 void UPGMA5::ScaleDistMx(bool InputIsSimilarity)
 	{
 	const float SCALE = 10.0f;
-	float MinDist = m_DistMx[0][1];
-	float MaxDist = m_DistMx[0][1];
+	float MinDist = m_DistMx.Get(0, 1);
+	float MaxDist = m_DistMx.Get(0, 1);
 	for (uint i = 0; i < m_LeafCount; ++i)
 		{
 		for (uint j = 0; j < i; ++j)
 			{
-			float d = m_DistMx[i][j];
-			asserta(m_DistMx[j][i] == d);
+			float d = m_DistMx.Get(i, j);
 			MinDist = min(MinDist, d);
 			MaxDist = max(MaxDist, d);
 			}
@@ -541,7 +566,7 @@ void UPGMA5::ScaleDistMx(bool InputIsSimilarity)
 		{
 		for (uint j = 0; j < i; ++j)
 			{
-			float d = m_DistMx[i][j];
+			float d = m_DistMx.Get(i, j);
 			//float NewDist = SCALE*(MaxDist - d)/(MaxDist - MinDist);
 			float NewDist = FLT_MAX;
 			if (InputIsSimilarity)
@@ -554,8 +579,7 @@ void UPGMA5::ScaleDistMx(bool InputIsSimilarity)
 			if (MaxNewDist == FLT_MAX || NewDist > MaxNewDist)
 				MaxNewDist = NewDist;
 
-			m_DistMx[i][j] = NewDist;
-			m_DistMx[j][i] = NewDist;
+			m_DistMx.Set(i, j, NewDist);
 			}
 		}
 	ProgressLog("Scaled min dist %.3g, max %.3g. scale\n",
@@ -608,3 +632,31 @@ void cmd_upgma5()
 
 	ProgressLog("All done.\n");
 	}
+
+/***
+Convert a text distance matrix, either reseek (-distmxin) or
+label1<tab>label2<tab>dist format, to the binary format.
+	muscle -distmxbin structs.distmx -output structs.bdm [-half]
+***/
+void cmd_distmxbin()
+	{
+	const string &InputFileName = opt(distmxbin);
+	const string &OutputFileName = opt(output);
+
+	FILE *f = OpenStdioFile(InputFileName);
+	string Line;
+	bool Ok = ReadLineStdioFile(f, Line);
+	CloseStdioFile(f);
+	if (!Ok)
+		Die("Empty file %s", InputFileName.c_str());
+
+	UPGMA5 U;
+	if (StartsWith(Line, "distmx\t"))
+		U.ReadDistMx2(InputFileName);
+	else
+		U.ReadDistMx(InputFileName);
+
+	const bool Half = opt(half);
+	U.m_DistMx.ToBinFile(OutputFileName, U.m_Labels, Half);
+	ProgressLog("%u labels, %s\n", U.m_LeafCount, Half ? "float16" : "float32");
+	}
@@ -1,15 +1,20 @@
 #pragma once
 
+#include "tridistmx.h"
+
 class UPGMA5
 	{
 public:
 	uint m_LeafCount = 0;
-	uint m_TriangleSize = 0;
+	uint64 m_TriangleSize = 0;
 	uint m_InternalNodeCount = 0;
 	uint m_InternalNodeIndex = 0;
 
-// Triangular distance matrix is m_Dist, which is allocated
-// as a one-dimensional vector of length m_TriangleSize.
+// No progress steps in Run (MPCFlat::m_Quiet)
+	bool m_Quiet = false;
+
+// Triangular distance matrix is m_Dist, which is the buffer of
+// m_DistMx (length m_TriangleSize), updated in place by Run.
 // TriangleSubscript(i,j) maps row,column=i,j to the subscript
 // into this vector.
 // Row / column coordinates are a bit messy.
@@ -44,31 +49,31 @@ public:
 	float *m_RightLength = 0;
 
 	vector<string> m_Labels;
-	vector<vector<float> > m_DistMx;
+	TriDistMx m_DistMx;
 	map<string, uint> m_LabelToIndex;
 
 public:
 	void Clear();
 	void Init(const vector<string> &Labels,
 	  const vector<vector<float> > &DistMx);
+	void Init(const vector<string> &Labels, const TriDistMx &DistMx);
+	void InitSwap(const vector<string> &Labels, TriDistMx &DistMx);
+	void SetLabels(const vector<string> &Labels);
 	void Run(const string &sLinkage, Tree &tree);
 	void Run(LINKAGE Linkage, Tree &tree);
 	void ReadDistMx(const string &FileName);
 	void ReadDistMx2(const string &FileName);
+	void ReadDistMxBin(const string &FileName);
 	void ScaleDistMx(bool InputIsSimilarity = true);
 	void FixEADistMx();
 	void LogMe() const;
 	void AddLabel(const string &Label);
 	uint GetLabelIndex(const string &Label) const;
 
-	uint TriangleSubscript(uint uIndex1, uint uIndex2) const
+	uint64 TriangleSubscript(uint uIndex1, uint uIndex2) const
 		{
-		uint v;
-		if (uIndex1 >= uIndex2)
-			v = uIndex2 + (uIndex1*(uIndex1 - 1))/2;
-		else
-			v = uIndex1 + (uIndex2*(uIndex2 - 1))/2;
-		assert(v < (m_LeafCount*(m_LeafCount - 1))/2);
+		uint64 v = TriDistMx::GetIndex(uIndex1, uIndex2);
+		assert(v < m_TriangleSize);
 		return v;
 		}
 	};
@@ -7,20 +7,16 @@
 double GetProtDist(const char *Q, const char *T, uint ColCount);
 
 static void MakeDistMx(const MultiSequence &Aln,
-  vector<vector<float> > &DistMx, vector<string> &Labels)
+  TriDistMx &DistMx, vector<string> &Labels)
 	{
-	DistMx.clear();
 	Labels.clear();
 
 	const uint SeqCount = Aln.GetSeqCount();
 	const uint ColCount = Aln.GetColCount();
 
-	DistMx.resize(SeqCount);
+	DistMx.Alloc(SeqCount, FLT_MAX);
 	for (uint i = 0; i < SeqCount; ++i)
 		{
-		DistMx[i].resize(SeqCount, FLT_MAX);
-		DistMx[i][i] = 0;
-
 		const string &Label = Aln.GetLabel(i);
 		Labels.push_back(Label);
 		}
@@ -64,8 +60,7 @@ static void MakeDistMx(const MultiSequence &Aln,
 
 		float dij = (float) GetProtDist(Seqi, Seqj, ColCount);
 
-		DistMx[ThreadLocali][ThreadLocalj] = dij;
-		DistMx[ThreadLocalj][ThreadLocali] = dij;
+		DistMx.Set(ThreadLocali, ThreadLocalj, dij);
 		}
 	}
 
@@ -80,7 +75,7 @@ void cmd_upgma5_msa()
 	SetAlphab(IsNucleo);
 
 	UPGMA5 U;
-	vector<vector<float> > &DistMx = U.m_DistMx;
+	TriDistMx &DistMx = U.m_DistMx;
 	vector<string> &Labels = U.m_Labels;
 
 	MakeDistMx(Aln, DistMx, Labels);
@@ -1,14 +1,17 @@
 #include "muscle.h"
 #include "usorter.h"
 #include "sort.h"
+#include "kmerscan.h"
 
 void USorter::Init()
 	{
 	asserta(g_AlphaSize > 0);
+	m_SyncmerD = optd(usorter_syncmer, 0);
 	if (g_Alpha == ALPHA_Amino)
 		{
 		m_WordLength = 3;
-		m_DictSize = myipow(20, m_WordLength);
+		m_DictSize = (m_SyncmerD > 1 ? GetKmerMaskAa(m_WordLength) + 1 :
+		  myipow(20, m_WordLength));
 		}
 	else if (g_Alpha == ALPHA_Nucleo)
 		{
@@ -17,9 +20,20 @@ void USorter::Init()
 		}
 	else
 		asserta(false);
+	if (m_SyncmerD > m_WordLength)
+		Die("-usorter_syncmer %u > word length %u", m_SyncmerD, m_WordLength);
 
-	m_Rows.clear();
-	m_Rows.resize(m_DictSize);
+	m_IndexSeqIndexes.clear();
+	m_Blocks.clear();
+	m_Heads.clear();
+	m_Tails.clear();
+	m_TailBytes.clear();
+	m_LastIndexes.clear();
+	m_Heads.resize(m_DictSize, UINT32_MAX);
+	m_Tails.resize(m_DictSize, UINT32_MAX);
+	m_TailBytes.resize(m_DictSize, 0);
+	m_LastIndexes.resize(m_DictSize, 0);
+	m_PostingCount = 0;
 	}
 
 uint USorter::CharsToWord(const byte *Chars)
@@ -60,22 +74,136 @@ uint USorter::CharsToWord_Nucleo(const byte *Chars)
 	return Word;
 	}
 
-void USorter::AddSeq(const byte *Seq, uint L, uint SeqIndex)
+static uint OnSyncmer(uint32 Code, uint32 Pos, void *UserData)
 	{
-	asserta(g_AlphaSize > 0);
-	uint Index = SIZE(m_IndexSeqIndexes);
+	vector<uint32> &Words = *(vector<uint32> *) UserData;
+	Words.push_back(Code);
+	return 1;
+	}
+
+// Default words are base-20/base-4 codes as before, so candidate
+// order is unchanged unless syncmers are requested.
+void USorter::GetWords(const byte *Seq, uint L, vector<uint32> &Words)
+	{
+	Words.clear();
 	if (L < m_WordLength)
 		return;
+	if (m_SyncmerD > 1)
+		{
+		if (g_Alpha == ALPHA_Nucleo)
+			SyncmerScanNt(Seq, 0, L, m_WordLength, m_SyncmerD, OnSyncmer, &Words);
+		else
+			SyncmerScanAa(Seq, 0, L, m_WordLength, m_SyncmerD, OnSyncmer, &Words);
+		return;
+		}
+
 	const uint WordCount = L + 1 - m_WordLength;
+	Words.reserve(WordCount);
 	for (uint i = 0; i < WordCount; ++i)
 		{
 		uint Word = CharsToWord(Seq + i);
 		if (Word < m_DictSize)
-			m_Rows[Word].push_back(Index);
+			Words.push_back(Word);
+		}
+	}
+
+uint32 USorter::AllocBlock()
+	{
+	const uint64 Pos = m_Blocks.size();
+	asserta(Pos/USORTER_BLOCK_BYTES < UINT32_MAX);
+	m_Blocks.resize(Pos + USORTER_BLOCK_BYTES);
+	*(uint32 *) (m_Blocks.data() + Pos) = UINT32_MAX;
+	return uint32(Pos/USORTER_BLOCK_BYTES);
+	}
+
+void USorter::AppendByte(uint32 Word, byte b)
+	{
+	uint32 Tail = m_Tails[Word];
+	if (Tail == UINT32_MAX || m_TailBytes[Word] == USORTER_BLOCK_DATA)
+		{
+		uint32 Block = AllocBlock();
+		if (Tail == UINT32_MAX)
+			m_Heads[Word] = Block;
+		else
+			*(uint32 *) (m_Blocks.data() + uint64(Tail)*USORTER_BLOCK_BYTES) =
+			  Block;
+		m_Tails[Word] = Block;
+		m_TailBytes[Word] = 0;
+		Tail = Block;
 		}
+	byte *Data = m_Blocks.data() + uint64(Tail)*USORTER_BLOCK_BYTES + sizeof(uint32);
+	Data[m_TailBytes[Word]++] = b;
+	}
+
+// LEB128 delta from the previous posting of this word
+void USorter::AppendPosting(uint32 Word, uint32 Index)
+	{
+	uint32 Delta = Index - m_LastIndexes[Word];
+	m_LastIndexes[Word] = Index;
+	while (Delta >= 0x80)
+		{
+		AppendByte(Word, byte(Delta | 0x80));
+		Delta >>= 7;
+		}
+	AppendByte(Word, byte(Delta));
+	++m_PostingCount;
+	}
+
+void USorter::AddSeq(const byte *Seq, uint L, uint SeqIndex)
+	{
+	asserta(g_AlphaSize > 0);
+	uint Index = SIZE(m_IndexSeqIndexes);
+	if (L < m_WordLength)
+		return;
+	vector<uint32> Words;
+	GetWords(Seq, L, Words);
+	const uint WordCount = SIZE(Words);
+	for (uint i = 0; i < WordCount; ++i)
+		AppendPosting(Words[i], Index);
 	m_IndexSeqIndexes.push_back(SeqIndex);
 	}
 
+// U[Index] += number of occurrences of Words in sequence Index,
+// Touched gets each Index with a hit once (U must start at zero).
+void USorter::CountHits(const vector<uint32> &Words, uint *U,
+  vector<uint> &Touched) const
+	{
+	Touched.clear();
+	const byte *Blocks = m_Blocks.data();
+	const uint WordCount = SIZE(Words);
+	for (uint i = 0; i < WordCount; ++i)
+		{
+		const uint32 Word = Words[i];
+		const uint32 Tail = m_Tails[Word];
+		uint32 Block = m_Heads[Word];
+		uint32 Index = 0;
+		uint32 Delta = 0;
+		uint Shift = 0;
+		while (Block != UINT32_MAX)
+			{
+			const byte *p = Blocks + uint64(Block)*USORTER_BLOCK_BYTES;
+			const byte *Data = p + sizeof(uint32);
+			const uint n = (Block == Tail ? m_TailBytes[Word] : USORTER_BLOCK_DATA);
+			for (uint k = 0; k < n; ++k)
+				{
+				const byte b = Data[k];
+				Delta |= uint32(b & 0x7f) << Shift;
+				if (b & 0x80)
+					{
+					Shift += 7;
+					continue;
+					}
+				Index += Delta;
+				if (U[Index]++ == 0)
+					Touched.push_back(Index);
+				Delta = 0;
+				Shift = 0;
+				}
+			Block = *(const uint32 *) p;
+			}
+		}
+	}
+
 void USorter::SearchSeq(const byte *Seq, uint L, vector<uint> &TopSeqIndexes,
   vector<uint> &TopWordCounts)
 	{
@@ -88,43 +216,40 @@ void USorter::SearchSeq(const byte *Seq, uint L, vector<uint> &TopSeqIndexes,
 
 	if (L < m_WordLength)
 		return;
-	const uint WordCount = L + 1 - m_WordLength;
+	vector<uint32> Words;
+	GetWords(Seq, L, Words);
 	vector<uint> U(IndexSize, 0);
-	for (uint i = 0; i < WordCount; ++i)
-		{
-		uint Word = CharsToWord(Seq + i);
-		if (Word >= m_DictSize)
-			continue;
-		const vector<uint> &Row = m_Rows[Word];
-		const uint n = SIZE(Row);
-		for (uint j = 0; j < n; ++j)
-			{
-			uint TargetSeqIndex = Row[j];
-			asserta(TargetSeqIndex < IndexSize);
-			U[TargetSeqIndex] += 1;
-			}
-		}
-	uint *Order = myalloc(uint, IndexSize);
-	QuickSortOrderDesc(U.data(), IndexSize, Order);
-	uint TopSeqIndex = Order[0];
-	uint TopWordCount = U[TopSeqIndex];
+	vector<uint> Touched;
+	CountHits(Words, U.data(), Touched);
+	if (Touched.empty())
+		return;
+
+	uint TopWordCount = 0;
+	for (uint i = 0; i < SIZE(Touched); ++i)
+		TopWordCount = max(TopWordCount, U[Touched[i]]);
 	uint MinU = TopWordCount/2 - 1;
 	if (MinU == 0)
 		MinU = 1;
-	uint LastWordCount = TopWordCount;
-	for (uint i = 0; i < IndexSize; ++i)
+
+// Only sequences with hits are ranked, ties go to the earlier index
+	vector<uint> Order;
+	for (uint i = 0; i < SIZE(Touched); ++i)
+		if (U[Touched[i]] >= MinU)
+			Order.push_back(Touched[i]);
+	sort(Order.begin(), Order.end(),
+	  [&U](uint Index1, uint Index2)
+		{
+		return U[Index1] > U[Index2] ||
+		  (U[Index1] == U[Index2] && Index1 < Index2);
+		});
+
+	const uint n = SIZE(Order);
+	for (uint i = 0; i < n; ++i)
 		{
 		uint Index = Order[i];
-		uint WordCount = U[Index];
-		asserta(WordCount <= LastWordCount);
-		LastWordCount = WordCount;
-		if (WordCount < MinU)
-			break;
-		uint SeqIndex = m_IndexSeqIndexes[Index];
-		TopSeqIndexes.push_back(SeqIndex);
-		TopWordCounts.push_back(WordCount);
+		TopSeqIndexes.push_back(m_IndexSeqIndexes[Index]);
+		TopWordCounts.push_back(U[Index]);
 		}
-	myfree(Order);
 	}
 
 void cmd_usorter()
@@ -1,13 +1,34 @@
 #pragma once
 
+/***
+Word index for candidate search. Postings for each word are the
+index numbers (order of AddSeq) of the sequences containing it, one
+entry per occurrence, stored as varint-coded deltas in chains of
+fixed-size blocks in one arena. AddSeq appends in increasing index
+order so deltas are small and the index can grow while it is being
+searched (UClust adds each new centroid). m_SyncmerD > 1 (option
+-usorter_syncmer) indexes and counts only open syncmers, about
+1/m_SyncmerD of the words, using kmerscan.h codes.
+***/
+static const uint USORTER_BLOCK_BYTES = 32;
+static const uint USORTER_BLOCK_DATA = USORTER_BLOCK_BYTES - sizeof(uint32);
+
 class USorter
 	{
 public:
 	const MultiSequence m_MFA;
-	vector<vector<uint> > m_Rows;
 	vector<uint> m_IndexSeqIndexes;
 	uint m_WordLength = 0; // 3;
 	uint m_DictSize = 0; // myipow(20, 3);
+	uint m_SyncmerD = 0;
+
+// Block = next block (uint32, UINT32_MAX at end) + USORTER_BLOCK_DATA bytes
+	vector<byte> m_Blocks;
+	vector<uint32> m_Heads;
+	vector<uint32> m_Tails;
+	vector<byte> m_TailBytes;
+	vector<uint32> m_LastIndexes;
+	uint64 m_PostingCount = 0;
 
 public:
 	void Init();
@@ -15,6 +36,15 @@ public:
 	uint CharsToWord(const byte *Chars);
 	uint CharsToWord_Nucleo(const byte *Chars);
 	uint CharsToWord_Amino(const byte *Chars);
+	void GetWords(const byte *Seq, uint L, vector<uint32> &Words);
 	void SearchSeq(const byte *Seq, uint L,
 	  vector<uint> &TopSeqIndexes, vector<uint> &TopWordCounts);
+	void CountHits(const vector<uint32> &Words, uint *U,
+	  vector<uint> &Touched) const;
+	uint GetIndexSize() const { return SIZE(m_IndexSeqIndexes); }
+
+private:
+	uint32 AllocBlock();
+	void AppendByte(uint32 Word, byte b);
+	void AppendPosting(uint32 Word, uint32 Index);
 	};
@@ -49,8 +49,8 @@ static void SetGaps(float IntOpen, float IntExt, float TermOpen, float TermExt)
 	g_AP_ExtB = IntExt;
 	}
 
-static float ViterbiMega(XDPMem &Mem, const vector<vector<byte> > &ProfA,
-   const vector<vector<byte> > &ProfB, PathInfo &PI)
+static float ViterbiMega(XDPMem &Mem, const MegaProfile &ProfA,
+   const MegaProfile &ProfB, PathInfo &PI)
 	{
 	const uint LA = SIZE(ProfA);
 	const uint LB = SIZE(ProfB);
@@ -59,7 +59,9 @@ static float ViterbiMega(XDPMem &Mem, const vector<vector<byte> > &ProfA,
 
 	Mem.Alloc(LA, LB);
 	PI.Alloc2(LA, LB);
-	
+	const uint IdxA = Mega::GetProfileIdx(ProfA);
+	const uint IdxB = Mega::GetProfileIdx(ProfB);
+	vector<float> MatchRow(LB);
 
 	float OpenA = g_AP_LOpenA;
 	float ExtA = g_AP_LExtA;
@@ -87,6 +89,7 @@ static float ViterbiMega(XDPMem &Mem, const vector<vector<byte> > &ProfA,
 		float I0 = MINUS_INFINITY;
 
 		byte *TBrow = TB[i];
+		Mega::GetMatchScoreRow(true, IdxA, i, IdxB, MatchRow.data());
 		for (unsigned j = 0; j < LB; ++j)
 			{
 			//byte b = B[j];
@@ -112,7 +115,7 @@ static float ViterbiMega(XDPMem &Mem, const vector<vector<byte> > &ProfA,
 				}
 			M0 = Mrow[j];
 
-			float MatchScore = Mega::GetMatchScore_LogOdds(ProfA, i, ProfB, j);
+			float MatchScore = MatchRow[j];
 			Mrow[j] = xM + MatchScore;
 		// Mrow[j] = DPM[i+1][j+1])
 			}
@@ -232,8 +235,8 @@ void AlignMega2()
 
 	XDPMem Mem;
 	PathInfo *PI = ObjMgr::GetPathInfo();
-	const vector<vector<byte> > &ProfA = Mega::GetProfile(0);
-	const vector<vector<byte> > &ProfB = Mega::GetProfile(1);
+	const MegaProfile &ProfA = Mega::GetProfile(0);
+	const MegaProfile &ProfB = Mega::GetProfile(1);
 	float Score = ViterbiMega(Mem, ProfA, ProfB, *PI);
 	if (!optset_output)
 		return;